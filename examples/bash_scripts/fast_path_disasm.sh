@@ -0,0 +1,35 @@
+#!/bin/bash
+# fast_path_disasm.sh
+
+# This script checks the markers of the fast_path benchmark in the disassembly.
+# For each binary and function, it prints the number of instructions up to the
+# first ret, which is the path taken while the buffer has room, and fails if
+# that path calls anything (e.g. __tls_get_addr or a TLS wrapper function).
+#
+# Usage: fast_path_disasm.sh <binary> <function> [<binary> <function> ...]
+
+status=0
+while [ $# -ge 2 ]; do
+  path=$(objdump -d --no-show-raw-insn "$1" |
+    awk -v fn="<$2>:" '$2 == fn { p = 1; next }
+                       p && /^$/ { exit }
+                       p { print }
+                       p && /\tret/ { exit }')
+
+  if [ -z "$path" ]; then
+    echo "$2 not found in $1"
+    exit 1
+  fi
+
+  count=$(echo "$path" | wc -l)
+  calls=$(echo "$path" | grep -c "call")
+  echo "$2 in $1: $count instructions up to ret, $calls calls"
+
+  if [ "$calls" -ne 0 ]; then
+    echo "$path" | grep "call"
+    status=1
+  fi
+  shift 2
+done
+
+exit $status
@@ -0,0 +1,79 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <nlohmann/json.hpp>
+#include <tracr/tracr.hpp>
+#include <vector>
+
+/**
+ * How much tracing slows down a kernel whose working set fits into the cache.
+ * Between two sweeps over an array, a burst of SET and RESET markers is
+ * recorded, and only the sweeps are timed. Build it without TraCR, with TraCR
+ * and with TRACR_NT_STORES and compare the time per sweep: plain stores pull
+ * the lines of the trace buffer into the caches and evict the array,
+ * non-temporal stores don't.
+ *
+ * Usage: cache_pollution [array KiB] [events per sweep] [sweeps]
+ */
+int main(int argc, char **argv) {
+  const size_t array_kib = (argc > 1) ? std::atoi(argv[1]) : 1536;
+  const size_t burst = (argc > 2) ? std::atoi(argv[2]) : 4096;
+  const size_t sweeps = (argc > 3) ? std::atoi(argv[3]) : 200;
+
+  std::vector<uint64_t> array(array_kib * 1024 / sizeof(uint64_t), 1);
+
+  // Initialize TraCR
+  INSTRUMENTATION_START();
+
+  // Warm up the caches
+  uint64_t sum = 0;
+  for (uint64_t value : array) {
+    sum += value;
+  }
+
+  std::chrono::duration<double> time(0);
+  for (size_t sweep = 0; sweep < sweeps; ++sweep) {
+    for (size_t i = 0; i < burst / 2; ++i) {
+      INSTRUMENTATION_MARK_SET(0, 1, uint32_t(i));
+      INSTRUMENTATION_MARK_RESET(0);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t value : array) {
+      sum += value;
+    }
+    auto stop = std::chrono::steady_clock::now();
+    time += stop - start;
+  }
+
+  const char *stores = "no";
+  if (INSTRUMENTATION_ACTIVE) {
+    nlohmann::json json = nlohmann::json::parse(INSTRUMENTATION_GET_JSON_STR());
+    stores = json.contains("nt_stores") ? "non-temporal" : "plain";
+  }
+
+  printf("%zu KiB array, %zu events per sweep with %s stores: %f[us] per "
+         "sweep (checksum %lu)\n",
+         array_kib, burst, stores, time.count() * 1e6 / double(sweeps),
+         static_cast<unsigned long>(sum));
+
+  // TraCR finished
+  INSTRUMENTATION_END();
+
+  return 0;
+}
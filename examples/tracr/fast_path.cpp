@@ -0,0 +1,100 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <tracr/tracr.hpp>
+#include <unistd.h>
+
+/**
+ * The same markers as fast_path_mark_pair(), inside a shared object
+ */
+extern "C" void fast_path_lib_mark_pair(uint32_t i);
+
+/**
+ * The markers of the header-only build
+ */
+extern "C" __attribute__((noinline)) void fast_path_mark_pair(uint32_t i) {
+  INSTRUMENTATION_MARK_SET(0, 1, i);
+  INSTRUMENTATION_MARK_RESET(0);
+}
+
+/**
+ * Time n_sets calls of mark_pair and count the user space instructions
+ * retired meanwhile (-1 if the kernel offers no counter, e.g. in a VM)
+ */
+static void measure(const char *name, void (*mark_pair)(uint32_t),
+                    uint32_t n_sets) {
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  const int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+
+  if (fd >= 0) {
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < n_sets; ++i) {
+    mark_pair(i);
+  }
+  auto stop = std::chrono::steady_clock::now();
+
+  long long instructions = -1;
+  if (fd >= 0) {
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &instructions, sizeof(instructions)) != sizeof(instructions)) {
+      instructions = -1;
+    }
+    close(fd);
+  }
+
+  std::chrono::duration<double> time = (stop - start);
+  printf("%-12s %f[ns] and %.1f instructions per event\n", name,
+         time.count() * 1e9 / double(2 * n_sets),
+         (instructions < 0) ? -1.0 : instructions / double(2 * n_sets));
+}
+
+/**
+ * Cost per marker, with the markers compiled into the executable and into a
+ * shared object (build with and without TRACR_FAST_PATH to compare). The
+ * instructions of the markers are checked by fast_path_disasm.sh.
+ *
+ * Usage: fast_path [n_sets]
+ */
+int main(int argc, char **argv) {
+  const uint32_t n_sets = (argc > 1) ? std::atoi(argv[1]) : 200000;
+
+  // Initialize TraCR
+  INSTRUMENTATION_START();
+
+  measure("header-only", fast_path_mark_pair, n_sets);
+  measure("shared", fast_path_lib_mark_pair, n_sets);
+
+  // TraCR finished
+  INSTRUMENTATION_END();
+
+  return 0;
+}
@@ -0,0 +1,25 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <tracr/tracr.hpp>
+
+/**
+ * The markers of fast_path.cpp, compiled into a shared object
+ */
+extern "C" void fast_path_lib_mark_pair(uint32_t i) {
+  INSTRUMENTATION_MARK_SET(0, 1, i);
+  INSTRUMENTATION_MARK_RESET(0);
+}
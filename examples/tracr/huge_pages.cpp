@@ -0,0 +1,85 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <nlohmann/json.hpp>
+#include <thread>
+#include <tracr/tracr.hpp>
+#include <vector>
+
+/**
+ * Per-event cost of recording into buffers backed by base pages and by huge
+ * pages (build with TRACR_HUGE_PAGES). Each round starts fresh TraCR threads
+ * whose buffers are mapped with the backing set in TRACR_PAGE_BACKING, so the
+ * cost includes the first touch of every page of the buffer.
+ *
+ * Usage: huge_pages [num_threads] [n_sets per thread]
+ */
+int main(int argc, char **argv) {
+  const int num_threads = (argc > 1) ? std::atoi(argv[1]) : 4;
+  const uint32_t n_sets = (argc > 2) ? std::atoi(argv[2]) : 500000;
+
+  // Initialize TraCR
+  INSTRUMENTATION_START();
+
+  for (const char *backing : {"base", "thp", "hugetlb"}) {
+    setenv("TRACR_PAGE_BACKING", backing, 1);
+
+    std::vector<double> ns_per_event(num_threads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+      threads.emplace_back([&ns_per_event, n_sets, t]() {
+        INSTRUMENTATION_THREAD_INIT();
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < n_sets; ++i) {
+          INSTRUMENTATION_MARK_SET(0, i % 128u, i);
+          INSTRUMENTATION_MARK_RESET(0);
+        }
+        auto stop = std::chrono::steady_clock::now();
+
+        std::chrono::duration<double> time = (stop - start);
+        ns_per_event[t] = time.count() * 1e9 / double(2 * n_sets);
+
+        INSTRUMENTATION_THREAD_FINALIZE();
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+
+    double mean = 0;
+    for (double ns : ns_per_event) {
+      mean += ns / num_threads;
+    }
+    printf("TRACR_PAGE_BACKING=%-7s %d threads x %u events: %f[ns] per event\n",
+           backing, num_threads, 2 * n_sets, mean);
+  }
+
+  // The backing each buffer actually got
+  if (INSTRUMENTATION_ACTIVE) {
+    nlohmann::json json = nlohmann::json::parse(INSTRUMENTATION_GET_JSON_STR());
+    if (json.contains("huge_pages")) {
+      printf("huge_pages: %s\n", json["huge_pages"].dump().c_str());
+    }
+  }
+
+  // TraCR finished
+  INSTRUMENTATION_END();
+
+  return 0;
+}
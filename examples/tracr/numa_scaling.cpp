@@ -0,0 +1,110 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <pthread.h>
+#include <sched.h>
+#include <thread>
+#include <tracr/numa_placement.hpp>
+#include <tracr/tracr.hpp>
+#include <vector>
+
+/**
+ * Per-event cost over the number of threads, each pinned to its own CPU, with
+ * every TRACR_NUMA_POLICY (build with TRACR_NUMA_LOCAL). Before its
+ * INSTRUMENTATION_THREAD_INIT() every thread prefers the memory of the next
+ * node, like a misplaced allocation would. With the policy "none" its buffer
+ * then lives on the remote node, with "preferred" and "bind" on its own.
+ *
+ * Usage: numa_scaling [n_sets per thread]
+ */
+int main(int argc, char **argv) {
+  const uint32_t n_sets = (argc > 1) ? std::atoi(argv[1]) : 500000;
+
+  // The CPUs this process may run on
+  cpu_set_t allowed;
+  sched_getaffinity(0, sizeof(allowed), &allowed);
+  std::vector<int> cpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &allowed)) {
+      cpus.push_back(cpu);
+    }
+  }
+
+  printf("%zu CPUs on %d NUMA nodes\n", cpus.size(), TraCR::num_numa_nodes());
+
+  // Initialize TraCR
+  INSTRUMENTATION_START();
+
+  for (size_t num_threads = 1; num_threads <= cpus.size(); num_threads *= 2) {
+    for (const char *policy : {"none", "preferred", "bind"}) {
+      setenv("TRACR_NUMA_POLICY", policy, 1);
+
+      std::vector<double> ns_per_event(num_threads);
+      std::vector<std::thread> threads;
+      for (size_t t = 0; t < num_threads; ++t) {
+        // Spread the threads over all allowed CPUs (and hence nodes)
+        const int cpu = cpus[t * cpus.size() / num_threads];
+
+        threads.emplace_back([&ns_per_event, n_sets, t, cpu]() {
+          cpu_set_t set;
+          CPU_ZERO(&set);
+          CPU_SET(cpu, &set);
+          pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+          // Misplace the memory of this thread on the next node
+          const int remote =
+              (TraCR::current_numa_node() + 1) % TraCR::num_numa_nodes();
+          constexpr int BITS = 8 * sizeof(unsigned long);
+          unsigned long mask[TraCR::MAX_NUMA_NODES / BITS] = {};
+          mask[remote / BITS] = 1UL << (remote % BITS);
+          syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask,
+                  TraCR::MAX_NUMA_NODES + 1);
+
+          INSTRUMENTATION_THREAD_INIT();
+
+          auto start = std::chrono::steady_clock::now();
+          for (uint32_t i = 0; i < n_sets; ++i) {
+            INSTRUMENTATION_MARK_SET(0, i % 128u, i);
+            INSTRUMENTATION_MARK_RESET(0);
+          }
+          auto stop = std::chrono::steady_clock::now();
+
+          std::chrono::duration<double> time = (stop - start);
+          ns_per_event[t] = time.count() * 1e9 / double(2 * n_sets);
+
+          INSTRUMENTATION_THREAD_FINALIZE();
+        });
+      }
+      for (auto &thread : threads) {
+        thread.join();
+      }
+
+      double mean = 0;
+      for (double ns : ns_per_event) {
+        mean += ns / num_threads;
+      }
+      printf("%3zu threads TRACR_NUMA_POLICY=%-9s %f[ns] per event\n",
+             num_threads, policy, mean);
+    }
+  }
+
+  // TraCR finished
+  INSTRUMENTATION_END();
+
+  return 0;
+}
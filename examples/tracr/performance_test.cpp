@@ -40,6 +40,22 @@ int main(void) {
          2 * n_sets, perf_time.count() * 1e6,
          perf_time.count() * 1e9 / double(2 * n_sets));
 
+  // performance test with the coarse clock (ticking every 10us)
+  INSTRUMENTATION_COARSE_CLOCK(10);
+
+  perf_test_start = std::chrono::system_clock::now();
+  for (uint16_t i = 0; i < n_sets; ++i) {
+    INSTRUMENTATION_MARK_SET_COARSE(0, i % 128u, uint32_t(i));
+    INSTRUMENTATION_MARK_RESET_COARSE(0);
+  }
+  perf_test_stop = std::chrono::system_clock::now();
+
+  perf_time = (perf_test_stop - perf_test_start);
+
+  printf("Setting %d coarse markers costs: %f[ms] and on average: %f[ns]\n",
+         2 * n_sets, perf_time.count() * 1e6,
+         perf_time.count() * 1e9 / double(2 * n_sets));
+
   // TraCR finished
   INSTRUMENTATION_END();
 
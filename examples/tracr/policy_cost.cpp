@@ -0,0 +1,61 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <nlohmann/json.hpp>
+#include <tracr/tracr.hpp>
+
+/**
+ * Per-event cost of a policy. Build it once per TRACR_POLICY_* flag and once
+ * with TRACR_RUNTIME_POLICY, run the latter with TRACR_POLICY and
+ * TRACR_CAPACITY, and compare: the runtime policy only steps in once the
+ * buffer is full. With a capacity below the events, the ignore and periodic
+ * policies also show the cost of a full buffer.
+ *
+ * Usage: policy_cost [n_sets]
+ */
+int main(int argc, char **argv) {
+  const uint32_t n_sets = (argc > 1) ? std::atoi(argv[1]) : 500000;
+
+  // Initialize TraCR
+  INSTRUMENTATION_START();
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < n_sets; ++i) {
+    INSTRUMENTATION_MARK_SET(0, i % 128u, i);
+    INSTRUMENTATION_MARK_RESET(0);
+  }
+  auto stop = std::chrono::steady_clock::now();
+
+  const char *mode = "compiled-in";
+  if (INSTRUMENTATION_ACTIVE) {
+    nlohmann::json json = nlohmann::json::parse(INSTRUMENTATION_GET_JSON_STR());
+    if (json.contains("runtime_policy")) {
+      mode = "runtime";
+      printf("runtime_policy: %s\n", json["runtime_policy"].dump().c_str());
+    }
+  }
+
+  std::chrono::duration<double> time = (stop - start);
+  printf("%u events with the %s policy: %f[ns] per event\n", 2 * n_sets, mode,
+         time.count() * 1e9 / double(2 * n_sets));
+
+  // TraCR finished
+  INSTRUMENTATION_END();
+
+  return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <nlohmann/json.hpp>
+#include <thread>
+#include <tracr/tracr.hpp>
+#include <vector>
+
+/**
+ * Cost of tracing a runtime that keeps creating short-lived threads, more of
+ * them than there are CPUs. Build it with per-thread buffers, with
+ * TRACR_BUFFER_POOL (optionally with TRACR_POOL_CHUNK) and with TRACR_PER_CPU
+ * and compare the time per thread: each TraCR thread maps a buffer of its own
+ * and faults its pages, pooled buffers are recycled with their pages, while
+ * the per-CPU buffers are shared by all threads.
+ *
+ * Usage: thread_churn [threads] [events per thread] [threads at once]
+ */
+int main(int argc, char **argv) {
+  const size_t num_threads = (argc > 1) ? std::atoi(argv[1]) : 2000;
+  const size_t n_events = (argc > 2) ? std::atoi(argv[2]) : 200;
+  const size_t at_once = (argc > 3)
+                             ? std::atoi(argv[3])
+                             : 4 * std::thread::hardware_concurrency();
+
+  // Initialize TraCR
+  INSTRUMENTATION_START();
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t first = 0; first < num_threads; first += at_once) {
+    std::vector<std::thread> threads;
+    for (size_t t = first; t < std::min(first + at_once, num_threads); ++t) {
+      threads.emplace_back([n_events, t]() {
+        INSTRUMENTATION_THREAD_INIT();
+
+        for (size_t i = 0; i < n_events / 2; ++i) {
+          INSTRUMENTATION_MARK_SET(0, 1, uint32_t(t));
+          INSTRUMENTATION_MARK_RESET(0);
+        }
+
+        INSTRUMENTATION_THREAD_FINALIZE();
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+  auto stop = std::chrono::steady_clock::now();
+
+  std::chrono::duration<double> time = (stop - start);
+  const char *buffers = "no";
+  if (INSTRUMENTATION_ACTIVE) {
+    nlohmann::json json = nlohmann::json::parse(INSTRUMENTATION_GET_JSON_STR());
+    buffers = json.contains("cpu_buffers")   ? "per-CPU"
+              : json.contains("buffer_pool") ? "pooled"
+                                             : "per-thread";
+
+    for (const char *key : {"cpu_buffers", "buffer_pool"}) {
+      if (json.contains(key)) {
+        printf("%s: %s\n", key, json[key].dump().c_str());
+      }
+    }
+  }
+
+  printf("%zu threads (%zu at once) x %zu events with %s buffers: %f[us] per "
+         "thread\n",
+         num_threads, at_once, n_events, buffers,
+         time.count() * 1e6 / double(num_threads));
+
+  // TraCR finished
+  INSTRUMENTATION_END();
+
+  return 0;
+}
@@ -0,0 +1,483 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file bts_compression.hpp
+ * @brief Block compression of the records of .bts files
+ * @author Noah Andrés Baumann
+ * @date 16/10/2026
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "bts_format.hpp"
+
+namespace TraCR {
+
+/**
+ * Compresses the records of a .bts file block by block. Each block is
+ * transformed first, so the LZ stage sees long runs of equal bytes:
+ *
+ *  1. With delta, the trailing 64-bit timestamp of each record is replaced by
+ *     its difference to the previous record of the block (standard payloads;
+ *     compact records already hold deltas).
+ *  2. Byte shuffle: byte k of all records is stored together, for each k.
+ *
+ * The LZ stage uses the LZ4 block format: sequences of a token (literal and
+ * match length), the literals, a 16-bit offset and the remaining match length.
+ * It is written here to keep TraCR free of dependencies.
+ */
+class BlockCodec {
+public:
+  // Matches are at least this long
+  static constexpr size_t MIN_MATCH = 4;
+
+  // The last bytes of a block are always literals, so the compressor can read
+  // 4 bytes ahead without checks
+  static constexpr size_t LAST_LITERALS = 8;
+
+  // Matches reach at most this far back
+  static constexpr size_t MAX_OFFSET = 65535;
+
+  // log2 of the number of entries of the match finder
+  static constexpr int HASH_BITS = 14;
+
+  // Records transposed at once by the byte shuffle
+  static constexpr size_t SHUFFLE_TILE = 16;
+
+  /**
+   * Compress the records of first followed by the ones of second into the
+   * block index and the block data of a compressed .bts file
+   */
+  static inline std::string compress(const void *first, size_t firstBytes,
+                                     const void *second, size_t secondBytes,
+                                     size_t recordSize, bool delta) {
+    const size_t totalBytes = firstBytes + secondBytes;
+
+    // Blocks hold whole records
+    const size_t blockBytes = BTS_BLOCK_BYTES / recordSize * recordSize;
+    const uint64_t numBlocks = (totalBytes + blockBytes - 1) / blockBytes;
+
+    std::vector<BtsBlock> index(numBlocks);
+    std::string data;
+    data.reserve(totalBytes / 4);
+
+    std::vector<uint8_t> raw(std::min(blockBytes, totalBytes));
+    std::vector<uint8_t> shuffled(raw.size());
+    std::vector<uint32_t> table(size_t(1) << HASH_BITS);
+
+    for (uint64_t b = 0; b < numBlocks; ++b) {
+      const size_t begin = b * blockBytes;
+      const size_t bytes = std::min(blockBytes, totalBytes - begin);
+
+      // The block may straddle the two ranges
+      gather(first, firstBytes, second, begin, bytes, raw.data());
+
+      transform(raw.data(), bytes, recordSize, delta, shuffled.data());
+
+      const size_t before = data.size();
+      lz_compress(shuffled.data(), bytes, data, table);
+
+      BtsBlock &block = index[b];
+      block.raw_bytes = static_cast<uint32_t>(bytes);
+      block.codec = static_cast<uint8_t>(BtsBlockCodec::SHUFFLE_LZ);
+
+      if (data.size() - before >= bytes) {
+        // transform() changed the timestamps in place
+        gather(first, firstBytes, second, begin, bytes, raw.data());
+        data.resize(before);
+        data.append(reinterpret_cast<const char *>(raw.data()), bytes);
+        block.codec = static_cast<uint8_t>(BtsBlockCodec::STORED);
+      }
+      block.stored_bytes = static_cast<uint32_t>(data.size() - before);
+    }
+
+    std::string out;
+    out.reserve(sizeof(numBlocks) + sizeof(BtsBlock) * numBlocks +
+                data.size());
+    out.append(reinterpret_cast<const char *>(&numBlocks), sizeof(numBlocks));
+    out.append(reinterpret_cast<const char *>(index.data()),
+               sizeof(BtsBlock) * numBlocks);
+    out.append(data);
+
+    return out;
+  }
+
+  /**
+   * Decompress the data of one block into its block.raw_bytes bytes at dst.
+   * Returns false if the data is corrupt.
+   */
+  static inline bool decompress(const BtsBlock &block, const uint8_t *src,
+                                uint8_t *dst, size_t recordSize, bool delta) {
+    if (block.codec == static_cast<uint8_t>(BtsBlockCodec::STORED)) {
+      if (block.stored_bytes != block.raw_bytes) {
+        return false;
+      }
+      std::memcpy(dst, src, block.raw_bytes);
+      return true;
+    }
+
+    if (block.codec != static_cast<uint8_t>(BtsBlockCodec::SHUFFLE_LZ) ||
+        block.raw_bytes % recordSize != 0) {
+      return false;
+    }
+
+    std::vector<uint8_t> shuffled(block.raw_bytes);
+    if (!lz_decompress(src, block.stored_bytes, shuffled.data(),
+                       block.raw_bytes)) {
+      return false;
+    }
+
+    untransform(shuffled.data(), block.raw_bytes, recordSize, delta, dst);
+    return true;
+  }
+
+private:
+  /**
+   * Copy bytes bytes starting at begin of the concatenation of the two ranges
+   */
+  static inline void gather(const void *first, size_t firstBytes,
+                            const void *second, size_t begin, size_t bytes,
+                            uint8_t *dst) {
+    if (begin < firstBytes) {
+      const size_t n = std::min(bytes, firstBytes - begin);
+      std::memcpy(dst, static_cast<const uint8_t *>(first) + begin, n);
+      dst += n;
+      begin += n;
+      bytes -= n;
+    }
+    if (bytes > 0) {
+      std::memcpy(dst,
+                  static_cast<const uint8_t *>(second) + (begin - firstBytes),
+                  bytes);
+    }
+  }
+
+  /**
+   * Byte k of record i goes to dst[k * count + i]. Transposes tiles of
+   * SHUFFLE_TILE records through a local buffer, so every stream is written
+   * SHUFFLE_TILE bytes at a time.
+   */
+  template <size_t RecordSize>
+  static inline void shuffle(const uint8_t *records, size_t count,
+                             uint8_t *dst) {
+    const size_t tiled = count / SHUFFLE_TILE * SHUFFLE_TILE;
+
+    for (size_t i = 0; i < tiled; i += SHUFFLE_TILE) {
+      uint8_t tile[RecordSize][SHUFFLE_TILE];
+      for (size_t j = 0; j < SHUFFLE_TILE; ++j) {
+        for (size_t k = 0; k < RecordSize; ++k) {
+          tile[k][j] = records[(i + j) * RecordSize + k];
+        }
+      }
+      for (size_t k = 0; k < RecordSize; ++k) {
+        std::memcpy(dst + k * count + i, tile[k], SHUFFLE_TILE);
+      }
+    }
+
+    for (size_t i = tiled; i < count; ++i) {
+      for (size_t k = 0; k < RecordSize; ++k) {
+        dst[k * count + i] = records[i * RecordSize + k];
+      }
+    }
+  }
+
+  /**
+   * The inverse of shuffle()
+   */
+  template <size_t RecordSize>
+  static inline void unshuffle(const uint8_t *shuffled, size_t count,
+                               uint8_t *records) {
+    const size_t tiled = count / SHUFFLE_TILE * SHUFFLE_TILE;
+
+    for (size_t i = 0; i < tiled; i += SHUFFLE_TILE) {
+      uint8_t tile[RecordSize][SHUFFLE_TILE];
+      for (size_t k = 0; k < RecordSize; ++k) {
+        std::memcpy(tile[k], shuffled + k * count + i, SHUFFLE_TILE);
+      }
+      for (size_t j = 0; j < SHUFFLE_TILE; ++j) {
+        for (size_t k = 0; k < RecordSize; ++k) {
+          records[(i + j) * RecordSize + k] = tile[k][j];
+        }
+      }
+    }
+
+    for (size_t i = tiled; i < count; ++i) {
+      for (size_t k = 0; k < RecordSize; ++k) {
+        records[i * RecordSize + k] = shuffled[k * count + i];
+      }
+    }
+  }
+
+  /**
+   * Delta-encode the timestamps (in place) and shuffle the bytes into dst
+   */
+  static inline void transform(uint8_t *records, size_t bytes,
+                               size_t recordSize, bool delta, uint8_t *dst) {
+    const size_t count = bytes / recordSize;
+
+    if (delta) {
+      uint64_t prev = 0;
+      for (size_t i = 0; i < count; ++i) {
+        uint8_t *ts = records + i * recordSize + recordSize - sizeof(uint64_t);
+        uint64_t value;
+        std::memcpy(&value, ts, sizeof(value));
+        const uint64_t diff = value - prev;
+        std::memcpy(ts, &diff, sizeof(diff));
+        prev = value;
+      }
+    }
+
+    switch (recordSize) {
+    case sizeof(uint64_t): // compact records
+      shuffle<sizeof(uint64_t)>(records, count, dst);
+      break;
+    case 2 * sizeof(uint64_t): // standard payloads
+      shuffle<2 * sizeof(uint64_t)>(records, count, dst);
+      break;
+    default:
+      for (size_t k = 0; k < recordSize; ++k) {
+        for (size_t i = 0; i < count; ++i) {
+          dst[k * count + i] = records[i * recordSize + k];
+        }
+      }
+    }
+  }
+
+  /**
+   * The inverse of transform()
+   */
+  static inline void untransform(const uint8_t *shuffled, size_t bytes,
+                                 size_t recordSize, bool delta,
+                                 uint8_t *records) {
+    const size_t count = bytes / recordSize;
+
+    switch (recordSize) {
+    case sizeof(uint64_t):
+      unshuffle<sizeof(uint64_t)>(shuffled, count, records);
+      break;
+    case 2 * sizeof(uint64_t):
+      unshuffle<2 * sizeof(uint64_t)>(shuffled, count, records);
+      break;
+    default:
+      for (size_t k = 0; k < recordSize; ++k) {
+        for (size_t i = 0; i < count; ++i) {
+          records[i * recordSize + k] = shuffled[k * count + i];
+        }
+      }
+    }
+
+    if (delta) {
+      uint64_t prev = 0;
+      for (size_t i = 0; i < count; ++i) {
+        uint8_t *ts = records + i * recordSize + recordSize - sizeof(uint64_t);
+        uint64_t diff;
+        std::memcpy(&diff, ts, sizeof(diff));
+        prev += diff;
+        std::memcpy(ts, &prev, sizeof(prev));
+      }
+    }
+  }
+
+  /**
+   *
+   */
+  static inline uint32_t read32(const uint8_t *p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+  }
+
+  /**
+   *
+   */
+  static inline uint64_t read64(const uint8_t *p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+  }
+
+  /**
+   * Append a length of 15 or more as a run of 255s and the rest
+   */
+  static inline void put_length(size_t length, std::string &out) {
+    for (; length >= 255; length -= 255) {
+      out.push_back(static_cast<char>(255));
+    }
+    out.push_back(static_cast<char>(length));
+  }
+
+  /**
+   * Append a sequence of the literals [literals, literals + numLiterals)
+   * followed by a match of matchLength bytes at offset (none if 0)
+   */
+  static inline void put_sequence(const uint8_t *literals, size_t numLiterals,
+                                  size_t offset, size_t matchLength,
+                                  std::string &out) {
+    const size_t match = (offset > 0) ? matchLength - MIN_MATCH : 0;
+
+    out.push_back(static_cast<char>((std::min<size_t>(numLiterals, 15) << 4) |
+                                    std::min<size_t>(match, 15)));
+    if (numLiterals >= 15) {
+      put_length(numLiterals - 15, out);
+    }
+    out.append(reinterpret_cast<const char *>(literals), numLiterals);
+
+    if (offset > 0) {
+      out.push_back(static_cast<char>(offset & 0xff));
+      out.push_back(static_cast<char>(offset >> 8));
+      if (match >= 15) {
+        put_length(match - 15, out);
+      }
+    }
+  }
+
+  /**
+   * Greedy LZ with a single-entry hash table of the positions of 4-byte
+   * sequences. Skips faster through data without matches.
+   */
+  static inline void lz_compress(const uint8_t *src, size_t bytes,
+                                 std::string &out,
+                                 std::vector<uint32_t> &table) {
+    std::fill(table.begin(), table.end(), 0);
+
+    size_t anchor = 0;
+    size_t pos = 0;
+
+    while (bytes >= LAST_LITERALS + MIN_MATCH &&
+           pos + MIN_MATCH <= bytes - LAST_LITERALS) {
+      const uint32_t sequence = read32(src + pos);
+      const uint32_t hash = (sequence * 2654435761U) >> (32 - HASH_BITS);
+
+      // Positions are stored plus one, so 0 means empty
+      const size_t candidate = table[hash];
+      table[hash] = static_cast<uint32_t>(pos + 1);
+
+      if (candidate == 0 || pos + 1 - candidate > MAX_OFFSET ||
+          read32(src + candidate - 1) != sequence) {
+        pos += 1 + ((pos - anchor) >> 6);
+        continue;
+      }
+
+      const size_t ref = candidate - 1;
+
+      // Compare 8 bytes at a time. On the little-endian targets of TraCR, the
+      // lowest set bit of the difference lies in the first differing byte.
+      const size_t limit = bytes - LAST_LITERALS - pos;
+      size_t length = MIN_MATCH;
+      while (length + sizeof(uint64_t) <= limit) {
+        const uint64_t diff =
+            read64(src + ref + length) ^ read64(src + pos + length);
+        if (diff != 0) {
+          length += __builtin_ctzll(diff) / 8;
+          break;
+        }
+        length += sizeof(uint64_t);
+      }
+      while (length < limit && src[ref + length] == src[pos + length]) {
+        ++length;
+      }
+
+      put_sequence(src + anchor, pos - anchor, pos - ref, length, out);
+      pos += length;
+      anchor = pos;
+    }
+
+    put_sequence(src + anchor, bytes - anchor, 0, 0, out);
+  }
+
+  /**
+   * Read a length continued by a run of 255s
+   */
+  static inline bool get_length(const uint8_t *&ip, const uint8_t *end,
+                                size_t &length) {
+    uint8_t byte;
+    do {
+      if (ip == end) {
+        return false;
+      }
+      byte = *ip++;
+      length += byte;
+    } while (byte == 255);
+    return true;
+  }
+
+  /**
+   * Decode the sequences of lz_compress() into exactly bytes bytes
+   */
+  static inline bool lz_decompress(const uint8_t *src, size_t srcBytes,
+                                   uint8_t *dst, size_t bytes) {
+    const uint8_t *ip = src;
+    const uint8_t *const ipEnd = src + srcBytes;
+    uint8_t *op = dst;
+    uint8_t *const opEnd = dst + bytes;
+
+    while (ip < ipEnd) {
+      const uint8_t token = *ip++;
+
+      size_t numLiterals = token >> 4;
+      if (numLiterals == 15 && !get_length(ip, ipEnd, numLiterals)) {
+        return false;
+      }
+      if (numLiterals > static_cast<size_t>(ipEnd - ip) ||
+          numLiterals > static_cast<size_t>(opEnd - op)) {
+        return false;
+      }
+      std::memcpy(op, ip, numLiterals);
+      ip += numLiterals;
+      op += numLiterals;
+
+      // The last sequence has no match
+      if (ip == ipEnd) {
+        break;
+      }
+
+      if (ipEnd - ip < 2) {
+        return false;
+      }
+      const size_t offset = ip[0] | (size_t(ip[1]) << 8);
+      ip += 2;
+
+      size_t length = token & 15;
+      if (length == 15 && !get_length(ip, ipEnd, length)) {
+        return false;
+      }
+      length += MIN_MATCH;
+
+      if (offset == 0 || offset > static_cast<size_t>(op - dst) ||
+          length > static_cast<size_t>(opEnd - op)) {
+        return false;
+      }
+
+      // May overlap, hence byte by byte
+      const uint8_t *match = op - offset;
+      for (size_t i = 0; i < length; ++i) {
+        op[i] = match[i];
+      }
+      op += length;
+    }
+
+    return op == opEnd;
+  }
+};
+
+} // namespace TraCR
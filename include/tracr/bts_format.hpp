@@ -0,0 +1,326 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file bts_format.hpp
+ * @brief On-disk layout of the .bts trace files and of the .tracr containers
+ * @author Noah Andrés Baumann
+ * @date 16/10/2026
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+
+namespace TraCR {
+
+/**
+ * A .bts file consists of:
+ *
+ *   BtsHeader | records | BtsEventCount[num_event_types] | BtsTrailer
+ *
+ * The header is written before the first record and describes how to read the
+ * records. The trailer is written on flush and summarizes them, so readers can
+ * inspect a file without scanning its records. A file without a trailer was not
+ * flushed completely; its records reach up to the end of the file, or up to
+ * published_records for a file-backed buffer (BTS_FLAG_MAPPED).
+ *
+ * Files written before the header existed are plain arrays of Payload.
+ *
+ * With BTS_FLAG_COMPRESSED the records are stored as independently compressed
+ * blocks instead:
+ *
+ *   uint64_t num_blocks | BtsBlock[num_blocks] | block data
+ */
+constexpr char BTS_MAGIC[8] = {'T', 'R', 'A', 'C', 'R', 'B', 'T', 'S'};
+constexpr char BTS_TRAILER_MAGIC[8] = {'T', 'R', 'A', 'C', 'R', 'E', 'N', 'D'};
+
+/**
+ * Readers reject files of a newer version. Fields are only ever appended to the
+ * header, hence a larger header_size of the same version is fine.
+ *
+ * Version 2 added compressed records (BTS_FLAG_COMPRESSED).
+ * Version 3 added the per-CPU records (BtsPayloadFormat::PER_CPU).
+ */
+constexpr uint16_t BTS_VERSION = 3;
+
+/**
+ * The layout of the records
+ */
+enum class BtsPayloadFormat : uint8_t {
+  // Payload
+  STANDARD = 0,
+
+  // Words of CompactCodec
+  COMPACT = 1,
+
+  // CpuRecord, a Payload followed by the TID of its thread
+  PER_CPU = 2
+};
+
+/**
+ * The policy the records were collected with
+ */
+enum class BtsPolicy : uint8_t {
+  ABORT = 0,
+  PERIODIC = 1,
+  IGNORE_IF_FULL = 2,
+  STREAMING = 3,
+  SEGMENTED = 4
+};
+
+/**
+ * Bits of BtsHeader::flags
+ */
+constexpr uint8_t BTS_FLAG_RAW_TIMESTAMPS = 1 << 0; // timestamps are ticks
+constexpr uint8_t BTS_FLAG_CAPTURE_CPU = 1 << 1;    // contains CPU payloads
+constexpr uint8_t BTS_FLAG_MAPPED = 1 << 2;         // file is the buffer
+constexpr uint8_t BTS_FLAG_COMPRESSED = 1 << 3;     // records are in blocks
+
+/**
+ * The header in front of the records
+ */
+struct BtsHeader {
+  char magic[8];
+  uint16_t version;
+  uint16_t header_size;
+  uint16_t record_size;
+  uint8_t payload_format; // BtsPayloadFormat
+  uint8_t policy;         // BtsPolicy
+  uint8_t timer_backend;  // TimerBackend
+  uint8_t flags;          // BTS_FLAG_*
+  uint16_t reserved0;
+
+  // With BtsPayloadFormat::PER_CPU, the CPU of the buffer
+  uint32_t cpu;
+
+  // The capacity of the trace buffer in records
+  uint64_t capacity;
+
+  // Counter frequency in Hz (0 if the timestamps are not counter based)
+  uint64_t frequency;
+
+  // kernel thread ID (-1 for the buffer of a CPU)
+  int64_t tid;
+
+  // With TRACR_MAPPED_BUFFER, the number of records published so far. Kept up
+  // to date while recording, so the records of a crashed run can be recovered.
+  uint64_t published_records;
+
+  // With TRACR_POLICY_SEGMENTED, the index of this segment of the thread
+  uint64_t segment;
+};
+
+static_assert(sizeof(BtsHeader) == 64, "BtsHeader layout changed");
+
+/**
+ * Number of events of one eventId, stored in front of the trailer
+ */
+struct BtsEventCount {
+  uint16_t eventId;
+  uint16_t reserved0;
+  uint32_t reserved1;
+  uint64_t count;
+};
+
+static_assert(sizeof(BtsEventCount) == 16, "BtsEventCount layout changed");
+
+/**
+ * The trailer at the very end of the file
+ */
+struct BtsTrailer {
+  char magic[8];
+
+  // Number of records and events in this file (a compact escape record is
+  // three records but one event)
+  uint64_t num_records;
+  uint64_t num_events;
+
+  // Events lost due to TRACR_POLICY_IGNORE_IF_FULL
+  uint64_t num_dropped;
+
+  // Events lost due to TRACR_POLICY_PERIODIC
+  uint64_t num_overwritten;
+
+  // Index of the oldest record, non-zero if the records are still wrapped
+  uint64_t wrap_index;
+
+  // Smallest and largest timestamp, without the coarse flag
+  uint64_t min_timestamp;
+  uint64_t max_timestamp;
+
+  uint32_t num_event_types;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(BtsTrailer) == 72, "BtsTrailer layout changed");
+
+/**
+ * The records of a compressed file are cut into blocks of this many bytes
+ * (the last one may be shorter), so readers can decompress them in parallel
+ */
+constexpr uint32_t BTS_BLOCK_BYTES = 1 << 20;
+
+/**
+ * How a block is stored
+ */
+enum class BtsBlockCodec : uint8_t {
+  // The records as they are, if they don't compress
+  STORED = 0,
+
+  // Timestamp deltas, byte shuffle and LZ (see BlockCodec)
+  SHUFFLE_LZ = 1
+};
+
+/**
+ * An entry of the block index in front of the block data
+ */
+struct BtsBlock {
+  // Size of the records of this block
+  uint32_t raw_bytes;
+
+  // Size of the block data
+  uint32_t stored_bytes;
+
+  uint8_t codec; // BtsBlockCodec
+  uint8_t reserved0;
+  uint16_t reserved1;
+  uint32_t reserved2;
+};
+
+static_assert(sizeof(BtsBlock) == 16, "BtsBlock layout changed");
+
+/**
+ * With TRACR_SINGLE_FILE, all trace files of a proc are sections of a single
+ * container file tracr/proc.<pid>.tracr:
+ *
+ *   ContainerHeader | section | ... | metadata | ContainerSection[n] | footer
+ *
+ * Each section starts on a multiple of the alignment and holds a complete .bts
+ * file of one TraCR thread. The metadata is the metadata.json of the proc. The
+ * section directory and the ContainerFooter are written last, a container
+ * without footer was not finished.
+ */
+constexpr char CONTAINER_MAGIC[8] = {'T', 'R', 'A', 'C', 'R', 'P', 'A', 'K'};
+constexpr char CONTAINER_FOOTER_MAGIC[8] = {'T', 'R', 'A', 'C',
+                                            'R', 'D', 'I', 'R'};
+
+/**
+ * Same rules as BTS_VERSION
+ */
+constexpr uint16_t CONTAINER_VERSION = 1;
+
+/**
+ * Sections start on page boundaries, so concurrent writers never share a page
+ */
+constexpr uint32_t CONTAINER_ALIGNMENT = 4096;
+
+/**
+ * The content of a section
+ */
+enum class ContainerSectionKind : uint32_t { TRACES = 0, METADATA = 1 };
+
+/**
+ * The header at the start of the container
+ */
+struct ContainerHeader {
+  char magic[8];
+  uint16_t version;
+  uint16_t header_size;
+  uint32_t alignment;
+
+  // The pid of the proc (its logical CPU ID, as in the proc folder name)
+  int64_t pid;
+
+  uint64_t reserved[5];
+};
+
+static_assert(sizeof(ContainerHeader) == 64, "ContainerHeader layout changed");
+
+/**
+ * An entry of the section directory
+ */
+struct ContainerSection {
+  uint32_t kind; // ContainerSectionKind
+  uint32_t reserved;
+
+  // kernel thread ID (-1 for the metadata)
+  int64_t tid;
+
+  // Byte range of the section in the container
+  uint64_t offset;
+  uint64_t size;
+};
+
+static_assert(sizeof(ContainerSection) == 32,
+              "ContainerSection layout changed");
+
+/**
+ * The footer at the very end of the container
+ */
+struct ContainerFooter {
+  char magic[8];
+  uint64_t directory_offset;
+  uint64_t num_sections;
+  uint64_t reserved;
+};
+
+static_assert(sizeof(ContainerFooter) == 32, "ContainerFooter layout changed");
+
+/**
+ * Statistics of the records of a TraCR thread, accumulated on flush
+ */
+struct BtsStats {
+  std::map<uint16_t, uint64_t> counts;
+  uint64_t num_events = 0;
+  uint64_t min_timestamp = UINT64_MAX;
+  uint64_t max_timestamp = 0;
+
+  inline void add(uint16_t eventId, uint64_t timestamp) {
+    ++counts[eventId];
+    ++num_events;
+    min_timestamp = (timestamp < min_timestamp) ? timestamp : min_timestamp;
+    max_timestamp = (timestamp > max_timestamp) ? timestamp : max_timestamp;
+  }
+};
+
+/**
+ * Serialize the event counts and the trailer into their on-disk form
+ */
+inline std::string bts_trailer_bytes(const BtsStats &stats,
+                                     BtsTrailer trailer) {
+  std::memcpy(trailer.magic, BTS_TRAILER_MAGIC, sizeof(trailer.magic));
+  trailer.num_events = stats.num_events;
+  trailer.min_timestamp = (stats.num_events > 0) ? stats.min_timestamp : 0;
+  trailer.max_timestamp = stats.max_timestamp;
+  trailer.num_event_types = static_cast<uint32_t>(stats.counts.size());
+
+  std::string bytes;
+  bytes.reserve(stats.counts.size() * sizeof(BtsEventCount) + sizeof(trailer));
+
+  for (const auto &[eventId, count] : stats.counts) {
+    BtsEventCount entry{eventId, 0, 0, count};
+    bytes.append(reinterpret_cast<const char *>(&entry), sizeof(entry));
+  }
+  bytes.append(reinterpret_cast<const char *>(&trailer), sizeof(trailer));
+
+  return bytes;
+}
+
+} // namespace TraCR
@@ -0,0 +1,273 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file buffer_pool.hpp
+ * @brief Recycled trace buffers of finalized threads (TRACR_BUFFER_POOL)
+ * @author Noah Andrés Baumann
+ * @date 16/10/2026
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sys/mman.h> // munmap()
+#include <unistd.h>   // sysconf()
+#include <utility>
+#include <vector>
+
+#include "trace_buffer.hpp"
+
+namespace TraCR {
+
+/**
+ * What a buffer pool did so far
+ */
+struct BufferPoolStats {
+  size_t buffers_created = 0;
+  size_t buffers_reused = 0;
+  size_t buffers_pooled = 0;
+  size_t chunks_created = 0;
+  size_t chunks_reused = 0;
+  size_t chunks_pooled = 0;
+};
+
+/**
+ * The trace buffers of finalized threads, handed to the threads created next.
+ * The pages of a recycled buffer are already faulted, so a short-lived thread
+ * neither maps a buffer nor takes a page fault for the records it shares with
+ * its predecessor.
+ *
+ * With a chunk size, a recycled buffer keeps only its first chunk of that many
+ * elements, and threads take more chunks as they record. A finalized thread
+ * gives its other chunks back, so the memory follows the records of the
+ * running threads instead of the most any thread ever recorded.
+ *
+ * Every moved range of pages is a mapping of its own, and a process has at
+ * most vm.max_map_count of them. Hence new chunks are faulted in place, a
+ * finalized thread gives its chunks back as one contiguous run, and a growing
+ * buffer takes a run front to back, so its chunks continue each other.
+ *
+ * Thread safe: buffers come back from the owners and from the flush engine.
+ */
+template <typename T> class BufferPool {
+public:
+  /**
+   * Constructor, for buffers of capacity elements. A chunk of 0 recycles whole
+   * buffers, otherwise capacity has to be a multiple of chunk, and a chunk a
+   * multiple of the page size.
+   */
+  BufferPool(size_t capacity, size_t chunk)
+      : _capacity(capacity), _chunk(chunk) {}
+
+  /**
+   * The buffers are owned exclusively, hence no copies.
+   */
+  BufferPool(const BufferPool &) = delete;
+  BufferPool &operator=(const BufferPool &) = delete;
+
+  /**
+   * Destructor, releases the detached runs (the buffers release themselves
+   * along with their attached chunks)
+   */
+  ~BufferPool() { trim(); }
+
+  /**
+   * A buffer for a new thread, a recycled one if the pool has any
+   */
+  inline TraceBuffer<T> take() {
+    size_t capacity;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (!_buffers.empty()) {
+        TraceBuffer<T> buffer = std::move(_buffers.back());
+        _buffers.pop_back();
+        ++_stats.buffers_reused;
+        return buffer;
+      }
+      ++_stats.buffers_created;
+      capacity = _capacity;
+    }
+
+    // Only address space, chunks are attached by grow()
+    return TraceBuffer<T>(capacity);
+  }
+
+  /**
+   * Take the buffer of a finalized thread back. All chunks but the first go
+   * back into the pool as one run.
+   */
+  inline void give(TraceBuffer<T> &&buffer) {
+    if (buffer.data() == nullptr) {
+      return; // Handed over to the flush engine
+    }
+
+    Run run{nullptr, 0};
+    if (_chunk > 0 && buffer.populated() > _chunk) {
+      run.elements = buffer.populated() - _chunk;
+      run.start = static_cast<char *>(
+          buffer.detach_chunks(run.elements, _chunk));
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (buffer.size() == _capacity) {
+      _buffers.push_back(std::move(buffer));
+    }
+    if (run.elements > 0) {
+      _runs.push_back(run);
+    }
+  }
+
+  /**
+   * Take over buffer, to be written by the flush engine. It comes back into
+   * the pool once the engine released the returned pointer.
+   */
+  inline std::shared_ptr<TraceBuffer<T>> hand_over(TraceBuffer<T> &&buffer) {
+    return std::shared_ptr<TraceBuffer<T>>(
+        new TraceBuffer<T>(std::move(buffer)), [this](TraceBuffer<T> *ptr) {
+          give(std::move(*ptr));
+          delete ptr;
+        });
+  }
+
+  /**
+   * Attach chunks to buffer until at least the first elements are populated
+   * (at most its capacity). Chunks of the pool come first, from the front of
+   * the latest run. Otherwise the reserved pages are faulted right away.
+   */
+  inline void grow(TraceBuffer<T> &buffer, size_t elements) {
+    elements = std::min(elements, _capacity);
+    const size_t bytes = chunk_bytes();
+
+    while (buffer.populated() < elements) {
+      char *chunk = nullptr;
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_runs.empty()) {
+          Run &run = _runs.back();
+          chunk = run.start;
+          run.start += bytes;
+          run.elements -= _chunk;
+          if (run.elements == 0) {
+            _runs.pop_back();
+          }
+          ++_stats.chunks_reused;
+        } else {
+          ++_stats.chunks_created;
+        }
+      }
+
+      if (chunk != nullptr) {
+        buffer.attach_chunk(chunk, _chunk);
+      } else {
+        buffer.populate_chunk(_chunk);
+      }
+    }
+  }
+
+  /**
+   * Release all buffers and chunks in the pool, the ones still in use come
+   * back later
+   */
+  inline void trim() {
+    std::vector<TraceBuffer<T>> buffers;
+    std::vector<Run> runs;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      buffers.swap(_buffers);
+      runs.swap(_runs);
+    }
+
+    for (const Run &run : runs) {
+      munmap(run.start, run.elements * sizeof(T));
+    }
+  }
+
+  /**
+   * Hand out buffers of capacity elements from now on. Pooled buffers of
+   * another capacity are released, as are the ones given back later.
+   */
+  inline void set_capacity(size_t capacity) {
+    std::vector<TraceBuffer<T>> buffers;
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (capacity != _capacity) {
+      buffers.swap(_buffers);
+      _capacity = capacity;
+    }
+  }
+
+  /**
+   * The number of elements per chunk (0 for whole buffers)
+   */
+  inline size_t chunk() const { return _chunk; }
+
+  /**
+   * What the pool did so far, and what it holds now
+   */
+  inline BufferPoolStats stats() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    BufferPoolStats stats = _stats;
+    stats.buffers_pooled = _buffers.size();
+    stats.chunks_pooled = 0;
+    for (const Run &run : _runs) {
+      stats.chunks_pooled += run.elements / _chunk;
+    }
+    return stats;
+  }
+
+private:
+  /**
+   * Consecutive chunks detached from one buffer
+   */
+  struct Run {
+    char *start;
+    size_t elements;
+  };
+
+  /**
+   * The bytes of a chunk, which has to span whole pages to be moved
+   */
+  inline size_t chunk_bytes() const {
+    const size_t bytes = _chunk * sizeof(T);
+    if (bytes % static_cast<size_t>(sysconf(_SC_PAGESIZE)) != 0) {
+      std::cerr << "The trace buffer chunks of " << bytes
+                << " bytes are no multiple of the page size\n";
+      std::exit(EXIT_FAILURE);
+    }
+    return bytes;
+  }
+
+  // The number of elements per buffer
+  size_t _capacity;
+
+  // The number of elements per chunk, 0 for whole buffers
+  size_t _chunk;
+
+  // The recycled buffers, and the runs of chunks detached from them
+  std::vector<TraceBuffer<T>> _buffers;
+  std::vector<Run> _runs;
+
+  BufferPoolStats _stats;
+
+  // Guards all of the above
+  std::mutex _mutex;
+};
+
+} // namespace TraCR
@@ -0,0 +1,344 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file cpu_buffers.hpp
+ * @brief One trace buffer per CPU shared by all threads (TRACR_PER_CPU)
+ * @author Noah Andrés Baumann
+ * @date 16/10/2026
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sched.h>  // sched_getcpu()
+#include <unistd.h> // sysconf()
+
+#include "non_temporal.hpp"
+#include "trace_buffer.hpp"
+
+#if defined(__x86_64__) && __has_include(<sys/rseq.h>)
+#include <sys/rseq.h> // __rseq_offset, __rseq_size (glibc >= 2.35)
+#ifdef RSEQ_SIG
+#define TRACR_RSEQ_APPEND
+#endif
+#endif
+
+/**
+ * Turns the value of a macro (RSEQ_SIG) into a string for inline assembly
+ */
+#define TRACR_STR_(x) #x
+#define TRACR_STR(x) TRACR_STR_(x)
+
+namespace TraCR {
+
+/**
+ * The trace buffers of all CPUs. Every thread appends to the buffer of the CPU
+ * it runs on, so their number and memory scale with the CPUs, no matter how
+ * many threads come and go.
+ *
+ * Threads of the same CPU never run at the same time, but may preempt each
+ * other. With a restartable sequence (rseq, x86-64) an append reads the CPU,
+ * writes the record and commits it by advancing the index of that CPU with
+ * plain stores. The kernel restarts it if the thread gets preempted, migrated
+ * or signaled before the commit. Without rseq the slot is reserved with an
+ * atomic increment instead.
+ *
+ * A Record is a fixed-size struct whose last field is the non-zero tid of the
+ * recording thread. Records with tid 0 were reserved but not yet written, and
+ * are skipped by readers.
+ */
+template <typename Record> class CpuBuffers {
+public:
+  /**
+   * Start recording into empty buffers of capacity records each. Called by
+   * instrumentation_start(), before any other thread appends.
+   */
+  inline void reset(size_t capacity) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // Buffers outlive the procs (threads may still append after the end), and
+    // are reused by the next one
+    if (!_slots) {
+      _numCpus = static_cast<size_t>(sysconf(_SC_NPROCESSORS_CONF));
+      _slots.reset(new Slot[_numCpus]);
+      _buffers.reset(new std::unique_ptr<TraceBuffer<Record>>[_numCpus]);
+    }
+
+    for (size_t cpu = 0; cpu < _numCpus; ++cpu) {
+      Slot &slot = _slots[cpu];
+      if (slot.records != nullptr) {
+        std::memset(slot.records, 0, sizeof(Record) * count(cpu));
+      }
+      slot.idx = 0;
+      slot.end = (slot.records != nullptr) ? capacity : 0;
+      slot.dropped = 0;
+    }
+    _capacity = capacity;
+
+#ifdef TRACR_RSEQ_APPEND
+    // glibc registers rseq for all threads or none
+    _rseq = __rseq_size > 0 && static_cast<int32_t>(rseq_area()->cpu_id) >= 0;
+#endif
+  }
+
+  /**
+   * Append record to the buffer of the current CPU. Returns false if it was
+   * dropped as that buffer is full. Records of threads without a slot (no rseq
+   * area, unknown CPU) are dropped and only counted.
+   */
+  inline bool append(const Record &record) {
+#ifdef TRACR_RSEQ_APPEND
+    static_assert(sizeof(Record) == 3 * sizeof(uint64_t),
+                  "The restartable sequence writes three words");
+
+    if (__builtin_expect(_rseq, 1)) {
+      uint64_t words[3];
+      std::memcpy(words, &record, sizeof(words));
+
+    restart:
+      // 3: the descriptor of the critical section [1, 2), which is entered by
+      // pointing the rseq area at it. 4: the abort handler, preceded by the
+      // signature (encoded as ud1, so disassemblers stay in sync).
+      asm goto(".pushsection __rseq_cs, \"aw\"\n\t"
+               ".balign 32\n\t"
+               "3:\n\t"
+               ".long 0, 0\n\t"
+               ".quad 1f, 2f - 1f, 4f\n\t"
+               ".popsection\n\t"
+               "leaq 3b(%%rip), %%rax\n\t"
+               "movq %%rax, %c[cs](%[area])\n\t"
+               "1:\n\t"
+               // The slot of the current CPU (-1 if not registered)
+               "movl %c[cpu](%[area]), %%eax\n\t"
+               "cmpq %[num], %%rax\n\t"
+               "jae %l[slow]\n\t"
+               "shlq $6, %%rax\n\t"
+               "addq %[slots], %%rax\n\t"
+               // Room for the record
+               "movq (%%rax), %%rcx\n\t"
+               "cmpq 8(%%rax), %%rcx\n\t"
+               "jae %l[slow]\n\t"
+               "leaq (%%rcx, %%rcx, 2), %%rdx\n\t"
+               "shlq $3, %%rdx\n\t"
+               "addq 16(%%rax), %%rdx\n\t"
+               "movq %[w0], (%%rdx)\n\t"
+               "movq %[w1], 8(%%rdx)\n\t"
+               "movq %[w2], 16(%%rdx)\n\t"
+               // Commit
+               "incq %%rcx\n\t"
+               "movq %%rcx, (%%rax)\n\t"
+               "2:\n\t"
+               ".pushsection __rseq_failure, \"ax\"\n\t"
+               ".byte 0x0f, 0xb9, 0x3d\n\t"
+               ".long " TRACR_STR(RSEQ_SIG) "\n\t"
+               "4:\n\t"
+               "jmp %l[restart]\n\t"
+               ".popsection"
+               :
+               : [area] "r"(rseq_area()), [slots] "r"(_slots.get()),
+                 [num] "r"(_numCpus), [w0] "r"(words[0]), [w1] "r"(words[1]),
+                 [w2] "r"(words[2]), [cs] "i"(offsetof(struct rseq, rseq_cs)),
+                 [cpu] "i"(offsetof(struct rseq, cpu_id))
+               : "rax", "rcx", "rdx", "memory", "cc"
+               : slow, restart);
+      return true;
+
+    slow:
+      return append_slow(record);
+    }
+#endif
+
+    return append_atomic(record);
+  }
+
+  /**
+   * Number of slots, one per configured CPU (0 before the first reset())
+   */
+  inline size_t num_cpus() const { return _numCpus; }
+
+  /**
+   * Number of records committed to the buffer of cpu so far
+   */
+  inline size_t count(size_t cpu) const {
+    const Slot &slot = _slots[cpu];
+    const size_t idx = __atomic_load_n(&slot.idx, __ATOMIC_ACQUIRE);
+    return (idx < slot.end) ? idx : slot.end;
+  }
+
+  /**
+   * The records of cpu, nullptr if no thread ran there yet
+   */
+  inline const Record *records(size_t cpu) const {
+    const Slot &slot = _slots[cpu];
+    return (__atomic_load_n(&slot.end, __ATOMIC_ACQUIRE) > 0) ? slot.records
+                                                               : nullptr;
+  }
+
+  /**
+   * Number of records dropped on cpu as its buffer was full
+   */
+  inline size_t dropped(size_t cpu) const {
+    return __atomic_load_n(&_slots[cpu].dropped, __ATOMIC_RELAXED);
+  }
+
+  /**
+   * Number of records dropped as their thread had no slot
+   */
+  inline size_t unregistered() const {
+    return __atomic_load_n(&_unregistered, __ATOMIC_RELAXED);
+  }
+
+  /**
+   * How the records are appended
+   */
+  inline const char *mode() const { return _rseq ? "rseq" : "atomic"; }
+
+private:
+  /**
+   * The state of one CPU, on a cache line of its own. The restartable sequence
+   * depends on this layout.
+   */
+  struct alignas(CACHE_LINE_SIZE) Slot {
+    // The index of the next record
+    size_t idx = 0;
+
+    // The capacity, 0 until the buffer is created (stored after records)
+    size_t end = 0;
+
+    Record *records = nullptr;
+
+    // Number of records dropped as the buffer was full
+    size_t dropped = 0;
+  };
+
+  static_assert(sizeof(Slot) == 64 && offsetof(Slot, end) == 8 &&
+                    offsetof(Slot, records) == 16,
+                "The restartable sequence depends on the Slot layout");
+
+#ifdef TRACR_RSEQ_APPEND
+  /**
+   * The rseq area of the calling thread, registered by glibc
+   */
+  static inline struct rseq *rseq_area() {
+    return reinterpret_cast<struct rseq *>(
+        static_cast<char *>(__builtin_thread_pointer()) + __rseq_offset);
+  }
+#endif
+
+  /**
+   * The slot of the CPU the calling thread runs on, with its buffer created on
+   * the first visit. nullptr if the CPU is unknown.
+   */
+  inline Slot *current_slot() {
+    const int cpu = sched_getcpu();
+    if (cpu < 0 || static_cast<size_t>(cpu) >= _numCpus) {
+      return nullptr;
+    }
+
+    // The capacity is stored last, a non-zero end implies the records
+    Slot &slot = _slots[cpu];
+    if (__builtin_expect(__atomic_load_n(&slot.end, __ATOMIC_ACQUIRE) == 0,
+                         0)) {
+      std::lock_guard<std::mutex> lock(_mutex);
+
+      if (slot.records == nullptr) {
+        // Created by a thread of that CPU, so the first touch places its
+        // pages on the node of the CPU
+        _buffers[cpu] = std::make_unique<TraceBuffer<Record>>(_capacity);
+        slot.records = _buffers[cpu]->data();
+      }
+      __atomic_store_n(&slot.end, _capacity, __ATOMIC_RELEASE);
+    }
+    return &slot;
+  }
+
+  /**
+   * The restartable sequence found no room in the buffer of the current CPU:
+   * it either doesn't exist yet or is full, or the thread is not registered.
+   */
+  inline bool append_slow(const Record &record) {
+#ifdef TRACR_RSEQ_APPEND
+    if (static_cast<int32_t>(rseq_area()->cpu_id) < 0) {
+      // Its records would race with the restartable sequences of the others
+      __atomic_fetch_add(&_unregistered, 1, __ATOMIC_RELAXED);
+      return true;
+    }
+#endif
+
+    Slot *slot = current_slot();
+    if (slot == nullptr) {
+      __atomic_fetch_add(&_unregistered, 1, __ATOMIC_RELAXED);
+      return true;
+    }
+
+    if (__atomic_load_n(&slot->idx, __ATOMIC_RELAXED) >= slot->end) {
+      __atomic_fetch_add(&slot->dropped, 1, __ATOMIC_RELAXED);
+      return false;
+    }
+
+    // Created now, or the thread migrated to a CPU with room
+    return append(record);
+  }
+
+  /**
+   * Reserve the slot with an atomic increment and publish the record with its
+   * tid, which readers check
+   */
+  inline bool append_atomic(const Record &record) {
+    Slot *slot = current_slot();
+    if (slot == nullptr) {
+      __atomic_fetch_add(&_unregistered, 1, __ATOMIC_RELAXED);
+      return true;
+    }
+
+    const size_t idx = __atomic_fetch_add(&slot->idx, 1, __ATOMIC_RELAXED);
+    if (__builtin_expect(idx >= slot->end, 0)) {
+      __atomic_fetch_add(&slot->dropped, 1, __ATOMIC_RELAXED);
+      return false;
+    }
+
+    Record &dst = slot->records[idx];
+    std::memcpy(&dst, &record, offsetof(Record, tid));
+    __atomic_store_n(&dst.tid, record.tid, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  // One slot per CPU
+  std::unique_ptr<Slot[]> _slots;
+  size_t _numCpus = 0;
+
+  // The buffers behind the slots, created on the first visit of their CPU
+  std::unique_ptr<std::unique_ptr<TraceBuffer<Record>>[]> _buffers;
+
+  // Records per buffer
+  size_t _capacity = 0;
+
+  // Whether the records are appended with restartable sequences
+  bool _rseq = false;
+
+  // Number of records dropped without a slot
+  size_t _unregistered = 0;
+
+  // Serializes the creation of buffers and reset()
+  std::mutex _mutex;
+};
+
+} // namespace TraCR
@@ -0,0 +1,675 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file flush_engine.hpp
+ * @brief Pool of I/O threads writing whole trace files in parallel
+ * @author Noah Andrés Baumann
+ * @date 16/10/2026
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h> // open()
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>    // mmap()
+#include <sys/stat.h>    // mkdir()
+#include <sys/syscall.h> // syscall()
+#include <sys/uio.h>     // pwritev()
+#include <thread>
+#include <unistd.h> // close()
+#include <vector>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define TRACR_HAS_IO_URING
+#endif
+#endif
+
+namespace TraCR {
+
+/**
+ * The number of I/O threads of the flush engine
+ */
+#ifndef TRACR_FLUSH_THREADS
+constexpr size_t FLUSH_THREADS = 4;
+#else
+constexpr size_t FLUSH_THREADS = TRACR_FLUSH_THREADS;
+#endif
+
+/**
+ * Files are written in requests of up to this many bytes, each ending on a
+ * multiple of it from the start of the file
+ */
+constexpr size_t FLUSH_CHUNK = 1 << 20;
+
+/**
+ * The number of requests an I/O thread keeps in flight with io_uring
+ */
+constexpr unsigned FLUSH_QUEUE_DEPTH = 32;
+
+/**
+ * A trace file to be written: head, the two record ranges and tail, in this
+ * order. prepare runs on the I/O thread right before writing (e.g. to compute
+ * the tail), and owner keeps the records alive until the file is written.
+ * prepare may also place the file into an open file by setting fd and offset.
+ * done runs on the writing thread once the file is written, with its size.
+ */
+struct FlushJob {
+  // Created if it does not exist yet
+  std::string folder;
+
+  std::string filepath;
+
+  std::string head;
+
+  const void *first = nullptr;
+  size_t firstBytes = 0;
+
+  const void *second = nullptr;
+  size_t secondBytes = 0;
+
+  std::string tail;
+
+  std::function<void(FlushJob &)> prepare;
+
+  std::function<void(size_t)> done;
+
+  std::shared_ptr<const void> owner;
+
+  // If set, the file is written at offset into fd (e.g. a section of a
+  // container), which is neither created nor closed
+  int fd = -1;
+  off_t offset = 0;
+};
+
+/**
+ * A positional write of up to FLUSH_CHUNK bytes, gathered from at most one
+ * piece of each part of a FlushJob
+ */
+struct FlushRequest {
+  off_t offset;
+  size_t bytes;
+  int numIov;
+  iovec iov[4];
+
+  /**
+   * Skip the first done bytes after a short write
+   */
+  inline void advance(size_t done) {
+    offset += static_cast<off_t>(done);
+    bytes -= done;
+
+    int first = 0;
+    while (done > 0 && done >= iov[first].iov_len) {
+      done -= iov[first].iov_len;
+      ++first;
+    }
+    if (done > 0) {
+      iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + done;
+      iov[first].iov_len -= done;
+    }
+
+    numIov -= first;
+    std::memmove(iov, iov + first, sizeof(iovec) * numIov);
+  }
+};
+
+class IoUring;
+
+#ifdef TRACR_HAS_IO_URING
+/**
+ * A minimal io_uring, set up with the raw system calls (no liburing needed).
+ * Owned by a single I/O thread.
+ */
+class IoUring {
+public:
+  /**
+   * Constructor, check available() as the kernel may not support io_uring or
+   * forbid it (e.g. seccomp, kernel.io_uring_disabled)
+   */
+  IoUring(unsigned entries) {
+    io_uring_params params{};
+    _fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (_fd < 0) {
+      return;
+    }
+
+    _sqBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cqBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    _singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (_singleMap) {
+      _sqBytes = _cqBytes = std::max(_sqBytes, _cqBytes);
+    }
+    _sqesBytes = params.sq_entries * sizeof(io_uring_sqe);
+
+    _sqRing = map(_sqBytes, IORING_OFF_SQ_RING);
+    _cqRing = _singleMap ? _sqRing : map(_cqBytes, IORING_OFF_CQ_RING);
+    void *sqes = map(_sqesBytes, IORING_OFF_SQES);
+
+    if (_sqRing == nullptr || _cqRing == nullptr || sqes == nullptr) {
+      release();
+      return;
+    }
+
+    _sqHead = ring<unsigned>(_sqRing, params.sq_off.head);
+    _sqTail = ring<unsigned>(_sqRing, params.sq_off.tail);
+    _sqMask = *ring<unsigned>(_sqRing, params.sq_off.ring_mask);
+    _sqArray = ring<unsigned>(_sqRing, params.sq_off.array);
+    _sqes = static_cast<io_uring_sqe *>(sqes);
+
+    _cqHead = ring<unsigned>(_cqRing, params.cq_off.head);
+    _cqTail = ring<unsigned>(_cqRing, params.cq_off.tail);
+    _cqMask = *ring<unsigned>(_cqRing, params.cq_off.ring_mask);
+    _cqes = ring<io_uring_cqe>(_cqRing, params.cq_off.cqes);
+
+    _entries = params.sq_entries;
+  }
+
+  /**
+   * The ring is owned exclusively, hence no copies.
+   */
+  IoUring(const IoUring &) = delete;
+  IoUring &operator=(const IoUring &) = delete;
+
+  /**
+   * Destructor
+   */
+  ~IoUring() { release(); }
+
+  /**
+   *
+   */
+  inline bool available() const { return _fd >= 0; }
+
+  /**
+   * Write all requests into fd, keeping up to the ring size in flight.
+   * Returns 0 or a negative errno.
+   */
+  inline int write(int fd, std::vector<FlushRequest> &requests) {
+    std::vector<size_t> retry;
+    size_t next = 0;
+    size_t inFlight = 0;
+    size_t remaining = requests.size();
+
+    while (remaining > 0) {
+      while (inFlight < _entries &&
+             (!retry.empty() || next < requests.size())) {
+        size_t idx = next;
+        if (!retry.empty()) {
+          idx = retry.back();
+          retry.pop_back();
+        } else {
+          ++next;
+        }
+        push(fd, requests[idx], idx);
+        ++inFlight;
+      }
+
+      // Also resubmits what the kernel did not consume in an interrupted call
+      const unsigned toSubmit =
+          *_sqTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+      if (syscall(__NR_io_uring_enter, _fd, toSubmit, 1,
+                  IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+          errno != EINTR) {
+        return -errno;
+      }
+
+      unsigned head = *_cqHead;
+      while (head != __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE)) {
+        const io_uring_cqe &cqe = _cqes[head & _cqMask];
+        const size_t idx = cqe.user_data;
+        const int res = cqe.res;
+        ++head;
+        --inFlight;
+
+        if (res == -EINTR || res == -EAGAIN) {
+          retry.push_back(idx);
+          continue;
+        }
+        if (res <= 0) {
+          __atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+          return (res < 0) ? res : -EIO;
+        }
+
+        requests[idx].advance(static_cast<size_t>(res));
+        if (requests[idx].bytes > 0) {
+          retry.push_back(idx); // short write
+        } else {
+          --remaining;
+        }
+      }
+      __atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    return 0;
+  }
+
+private:
+  /**
+   * Queue a vectored write of the request (submitted by the next enter)
+   */
+  inline void push(int fd, FlushRequest &request, size_t idx) {
+    const unsigned tail = *_sqTail;
+    const unsigned slot = tail & _sqMask;
+
+    io_uring_sqe &sqe = _sqes[slot];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_WRITEV;
+    sqe.fd = fd;
+    sqe.off = static_cast<uint64_t>(request.offset);
+    sqe.addr = reinterpret_cast<uint64_t>(request.iov);
+    sqe.len = static_cast<uint32_t>(request.numIov);
+    sqe.user_data = idx;
+
+    _sqArray[slot] = slot;
+    __atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+  }
+
+  /**
+   *
+   */
+  inline void *map(size_t bytes, off_t offset) {
+    void *ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, _fd, offset);
+    return (ptr == MAP_FAILED) ? nullptr : ptr;
+  }
+
+  /**
+   *
+   */
+  template <typename T> static inline T *ring(void *base, uint32_t offset) {
+    return reinterpret_cast<T *>(static_cast<char *>(base) + offset);
+  }
+
+  /**
+   *
+   */
+  inline void release() {
+    if (_sqes != nullptr) {
+      munmap(_sqes, _sqesBytes);
+    }
+    if (_cqRing != nullptr && !_singleMap) {
+      munmap(_cqRing, _cqBytes);
+    }
+    if (_sqRing != nullptr) {
+      munmap(_sqRing, _sqBytes);
+    }
+    if (_fd >= 0) {
+      close(_fd);
+    }
+    _sqes = nullptr;
+    _sqRing = _cqRing = nullptr;
+    _fd = -1;
+  }
+
+  // The ring file descriptor (-1 if not available)
+  int _fd = -1;
+
+  // Number of submission queue entries
+  unsigned _entries = 0;
+
+  // The mapped rings and their sizes
+  void *_sqRing = nullptr;
+  void *_cqRing = nullptr;
+  size_t _sqBytes = 0;
+  size_t _cqBytes = 0;
+  size_t _sqesBytes = 0;
+  bool _singleMap = false;
+
+  // The submission queue
+  unsigned *_sqHead = nullptr;
+  unsigned *_sqTail = nullptr;
+  unsigned *_sqArray = nullptr;
+  unsigned _sqMask = 0;
+  io_uring_sqe *_sqes = nullptr;
+
+  // The completion queue
+  unsigned *_cqHead = nullptr;
+  unsigned *_cqTail = nullptr;
+  unsigned _cqMask = 0;
+  io_uring_cqe *_cqes = nullptr;
+};
+#endif
+
+/**
+ * The TraCR flush engine.
+ *
+ * TraCR threads hand over a FlushJob and return, the I/O threads create the
+ * folder, prepare and write the file. The jobs of different threads are
+ * written in parallel. Each I/O thread submits a whole file through its own
+ * io_uring where available, or falls back to pwritev().
+ */
+class FlushEngine {
+public:
+  /**
+   * Constructor, selects the backend and starts the I/O threads. The
+   * TRACR_FLUSH_BACKEND environment variable ("io_uring" or "pwritev")
+   * overrides the default.
+   */
+  FlushEngine() {
+#ifdef TRACR_HAS_IO_URING
+    _useIoUring = IoUring(1).available();
+#endif
+
+    if (const char *backend = std::getenv("TRACR_FLUSH_BACKEND")) {
+      if (std::strcmp(backend, "pwritev") == 0) {
+        _useIoUring = false;
+      } else if (std::strcmp(backend, "io_uring") != 0) {
+        std::cerr << "Unknown TraCR flush backend: " << backend << "\n";
+        std::exit(EXIT_FAILURE);
+      } else if (!_useIoUring) {
+        std::cerr << "TraCR flush backend not available: " << backend << "\n";
+        std::exit(EXIT_FAILURE);
+      }
+    }
+
+    for (size_t i = 0; i < FLUSH_THREADS; ++i) {
+      _threads.emplace_back([this] { run(); });
+    }
+  }
+
+  /**
+   * The I/O threads are owned exclusively, hence no copies.
+   */
+  FlushEngine(const FlushEngine &) = delete;
+  FlushEngine &operator=(const FlushEngine &) = delete;
+
+  /**
+   * Destructor, writes all remaining jobs and joins the I/O threads
+   */
+  ~FlushEngine() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _jobCv.notify_all();
+
+    for (auto &thread : _threads) {
+      thread.join();
+    }
+  }
+
+  /**
+   * Queue a file to be written. Returns immediately.
+   */
+  inline void submit(FlushJob &&job) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _jobs.push_back(std::move(job));
+    }
+    _jobCv.notify_one();
+  }
+
+  /**
+   * Block the caller until all submitted files are written
+   */
+  inline void drain() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _doneCv.wait(lock, [this] { return _jobs.empty() && _active == 0; });
+  }
+
+  /**
+   * Write a file synchronously on the calling thread, through ring if given
+   */
+  static inline void write(FlushJob &job, IoUring *ring = nullptr) {
+    if (!job.folder.empty() && mkdir(job.folder.c_str(), 0755) != 0 &&
+        errno != EEXIST) {
+      std::cerr << "mkdir failed for: " << job.folder << " errno=" << errno
+                << " (" << std::strerror(errno) << ")\n";
+      std::exit(EXIT_FAILURE);
+    }
+
+    if (job.prepare) {
+      job.prepare(job);
+    }
+
+    int fd = job.fd;
+    if (fd < 0) {
+      fd = open(job.filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0644);
+    }
+    if (fd < 0) {
+      std::cerr << "Failed to open file: " << job.filepath << "\n";
+      std::exit(EXIT_FAILURE);
+    }
+
+    std::vector<FlushRequest> requests = split(job);
+
+    int err = 0;
+#ifdef TRACR_HAS_IO_URING
+    if (ring != nullptr) {
+      err = ring->write(fd, requests);
+    } else {
+      err = write_requests(fd, requests);
+    }
+#else
+    (void)ring;
+    err = write_requests(fd, requests);
+#endif
+
+    if (err != 0 || (job.fd < 0 && close(fd) != 0)) {
+      err = (err != 0) ? -err : errno;
+      std::cerr << "Failed to write into file: " << job.filepath
+                << " errno=" << err << " (" << std::strerror(err) << ")\n";
+      std::exit(EXIT_FAILURE);
+    }
+
+    if (job.done) {
+      job.done(job.head.size() + job.firstBytes + job.secondBytes +
+               job.tail.size());
+    }
+  }
+
+  /**
+   *
+   */
+  inline const char *getBackend() const {
+    return _useIoUring ? "io_uring" : "pwritev";
+  }
+
+  /**
+   *
+   */
+  inline size_t getNumThreads() const { return _threads.size(); }
+
+  /**
+   * Number of files written so far
+   */
+  inline size_t getFiles() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _files;
+  }
+
+  /**
+   * Number of bytes written so far
+   */
+  inline size_t getBytes() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _bytes;
+  }
+
+  /**
+   * Time in seconds during which at least one I/O thread was busy
+   */
+  inline double getBusySeconds() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return std::chrono::duration<double>(_busy).count();
+  }
+
+private:
+  /**
+   * Cut the file into requests ending on multiples of FLUSH_CHUNK of the file
+   * offset. The first one ends on the first such boundary after the offset of
+   * the job (a section of a container starts on any multiple of
+   * CONTAINER_ALIGNMENT), all others are FLUSH_CHUNK bytes but the last.
+   */
+  static inline std::vector<FlushRequest> split(const FlushJob &job) {
+    const std::pair<const void *, size_t> parts[] = {
+        {job.head.data(), job.head.size()},
+        {job.first, job.firstBytes},
+        {job.second, job.secondBytes},
+        {job.tail.data(), job.tail.size()}};
+
+    std::vector<FlushRequest> requests;
+    FlushRequest request{job.offset, 0, 0, {}};
+
+    // The bytes up to the next boundary
+    size_t limit = FLUSH_CHUNK - static_cast<size_t>(job.offset) % FLUSH_CHUNK;
+
+    for (const auto &[data, bytes] : parts) {
+      const char *ptr = static_cast<const char *>(data);
+      size_t left = bytes;
+
+      while (left > 0) {
+        const size_t n = std::min(left, limit - request.bytes);
+        request.iov[request.numIov++] = {const_cast<char *>(ptr), n};
+        request.bytes += n;
+        ptr += n;
+        left -= n;
+
+        if (request.bytes == limit) {
+          requests.push_back(request);
+          const off_t next = request.offset + static_cast<off_t>(limit);
+          request = {next, 0, 0, {}};
+          limit = FLUSH_CHUNK;
+        }
+      }
+    }
+
+    if (request.bytes > 0) {
+      requests.push_back(request);
+    }
+
+    return requests;
+  }
+
+  /**
+   * Write all requests with pwritev(). Returns 0 or a negative errno.
+   */
+  static inline int write_requests(int fd,
+                                   std::vector<FlushRequest> &requests) {
+    for (auto &request : requests) {
+      while (request.bytes > 0) {
+        ssize_t written =
+            pwritev(fd, request.iov, request.numIov, request.offset);
+
+        if (written < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          return -errno;
+        }
+
+        request.advance(static_cast<size_t>(written));
+      }
+    }
+
+    return 0;
+  }
+
+  /**
+   * The loop of an I/O thread
+   */
+  inline void run() {
+    IoUring *ring = nullptr;
+#ifdef TRACR_HAS_IO_URING
+    std::unique_ptr<IoUring> uring;
+    if (_useIoUring) {
+      uring = std::make_unique<IoUring>(FLUSH_QUEUE_DEPTH);
+      ring = uring->available() ? uring.get() : nullptr;
+    }
+#endif
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (true) {
+      _jobCv.wait(lock, [this] { return _stop || !_jobs.empty(); });
+
+      if (_jobs.empty()) {
+        return; // _stop is set and everything is written
+      }
+
+      FlushJob job = std::move(_jobs.front());
+      _jobs.pop_front();
+
+      if (_active++ == 0) {
+        _busySince = std::chrono::steady_clock::now();
+      }
+
+      // Don't hold the lock while doing I/O
+      lock.unlock();
+      write(job, ring);
+      const size_t bytes =
+          job.head.size() + job.firstBytes + job.secondBytes + job.tail.size();
+      job = FlushJob{}; // Releases the records
+      lock.lock();
+
+      ++_files;
+      _bytes += bytes;
+
+      if (--_active == 0) {
+        _busy += std::chrono::steady_clock::now() - _busySince;
+        _doneCv.notify_all();
+      }
+    }
+  }
+
+  // Protects the job queue and the statistics
+  std::mutex _mutex;
+
+  // Signals the I/O threads that there is work
+  std::condition_variable _jobCv;
+
+  // Signals drain() that the I/O threads went idle
+  std::condition_variable _doneCv;
+
+  // The files waiting to be written
+  std::deque<FlushJob> _jobs;
+
+  // Set on destruction
+  bool _stop = false;
+
+  // Submit through io_uring instead of pwritev()
+  bool _useIoUring = false;
+
+  // Number of I/O threads currently writing
+  size_t _active = 0;
+
+  // Statistics of the written files
+  size_t _files = 0;
+  size_t _bytes = 0;
+  std::chrono::steady_clock::duration _busy{0};
+  std::chrono::steady_clock::time_point _busySince;
+
+  // The I/O threads (started last)
+  std::vector<std::thread> _threads;
+};
+
+} // namespace TraCR
@@ -0,0 +1,120 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file full_policy.hpp
+ * @brief Full-buffer policies chosen at runtime (TRACR_RUNTIME_POLICY)
+ * @author Noah Andrés Baumann
+ * @date 16/10/2026
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "bts_format.hpp"
+
+namespace TraCR {
+
+/**
+ * The indices a TraCR thread may record at without asking its policy. Index i
+ * of [lap, end) is stored in slot i - lap of the buffer.
+ */
+struct FillWindow {
+  // The index stored in the first slot
+  size_t lap = 0;
+
+  // The first index past the buffer
+  size_t end = 0;
+
+  // The number of records of the buffer
+  size_t capacity = 0;
+
+  // Number of events dropped as the buffer was full
+  size_t dropped = 0;
+};
+
+/**
+ * Terminate the process once the buffer is full (the default)
+ */
+struct AbortIfFull {
+  static constexpr BtsPolicy policy = BtsPolicy::ABORT;
+
+  static inline bool make_room(FillWindow &, long tid) {
+    std::cerr << "Warning: TID[" << tid
+              << "] is full, terminating with a Runtime Error.\n";
+    std::exit(EXIT_FAILURE);
+  }
+};
+
+/**
+ * Drop the events once the buffer is full
+ */
+struct IgnoreIfFull {
+  static constexpr BtsPolicy policy = BtsPolicy::IGNORE_IF_FULL;
+
+  static inline bool make_room(FillWindow &window, long) {
+    ++window.dropped;
+    return false;
+  }
+};
+
+/**
+ * Overwrite the oldest records once the buffer is full, as a ring buffer
+ */
+struct Periodic {
+  static constexpr BtsPolicy policy = BtsPolicy::PERIODIC;
+
+  static inline bool make_room(FillWindow &window, long) {
+    window.lap = window.end;
+    window.end += window.capacity;
+    return true;
+  }
+};
+
+/**
+ * The name of a policy, as taken by parse_full_policy()
+ */
+inline const char *full_policy_name(BtsPolicy policy) {
+  switch (policy) {
+  case BtsPolicy::PERIODIC:
+    return "periodic";
+  case BtsPolicy::IGNORE_IF_FULL:
+    return "ignore_if_full";
+  default:
+    return "abort";
+  }
+}
+
+/**
+ * The policy of the given name ("abort", "ignore_if_full" or "periodic").
+ * Returns false for any other name.
+ */
+inline bool parse_full_policy(const std::string &name, BtsPolicy &policy) {
+  for (BtsPolicy candidate :
+       {BtsPolicy::ABORT, BtsPolicy::IGNORE_IF_FULL, BtsPolicy::PERIODIC}) {
+    if (name == full_policy_name(candidate)) {
+      policy = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace TraCR
@@ -23,19 +23,39 @@
 
 #pragma once
 
-#include <array>
+#include <algorithm>
 #include <atomic>
+#include <cstring>
 #include <ctime>
+#include <fcntl.h> // open()
 #include <fstream> // To store files
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <sched.h> // sched_getcpu()
 #include <string>
 #include <sys/stat.h>  // mkdir()
 #include <sys/types.h> // chmod type
-#include <unistd.h>    // SYS_gettid
+#include <type_traits>
+#include <unistd.h> // SYS_gettid
 #include <unordered_map>
+#include <vector>
+
+#include "bts_compression.hpp"
+#include "bts_format.hpp"
+#include "buffer_pool.hpp"
+#include "cpu_buffers.hpp"
+#include "flush_engine.hpp"
+#include "full_policy.hpp"
+#include "nano_timer.hpp"
+#include "non_temporal.hpp"
+#include "segment_manager.hpp"
+#include "signal_trigger.hpp"
+#include "trace_buffer.hpp"
+#include "trace_container.hpp"
+#include "trace_writer.hpp"
 
 namespace TraCR {
 
@@ -52,6 +72,9 @@ namespace TraCR {
  * capatity = 2**16 = 65'536     -> ~1MB tracr thread size
  * capacity = 2**20 = 1'048'576  -> ~17MB tracr thread size (default)
  * capacity = 2**24 = 16'777'216 -> ~268MB tracr thread size
+ *
+ * NOTE: These sizes are only reserved address space. Physical memory is
+ * committed page by page as traces are recorded.
  */
 #ifndef TRACR_CAPACITY
 constexpr size_t CAPACITY = 1 << 20;
@@ -60,98 +83,162 @@ constexpr size_t CAPACITY = TRACR_CAPACITY;
 #endif
 
 /**
- * Debug printing method. Can be enabled with the ENABLE_DEBUG flag included.
- * TODO: not yet working
+ * The streaming policy needs a file to stream into.
  */
-#ifdef ENABLE_DEBUG
-#define debug_print(fmt, ...) printf("[TraCR DEBUG] " fmt "\n", ##__VA_ARGS__)
-#else
-#define debug_print(fmt, ...)
+#if defined(TRACR_POLICY_STREAMING) && defined(TRACR_DISABLE_FLUSH)
+#error "TRACR_POLICY_STREAMING can't be combined with TRACR_DISABLE_FLUSH"
 #endif
 
 /**
- * Our nanosecond timer
- *
- * This timer can also be changed by the chrono (or PyPTO get_cycle()) method
+ * A file-backed buffer is the trace file itself, it can neither be streamed nor
+ * skipped.
  */
-class NanoTimer {
-public:
-  // Always returns nanoseconds
-  static uint64_t now() {
-#ifdef USE_HW_COUNTER
-    return ticks_to_ns(raw());
-#else
-    return clock_ns();
+#if defined(TRACR_MAPPED_BUFFER) && defined(TRACR_POLICY_STREAMING)
+#error "TRACR_MAPPED_BUFFER can't be combined with TRACR_POLICY_STREAMING"
 #endif
-  }
 
-#ifdef USE_HW_COUNTER
+#if defined(TRACR_MAPPED_BUFFER) && defined(TRACR_DISABLE_FLUSH)
+#error "TRACR_MAPPED_BUFFER can't be combined with TRACR_DISABLE_FLUSH"
+#endif
 
-  // Raw hardware counter ticks
-  static inline uint64_t raw() {
-#if defined(__aarch64__)
-    uint64_t val;
-    asm volatile("mrs %0, cntvct_el0" : "=r"(val));
-    return val;
-#elif defined(__x86_64__)
-    unsigned hi, lo;
-    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
-    return ((uint64_t)hi << 32) | lo;
-#else
-#error "Unsupported architecture for HW counter"
+/**
+ * The asynchronous flush only applies to buffers written out as a whole.
+ */
+#if defined(TRACR_ASYNC_FLUSH) &&                                              \
+    (defined(TRACR_DISABLE_FLUSH) || defined(TRACR_POLICY_STREAMING) ||        \
+     defined(TRACR_MAPPED_BUFFER))
+#error "TRACR_ASYNC_FLUSH needs buffers that are flushed as a whole"
 #endif
-  }
 
-  // Counter frequency (ticks per second)
-  static inline uint64_t frequency() {
-#if defined(__aarch64__)
-    uint64_t freq;
-    asm volatile("mrs %0, cntfrq_el0" : "=r"(freq));
-    return freq;
-#elif defined(__x86_64__)
-    return tsc_frequency();
+/**
+ * Segments are written as a whole while the thread keeps recording into the
+ * same buffer, which rules out the other policies and a file-backed buffer.
+ */
+#if defined(TRACR_POLICY_SEGMENTED) &&                                         \
+    (defined(TRACR_POLICY_PERIODIC) || defined(TRACR_POLICY_IGNORE_IF_FULL) || \
+     defined(TRACR_POLICY_STREAMING))
+#error "TRACR_POLICY_SEGMENTED can't be combined with another policy"
 #endif
-  }
 
+#if defined(TRACR_POLICY_SEGMENTED) &&                                         \
+    (defined(TRACR_MAPPED_BUFFER) || defined(TRACR_DISABLE_FLUSH))
+#error "TRACR_POLICY_SEGMENTED needs a flushed anonymous buffer"
 #endif
 
-private:
-  static inline uint64_t clock_ns() {
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
-    return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000ULL +
-           static_cast<uint64_t>(ts.tv_nsec);
-  }
+/**
+ * A container holds the trace files written as a whole at the end.
+ */
+#if defined(TRACR_SINGLE_FILE) &&                                              \
+    (defined(TRACR_DISABLE_FLUSH) || defined(TRACR_POLICY_STREAMING) ||        \
+     defined(TRACR_POLICY_SEGMENTED) || defined(TRACR_MAPPED_BUFFER))
+#error "TRACR_SINGLE_FILE needs buffers that are flushed as a whole at the end"
+#endif
 
-#ifdef USE_HW_COUNTER
-  static inline uint64_t ticks_to_ns(uint64_t ticks) {
-    static const uint64_t freq = frequency();
-    return (ticks * 1'000'000'000ULL) / freq;
-  }
+/**
+ * Compressed records can only be written once they are complete.
+ */
+#if defined(TRACR_COMPRESS) &&                                                 \
+    (defined(TRACR_POLICY_STREAMING) || defined(TRACR_MAPPED_BUFFER))
+#error "TRACR_COMPRESS needs buffers that are flushed as a whole"
+#endif
+
+/**
+ * Huge pages back the anonymous buffers, a file-backed buffer lives in the page
+ * cache.
+ */
+#if defined(TRACR_HUGE_PAGES) && defined(TRACR_MAPPED_BUFFER)
+#error "TRACR_HUGE_PAGES can't be combined with TRACR_MAPPED_BUFFER"
 #endif
 
-#if defined(__x86_64__) && defined(USE_HW_COUNTER)
-  // Warning: Simplified TSC calibration (see note below)
-  static uint64_t tsc_frequency() {
-    // Fallback to clock-based calibration
-    // Runs once (static)
-    static uint64_t freq = [] {
-      uint64_t t0 = raw();
-      uint64_t n0 = clock_ns();
+/**
+ * The page cache decides where the pages of a file-backed buffer live.
+ */
+#if defined(TRACR_NUMA_LOCAL) && defined(TRACR_MAPPED_BUFFER)
+#error "TRACR_NUMA_LOCAL can't be combined with TRACR_MAPPED_BUFFER"
+#endif
 
-      // wait ~50ms
-      struct timespec req = {0, 50'000'000};
-      nanosleep(&req, nullptr);
+/**
+ * Staging lines hold fixed-size records written strictly in order by their
+ * thread, and are only published once a page of them is complete.
+ */
+#if defined(TRACR_NT_STORES) &&                                                \
+    (defined(TRACR_COMPACT_PAYLOAD) || defined(TRACR_POLICY_STREAMING) ||      \
+     defined(TRACR_POLICY_SEGMENTED))
+#error "TRACR_NT_STORES needs fixed-size records kept in a single buffer"
+#endif
 
-      uint64_t t1 = raw();
-      uint64_t n1 = clock_ns();
+/**
+ * The markers write through the cursor without the TraCR thread, hence without
+ * the per-event work of these options.
+ */
+#if defined(TRACR_FAST_PATH) &&                                                \
+    (defined(TRACR_COMPACT_PAYLOAD) || defined(TRACR_CAPTURE_CPU) ||           \
+     defined(TRACR_MAPPED_BUFFER) || defined(TRACR_POLICY_SEGMENTED) ||        \
+     defined(TRACR_NT_STORES))
+#error "TRACR_FAST_PATH needs plain records without per-event bookkeeping"
+#endif
 
-      return (t1 - t0) * 1'000'000'000ULL / (n1 - n0);
-    }();
-    return freq;
-  }
+/**
+ * The buffers of the CPUs are shared by all threads and written as a whole at
+ * the end. Their records carry the TID, and the CPU follows from the buffer.
+ */
+#if defined(TRACR_PER_CPU) &&                                                  \
+    (defined(TRACR_COMPACT_PAYLOAD) || defined(TRACR_CAPTURE_CPU) ||           \
+     defined(TRACR_MAPPED_BUFFER) || defined(TRACR_POLICY_PERIODIC) ||         \
+     defined(TRACR_POLICY_STREAMING) || defined(TRACR_POLICY_SEGMENTED) ||     \
+     defined(TRACR_SINGLE_FILE) || defined(TRACR_HUGE_PAGES) ||                \
+     defined(TRACR_NUMA_LOCAL) || defined(TRACR_NT_STORES) ||                  \
+     defined(TRACR_FAST_PATH))
+#error "TRACR_PER_CPU can't be combined with options of per-thread buffers"
+#endif
+
+/**
+ * Recycled buffers are anonymous, and keep the NUMA node of their first thread.
+ */
+#if defined(TRACR_BUFFER_POOL) &&                                              \
+    (defined(TRACR_MAPPED_BUFFER) || defined(TRACR_NUMA_LOCAL) ||              \
+     defined(TRACR_PER_CPU))
+#error "TRACR_BUFFER_POOL needs anonymous buffers of the threads"
+#endif
+
+/**
+ * Chunks are base pages moved between the buffers of the pool.
+ */
+#if defined(TRACR_POOL_CHUNK) &&                                               \
+    (!defined(TRACR_BUFFER_POOL) || defined(TRACR_HUGE_PAGES))
+#error "TRACR_POOL_CHUNK needs TRACR_BUFFER_POOL without TRACR_HUGE_PAGES"
+#endif
+
+/**
+ * The policy and the capacity are chosen at runtime. Only the full-buffer path
+ * of a plain buffer depends on them.
+ */
+#if defined(TRACR_RUNTIME_POLICY) &&                                           \
+    (defined(TRACR_POLICY_PERIODIC) || defined(TRACR_POLICY_IGNORE_IF_FULL) || \
+     defined(TRACR_POLICY_STREAMING) || defined(TRACR_POLICY_SEGMENTED) ||     \
+     defined(TRACR_MAPPED_BUFFER) || defined(TRACR_NT_STORES) ||               \
+     defined(TRACR_FAST_PATH) || defined(TRACR_PER_CPU) ||                     \
+     defined(TRACR_POOL_CHUNK))
+#error "TRACR_RUNTIME_POLICY needs plain buffers without a compiled-in policy"
+#endif
+
+/**
+ * Compact records are variable sized, overwriting old ones would leave a torn
+ * record at the start of the buffer.
+ */
+#if defined(TRACR_COMPACT_PAYLOAD) && defined(TRACR_POLICY_PERIODIC)
+#error "TRACR_COMPACT_PAYLOAD can't be combined with TRACR_POLICY_PERIODIC"
+#endif
+
+/**
+ * Debug printing method. Can be enabled with the ENABLE_DEBUG flag included.
+ * TODO: not yet working
+ */
+#ifdef ENABLE_DEBUG
+#define debug_print(fmt, ...) printf("[TraCR DEBUG] " fmt "\n", ##__VA_ARGS__)
+#else
+#define debug_print(fmt, ...)
 #endif
-};
 
 /**
  * Marker payload
@@ -167,10 +254,240 @@ struct Payload {
   // as well (i.e. The type of task label of the event type)
   uint32_t extraId;
 
-  // Chrono nanosecond timestamp
+  // Nanosecond timestamp (raw counter ticks with TRACR_RAW_TIMESTAMPS)
   uint64_t timestamp;
 };
 
+/**
+ * With TRACR_CAPTURE_CPU a payload with this eventId is stored in front of an
+ * event whenever its thread runs on a different CPU than for the previous
+ * event. Its extraId holds the new CPU id.
+ */
+constexpr uint16_t CPU_EVENT_ID = UINT16_MAX - 1;
+
+/**
+ * The record of the per-CPU buffers of TRACR_PER_CPU, which interleave the
+ * events of all threads that ran on a CPU
+ */
+struct CpuRecord {
+  Payload payload;
+
+  // kernel thread ID of the thread that recorded the payload (0 while its
+  // slot is reserved but not yet written)
+  int64_t tid;
+};
+
+/**
+ * The compact record format of TRACR_COMPACT_PAYLOAD.
+ *
+ * Most events are only a few microseconds apart and use small ids. These are
+ * packed into a single 64-bit word holding the timestamp delta to the previous
+ * event of the same TraCR thread:
+ *
+ *   [63] 0 | [62] coarse | [61:38] delta | [37:30] channelId |
+ *   [29:22] eventId | [21:0] extraId
+ *
+ * The all-ones eventId and extraId stand for UINT16_MAX (reset) and UINT32_MAX
+ * (no extraId). Everything else becomes an escape record of three words:
+ *
+ *   [63] 1 | [31:16] channelId | [15:0] eventId, extraId, timestamp
+ *
+ * The timestamp of an escape record is absolute and becomes the new base of
+ * the following deltas.
+ */
+class CompactCodec {
+public:
+  // The maximum number of words of one record
+  static constexpr size_t MAX_WORDS = 3;
+
+  static constexpr uint64_t ESCAPE_BIT = 1ULL << 63;
+  static constexpr uint64_t COARSE_BIT = 1ULL << 62;
+
+  static constexpr int DELTA_SHIFT = 38;
+  static constexpr int CHANNEL_SHIFT = 30;
+  static constexpr int EVENT_SHIFT = 22;
+
+  static constexpr uint64_t DELTA_MASK = (1ULL << 24) - 1;
+  static constexpr uint64_t CHANNEL_MASK = (1ULL << 8) - 1;
+  static constexpr uint64_t EVENT_MASK = (1ULL << 8) - 1;
+  static constexpr uint64_t EXTRA_MASK = (1ULL << 22) - 1;
+
+  /**
+   * Encode the payload relative to the previous timestamp (without the coarse
+   * flag). Returns the number of words written into out.
+   */
+  static inline size_t encode(const Payload &payload, uint64_t prev,
+                              uint64_t *out) {
+    const uint64_t ts = payload.timestamp & ~COARSE_TIMESTAMP_FLAG;
+    const uint64_t delta = ts - prev;
+    const uint64_t event =
+        (payload.eventId == UINT16_MAX) ? EVENT_MASK : payload.eventId;
+    const uint64_t extra =
+        (payload.extraId == UINT32_MAX) ? EXTRA_MASK : payload.extraId;
+
+    if (likely(ts >= prev && delta <= DELTA_MASK &&
+               payload.channelId <= CHANNEL_MASK &&
+               (event < EVENT_MASK || payload.eventId == UINT16_MAX) &&
+               (extra < EXTRA_MASK || payload.extraId == UINT32_MAX))) {
+      out[0] = ((payload.timestamp & COARSE_TIMESTAMP_FLAG) ? COARSE_BIT : 0) |
+               (delta << DELTA_SHIFT) |
+               (uint64_t(payload.channelId) << CHANNEL_SHIFT) |
+               (event << EVENT_SHIFT) | extra;
+      return 1;
+    }
+
+    out[0] = ESCAPE_BIT | (uint64_t(payload.channelId) << 16) | payload.eventId;
+    out[1] = payload.extraId;
+    out[2] = payload.timestamp;
+    return MAX_WORDS;
+  }
+
+  /**
+   * Decode one record of at most avail words and advance prev. Returns the
+   * number of words consumed, or 0 if the record is truncated.
+   */
+  static inline size_t decode(const uint64_t *in, size_t avail, uint64_t &prev,
+                              Payload &payload) {
+    const uint64_t word = in[0];
+
+    if (word & ESCAPE_BIT) {
+      if (avail < MAX_WORDS) {
+        return 0;
+      }
+
+      payload.channelId = static_cast<uint16_t>(word >> 16);
+      payload.eventId = static_cast<uint16_t>(word);
+      payload.extraId = static_cast<uint32_t>(in[1]);
+      payload.timestamp = in[2];
+      prev = in[2] & ~COARSE_TIMESTAMP_FLAG;
+      return MAX_WORDS;
+    }
+
+    const uint64_t event = (word >> EVENT_SHIFT) & EVENT_MASK;
+    const uint64_t extra = word & EXTRA_MASK;
+
+    prev += (word >> DELTA_SHIFT) & DELTA_MASK;
+
+    payload.channelId =
+        static_cast<uint16_t>((word >> CHANNEL_SHIFT) & CHANNEL_MASK);
+    payload.eventId = (event == EVENT_MASK) ? UINT16_MAX : event;
+    payload.extraId = (extra == EXTRA_MASK) ? UINT32_MAX : extra;
+    payload.timestamp =
+        prev | ((word & COARSE_BIT) ? COARSE_TIMESTAMP_FLAG : 0);
+    return 1;
+  }
+};
+
+/**
+ * The unit stored in the trace buffer. A compact record takes half the space
+ * of a Payload, hence twice as many fit into the same buffer.
+ */
+#ifdef TRACR_COMPACT_PAYLOAD
+using TraceRecord = uint64_t;
+constexpr size_t RECORD_CAPACITY = 2 * CAPACITY;
+#else
+using TraceRecord = Payload;
+constexpr size_t RECORD_CAPACITY = CAPACITY;
+#endif
+
+#ifdef TRACR_NT_STORES
+/**
+ * The records of a staging line, and the number of records after which the
+ * streamed lines are fenced and published (a page)
+ */
+constexpr size_t RECORDS_PER_LINE = CACHE_LINE_SIZE / sizeof(TraceRecord);
+constexpr size_t RECORDS_PER_FENCE = 4096 / sizeof(TraceRecord);
+
+static_assert(RECORD_CAPACITY % RECORDS_PER_LINE == 0,
+              "TRACR_CAPACITY has to fill whole cache lines");
+#endif
+
+#ifdef TRACR_FAST_PATH
+/**
+ * The write position of the TraCR thread of the calling thread, laid out for
+ * the markers: record idx is stored at base + idx * sizeof(TraceRecord), and
+ * every idx below end is free without asking the policy.
+ */
+struct TraceCursor {
+  uintptr_t base;
+  size_t idx;
+  size_t end;
+};
+
+/**
+ * Initial-exec, so a marker reaches it with a single thread pointer relative
+ * access, also from a shared object. Constant initialized and trivially
+ * destructible, so no TLS wrapper function is called either. An end of 0 sends
+ * the markers to the TraCR thread.
+ */
+inline thread_local TraceCursor tracr_cursor
+    __attribute__((tls_model("initial-exec"))) = {0, 0, 0};
+#endif
+
+#ifdef TRACR_RUNTIME_POLICY
+/**
+ * The policy and the capacity (in events) of the TraCR threads created from
+ * now on. Chosen before instrumentation_start(), TRACR_CAPACITY is only the
+ * default.
+ */
+inline BtsPolicy tracr_policy = BtsPolicy::ABORT;
+inline size_t tracr_capacity = CAPACITY;
+#endif
+
+/**
+ * The number of records of new buffers
+ */
+inline size_t record_capacity() {
+#ifdef TRACR_RUNTIME_POLICY
+  return tracr_capacity * (RECORD_CAPACITY / CAPACITY);
+#else
+  return RECORD_CAPACITY;
+#endif
+}
+
+#ifdef TRACR_POOL_CHUNK
+/**
+ * The number of records per chunk of a pooled buffer, the granularity by which
+ * the buffer of a TraCR thread grows.
+ */
+constexpr size_t POOL_CHUNK = TRACR_POOL_CHUNK;
+
+static_assert(RECORD_CAPACITY % POOL_CHUNK == 0,
+              "The capacity has to be a multiple of TRACR_POOL_CHUNK");
+static_assert(POOL_CHUNK * sizeof(TraceRecord) % 4096 == 0,
+              "A chunk has to span whole pages");
+
+/**
+ * A chunk taken from the pool may stay a mapping of its own, and a process
+ * has at most vm.max_map_count (65530 by default) of them. Hence a buffer
+ * holds at most this many chunks.
+ */
+constexpr size_t MAX_POOL_CHUNKS = 64;
+
+static_assert(RECORD_CAPACITY / POOL_CHUNK <= MAX_POOL_CHUNKS,
+              "TRACR_POOL_CHUNK has to be at least 1/64 of the capacity");
+#else
+constexpr size_t POOL_CHUNK = 0;
+#endif
+
+#ifdef TRACR_BUFFER_POOL
+/**
+ * The buffers of finalized TraCR threads. Global rather than part of the
+ * TraCR proc, as the flush engine and threads still running after
+ * instrumentation_end() give buffers back.
+ */
+inline BufferPool<TraceRecord> tracr_buffer_pool(record_capacity(), POOL_CHUNK);
+#endif
+
+#ifdef TRACR_PER_CPU
+/**
+ * The buffers all threads record into with TRACR_PER_CPU. Global rather than
+ * part of the TraCR proc, as threads may still record after
+ * instrumentation_end().
+ */
+inline CpuBuffers<CpuRecord> tracr_cpu_buffers;
+#endif
+
 /**
  * TraCR Thread class. One MPI instance chas atleast 1
  */
@@ -179,117 +496,1185 @@ public:
   /**
    * Constructor
    */
-  TraCRThread(long tid) : _tid(tid){};
+#ifdef TRACR_MAPPED_BUFFER
+  /**
+   * Constructor, maps traces.bts inside the given proc folder as the buffer
+   */
+  TraCRThread(long tid, const std::string &path)
+      : _traces(RECORD_CAPACITY, open_mapped_file(path, tid),
+                sizeof(BtsHeader)),
+        _tid(tid) {
+    _thread_folder_name = path + "thread." + std::to_string(_tid) + "/";
+    _mappedHeader = static_cast<BtsHeader *>(_traces.prefix());
+    *_mappedHeader = make_header();
+  };
+#else
+#ifdef TRACR_FAST_PATH
+  TraCRThread(long tid) : _traces(new_buffer()), _tid(tid) {
+    _traceIdx = 0;
+    sync_cursor();
+  };
+#elif defined(TRACR_RUNTIME_POLICY)
+  TraCRThread(long tid) : _traces(new_buffer()), _tid(tid) {
+    _window.capacity = _window.end = _traces.size();
+    select_policy(tracr_policy);
+  };
+#else
+  TraCRThread(long tid) : _traces(new_buffer()), _tid(tid){};
+#endif
+#endif
 
   /**
    * No default constructor allowed.
    */
   TraCRThread() = delete;
 
+#if defined(TRACR_FAST_PATH) || defined(TRACR_BUFFER_POOL)
+  /**
+   * Destructor, sends the markers of this thread back to the TraCR thread and
+   * the buffer back to the pool
+   */
+  ~TraCRThread() {
+#ifdef TRACR_FAST_PATH
+    tracr_cursor.end = 0;
+#endif
+#ifdef TRACR_BUFFER_POOL
+    tracr_buffer_pool.give(std::move(_traces));
+#endif
+  }
+#else
   /**
    * Default Destructor as we obey RAII
    */
   ~TraCRThread() = default;
+#endif
 
   /**
    *
    */
   inline void store_trace(const Payload &payload) {
-#ifdef TRACR_POLICY_PERIODIC
-    if (unlikely(_traceIdx == CAPACITY)) {
+#ifdef TRACR_COMPACT_PAYLOAD
+    uint64_t words[CompactCodec::MAX_WORDS];
+    size_t count = CompactCodec::encode(payload, _lastTimestamp, words);
+
+    if (unlikely(!reserve(count))) {
+      return;
+    }
+
+#ifdef TRACR_POLICY_SEGMENTED
+    // A new segment starts over from a zero timestamp
+    if (unlikely(_traceIdx == 0)) {
+      count = CompactCodec::encode(payload, _lastTimestamp, words);
+    }
+#endif
+
+    for (size_t i = 0; i < count; ++i) {
+      _traces[slot(_traceIdx) + i] = words[i];
+    }
+    publish(_traceIdx + count);
+    _lastTimestamp = payload.timestamp & ~COARSE_TIMESTAMP_FLAG;
+#elif defined(TRACR_POLICY_PERIODIC)
+    if (unlikely(next_index() == CAPACITY)) {
       debug_print("WARNING: TID[%lu] is full, this thread will now overwrite "
                   "from the beginning.",
                   _tid);
     }
 
-    _traces[_traceIdx % CAPACITY] = payload;
-    ++_traceIdx;
-
-#elif defined(TRACR_POLICY_IGNORE_IF_FULL)
-    if (unlikely(_traceIdx >= CAPACITY)) {
-      debug_print("WARNING: TID[%lu] is full, this thread will now ignore "
-                  "incoming traces.",
-                  _tid);
-    } else {
-      _traces[_traceIdx] = payload;
-      ++_traceIdx;
+#ifdef TRACR_POOL_CHUNK
+    // The first lap takes the chunks, later ones find the buffer backed
+    if (unlikely(next_index() + 1 > _growAt)) {
+      grow(next_index() + 1);
     }
-#else /* Abort if full */
-    if (unlikely(_traceIdx >= CAPACITY)) {
-      std::cerr << "Warning: TID[" << _tid
-                << "] is full, terminating with a Runtime Error.\n";
-      std::exit(EXIT_FAILURE);
+#endif
+
+#ifdef TRACR_NT_STORES
+    stage(payload);
+#else
+    _traces[_traceIdx % CAPACITY] = payload;
+    publish(_traceIdx + 1);
+#endif
+#else
+    if (unlikely(!reserve(1))) {
+      return;
     }
 
-    _traces[_traceIdx] = payload;
-    ++_traceIdx;
+#ifdef TRACR_NT_STORES
+    stage(payload);
+#else
+    _traces[slot(_traceIdx)] = payload;
+    publish(_traceIdx + 1);
+#endif
+#endif
+
+#ifdef TRACR_FAST_PATH
+    sync_cursor();
 #endif
   }
 
+#ifdef TRACR_NT_STORES
   /**
-   * Flushed the traces into a file at the given path
+   * Write the staged records into the buffer and publish all records. Called
+   * by the owner before it reads its own records.
    */
-#ifndef TRACR_DISABLE_FLUSH
-  inline void flush_traces(const std::string &path) {
-    // Don't create a folder if this TraCR thread is empty
-    if (_traceIdx == 0) {
-      return;
+  inline void drain_stage() {
+    const size_t staged = _stagedIdx % RECORDS_PER_LINE;
+    for (size_t i = 0; i < staged; ++i) {
+      _traces[(_stagedIdx - staged + i) % RECORD_CAPACITY] = _stage[i];
+    }
+
+    nt_store_fence();
+    publish(_stagedIdx);
+  }
+#endif
+
+#ifdef TRACR_CAPTURE_CPU
+  /**
+   * Store a CPU payload if this thread migrated since its previous event
+   */
+  inline void track_cpu(uint16_t channelId, uint32_t cpu, uint64_t timestamp) {
+    if (unlikely(cpu != _lastCpu)) {
+      _lastCpu = cpu;
+      store_trace({channelId, CPU_EVENT_ID, cpu, timestamp});
     }
+  }
+#endif
+
+#ifdef TRACR_ASYNC_FLUSH
+  /**
+   * Connect this TraCR thread to the flush engine writing its trace file
+   */
+  inline void attach_flush_engine(FlushEngine *engine) {
+    _flushEngine = engine;
+  }
+#endif
+
+#ifdef TRACR_SINGLE_FILE
+  /**
+   * Connect this TraCR thread to the container its trace file is written into
+   */
+  inline void attach_container(TraceContainer *container) {
+    _container = container;
+  }
+#endif
 
+#ifdef TRACR_POLICY_SEGMENTED
+  /**
+   * Connect this TraCR thread to the segment rotation of the proc folder at
+   * the given path
+   */
+  inline void attach_segments(SegmentManager *segments,
+                              const std::string &path) {
+    _segments = segments;
+    _proc_folder_name = path;
     _thread_folder_name = path + "thread." + std::to_string(_tid) + "/";
+    _seenEpoch = SegmentManager::epoch();
+  }
 
-    // Create the last thread ID folder
-    if (mkdir(_thread_folder_name.c_str(), 0755) != 0) {
-      if (errno != EEXIST) { // ignore "already exists"
-        std::cerr << "mkdir failed for: " << _thread_folder_name
-                  << " errno=" << errno << " (" << std::strerror(errno)
-                  << ")\n";
-        std::exit(EXIT_FAILURE);
-      }
+  /**
+   * Write the records recorded so far as traces.<segment>.bts and continue
+   * with an empty buffer in the next segment
+   */
+  inline void next_segment() {
+    std::lock_guard<std::mutex> lock(_swapMutex);
+    _seenEpoch = SegmentManager::epoch();
+
+    // Flushed by instrumentation_end(), there is no proc anymore
+    if (!_detached) {
+      write_segment(_traceIdx);
     }
 
-    std::string filepath = _thread_folder_name + "traces.bts";
+    publish(0);
+#ifdef TRACR_COMPACT_PAYLOAD
+    // Each segment is decoded on its own
+    _lastTimestamp = 0;
+#endif
+  }
+#endif
+
+#ifdef TRACR_POLICY_STREAMING
+  /**
+   * Connect this TraCR thread to the writer thread which streams its filled
+   * halves into the proc folder at the given path
+   */
+  inline void attach_writer(TraceWriter *writer, const std::string &path) {
+    _writer = writer;
+    _proc_folder_name = path;
+  }
+
+  /**
+   *
+   */
+  inline size_t getStreamHandoffs() { return _streamHandoffs; }
+
+  /**
+   *
+   */
+  inline size_t getStreamStalls() { return _streamStalls; }
+#endif
+
+#ifndef TRACR_DISABLE_FLUSH
+  /**
+   * Take over the flush of this TraCR thread. Returns false if the owner or
+   * instrumentation_end() already did, so no thread gets flushed twice. Called
+   * under tracr_threads_mutex.
+   */
+  inline bool claim_flush() {
+    if (_flushed) {
+      return false;
+    }
+    _flushed = true;
+    return true;
+  }
+
+  /**
+   * Flushed the traces into a file at the given path
+   */
+  inline void flush_traces(const std::string &path) {
+#ifdef TRACR_NT_STORES
+    drain_stage();
+#endif
+
+#ifdef TRACR_POLICY_STREAMING
+    (void)path; // The file is already in place
+    finish_stream(_traceIdx);
+#elif defined(TRACR_POLICY_SEGMENTED)
+    (void)path; // The last segment
+    write_segment(_traceIdx);
+#elif defined(TRACR_MAPPED_BUFFER)
+    (void)path; // The file is already in place
+
+    const std::string filepath = _thread_folder_name + "traces.bts";
+
+    // Don't leave a folder behind if this TraCR thread is empty
+    if (_traceIdx == 0) {
+      unlink(filepath.c_str());
+      rmdir(_thread_folder_name.c_str());
+      return;
+    }
+
+    const size_t count = std::min(_traceIdx, RECORD_CAPACITY);
+    const size_t oldest =
+        (_traceIdx > RECORD_CAPACITY) ? _traceIdx % RECORD_CAPACITY : 0;
+
+    // Unwrap in place into chronological order
+    std::rotate(_traces.data(), _traces.data() + oldest,
+                _traces.data() + count);
+
+    BtsTrailer trailer{};
+    trailer.num_records = count;
+    trailer.num_overwritten = getOverwritten();
+#ifdef TRACR_POLICY_IGNORE_IF_FULL
+    trailer.num_dropped = _numDropped;
+#endif
+
+    collect_stats(_traces.data(), count, _stats, _statsPrev);
+    _mappedHeader->published_records = count;
+
+    // Cut the unused capacity and append the trailer
+    const std::string bytes = bts_trailer_bytes(_stats, trailer);
+    const off_t end = sizeof(BtsHeader) + sizeof(TraceRecord) * count;
+
+    int fd = open(filepath.c_str(), O_WRONLY);
+    if (fd < 0 || ftruncate(fd, end) != 0 ||
+        pwrite(fd, bytes.data(), bytes.size(), end) !=
+            static_cast<ssize_t>(bytes.size()) ||
+        close(fd) != 0) {
+      std::cerr << "Failed to finish file: " << filepath << " errno=" << errno
+                << " (" << std::strerror(errno) << ")\n";
+      std::exit(EXIT_FAILURE);
+    }
+#else
+    // Don't create a folder if this TraCR thread is empty
+    if (_traceIdx == 0) {
+      return;
+    }
+
+    _thread_folder_name = path + "thread." + std::to_string(_tid) + "/";
+
+    debug_print("The filepath of this TraCR thread[%lu] is: %straces.bts",
+                _tid, _thread_folder_name.c_str());
+
+    // Once wrapped, the whole buffer is valid starting at the oldest record
+    const size_t count = std::min(_traceIdx, capacity());
+    const size_t oldest = (_traceIdx > capacity()) ? _traceIdx % capacity() : 0;
+
+    BtsTrailer trailer{};
+    trailer.num_records = count;
+    trailer.num_overwritten = getOverwritten();
+#if defined(TRACR_POLICY_IGNORE_IF_FULL)
+    trailer.num_dropped = _numDropped;
+#elif defined(TRACR_RUNTIME_POLICY)
+    trailer.num_dropped = _window.dropped;
+#endif
+
+    std::shared_ptr<const void> owner;
+    const TraceRecord *records = _traces.data();
+#ifdef TRACR_ASYNC_FLUSH
+    // Hand the buffer over, the flush engine releases it once written
+    auto buffer = hand_over();
+    records = buffer->data();
+    owner = buffer;
+#endif
+
+    // Unwrapped into chronological order
+    write_bts_file(_thread_folder_name, owner, records + oldest,
+                   count - oldest, records, oldest, trailer);
+#endif
+  }
+
+  /**
+   * Copy the records of this TraCR thread and write them into the thread
+   * folder inside the given snapshot folder. Called by the snapshot thread
+   * while the owner keeps recording, which is never blocked.
+   */
+  inline void snapshot_traces(const std::string &path) const {
+    FlushJob job;
+    if (copy_traces(path, job)) {
+#ifdef TRACR_ASYNC_FLUSH
+      _flushEngine->submit(std::move(job));
+#else
+      FlushEngine::write(job);
+#endif
+    }
+  }
+
+  /**
+   * Copy the records of this TraCR thread into a job writing them into the
+   * thread folder inside the given folder. Returns false if there are none.
+   * The job owns the copy, hence can be written once the thread is gone.
+   */
+  inline bool copy_traces(const std::string &path, FlushJob &job) const {
+    const size_t end = __atomic_load_n(&_traceIdx, __ATOMIC_ACQUIRE);
+    if (end == 0) {
+      return false;
+    }
+
+    // Copy in chronological order, a wrapped buffer starts at its oldest
+    const size_t begin = (end > capacity()) ? end - capacity() : 0;
+    const size_t first = begin % capacity();
+    const size_t firstCount = std::min(end - begin, capacity() - first);
+
+    auto copy = std::make_shared<std::vector<TraceRecord>>(end - begin);
+    std::memcpy(copy->data(), &_traces[first],
+                sizeof(TraceRecord) * firstCount);
+    std::memcpy(copy->data() + firstCount, _traces.data(),
+                sizeof(TraceRecord) * (copy->size() - firstCount));
+
+    size_t torn = 0;
+    if (wraps()) {
+      // The owner may have overwritten the oldest records while copying. It
+      // writes record i before publishing i + 1, hence everything up to
+      // i - capacity() may be torn.
+      size_t now = __atomic_load_n(&_traceIdx, __ATOMIC_ACQUIRE);
+#ifdef TRACR_NT_STORES
+      // The owner streams up to a page of records past the published index
+      now += RECORDS_PER_FENCE;
+#endif
+      if (now >= capacity() && now - capacity() + 1 > begin) {
+        torn = std::min(now - capacity() + 1 - begin, copy->size());
+      }
+    }
+
+    BtsTrailer trailer{};
+    trailer.num_records = copy->size() - torn;
+    trailer.num_overwritten = begin + torn;
+
+    job = make_bts_job(path + "thread." + std::to_string(_tid) + "/", copy,
+                       copy->data() + torn, copy->size() - torn, nullptr, 0,
+                       trailer);
+    return true;
+  }
+
+  /**
+   * Flush the records published so far on behalf of this TraCR thread while
+   * its owner is still running. Later records of the owner are not flushed.
+   */
+  inline void flush_live(const std::string &path) {
+#if defined(TRACR_POLICY_STREAMING)
+    (void)path; // The file is already in place
+
+    // The owner can't be inside swap_halves(), and won't hand over any more
+    // halves once detached
+    std::lock_guard<std::mutex> lock(_swapMutex);
+    _detached = true;
+    finish_stream(__atomic_load_n(&_traceIdx, __ATOMIC_ACQUIRE));
+#elif defined(TRACR_POLICY_SEGMENTED)
+    // The owner can't be inside next_segment(), and won't write any more
+    // segments once detached
+    std::lock_guard<std::mutex> lock(_swapMutex);
+    _detached = true;
+
+    FlushJob job;
+    if (copy_traces(path, job)) {
+      write_segment_job(std::move(job));
+    }
+#elif defined(TRACR_MAPPED_BUFFER)
+    // The owner keeps writing into the file, so it can't be truncated. The
+    // published records are recovered by tracr_process.
+    (void)path;
+#else
+    snapshot_traces(path);
+#endif
+  }
+#endif
+
+  /**
+   * Number of events overwritten by TRACR_POLICY_PERIODIC
+   */
+  inline size_t getOverwritten() const {
+    const size_t idx = __atomic_load_n(&_traceIdx, __ATOMIC_RELAXED);
+    return (idx > capacity()) ? idx - capacity() : 0;
+  }
+
+  /**
+   * Whether the oldest records get overwritten once the buffer is full
+   */
+  inline bool wraps() const {
+#if defined(TRACR_POLICY_PERIODIC)
+    return true;
+#elif defined(TRACR_RUNTIME_POLICY)
+    return _policy == BtsPolicy::PERIODIC;
+#else
+    return false;
+#endif
+  }
+
+  /**
+   * The number of records of the buffer
+   */
+  inline size_t capacity() const {
+#ifdef TRACR_RUNTIME_POLICY
+    return _window.capacity;
+#else
+    return RECORD_CAPACITY;
+#endif
+  }
+
+  /**
+   *
+   */
+  inline long getTID() { return _tid; }
+
+  // The buffer to keep track of the traces (committed lazily by the kernel)
+  TraceBuffer<TraceRecord> _traces;
+
+#ifdef TRACR_FAST_PATH
+  // The index at which point to add the next record, kept in the cursor of
+  // the owning thread
+  size_t &_traceIdx = tracr_cursor.idx;
+#else
+  // The index at which point to add the next record
+  size_t _traceIdx = 0;
+#endif
+
+private:
+  /**
+   * Advance the index once the records are written. The release store lets the
+   * snapshot thread read all records below the index (a plain store on x86).
+   */
+  inline void publish(size_t traceIdx) {
+    __atomic_store_n(&_traceIdx, traceIdx, __ATOMIC_RELEASE);
+#ifdef TRACR_MAPPED_BUFFER
+    // Mirrored into the file, in case the process dies before the flush
+    __atomic_store_n(&_mappedHeader->published_records, traceIdx,
+                     __ATOMIC_RELEASE);
+#endif
+  }
+
+#ifdef TRACR_FAST_PATH
+  /**
+   * Point the cursor of the owning thread at the records the markers may
+   * store without the policy: the rest of the current lap of a periodic
+   * buffer, of the current half of a streamed one, or of the whole buffer.
+   */
+  inline void sync_cursor() {
+    const uintptr_t data = reinterpret_cast<uintptr_t>(_traces.data());
+#if defined(TRACR_POLICY_PERIODIC)
+    const size_t lap = _traceIdx / RECORD_CAPACITY * RECORD_CAPACITY;
+    tracr_cursor.base = data - lap * sizeof(TraceRecord);
+    tracr_cursor.end = lap + RECORD_CAPACITY;
+#elif defined(TRACR_POLICY_STREAMING)
+    tracr_cursor.base = data;
+    tracr_cursor.end = _halfEnd;
+#else
+    tracr_cursor.base = data;
+    tracr_cursor.end = RECORD_CAPACITY;
+#endif
+#ifdef TRACR_POOL_CHUNK
+    // Up to the chunks taken so far
+    tracr_cursor.end = std::min(tracr_cursor.end, _growAt);
+#endif
+  }
+#endif
+
+  /**
+   * A buffer for a new TraCR thread, from the pool with TRACR_BUFFER_POOL
+   */
+  static inline TraceBuffer<TraceRecord> new_buffer() {
+#ifdef TRACR_BUFFER_POOL
+    return tracr_buffer_pool.take();
+#else
+    return TraceBuffer<TraceRecord>(record_capacity());
+#endif
+  }
+
+  /**
+   * The slot of the buffer holding index idx of the current lap
+   */
+  inline size_t slot(size_t idx) const {
+#ifdef TRACR_RUNTIME_POLICY
+    return idx - _window.lap;
+#else
+    return idx;
+#endif
+  }
+
+#ifdef TRACR_RUNTIME_POLICY
+  /**
+   * Specialize the full-buffer path of this TraCR thread for policy
+   */
+  inline void select_policy(BtsPolicy policy) {
+    _policy = policy;
+    switch (policy) {
+    case BtsPolicy::PERIODIC:
+      _makeRoom = &TraCRThread::make_room<Periodic>;
+      break;
+    case BtsPolicy::IGNORE_IF_FULL:
+      _makeRoom = &TraCRThread::make_room<IgnoreIfFull>;
+      break;
+    default:
+      _makeRoom = &TraCRThread::make_room<AbortIfFull>;
+      break;
+    }
+  }
+
+  /**
+   * The full-buffer path of a Policy, taken at the end of the window only.
+   * Returns false if the record has to be dropped.
+   */
+  template <typename Policy> bool make_room() {
+    debug_print("WARNING: TID[%lu] is full, policy: %s", _tid,
+                full_policy_name(Policy::policy));
+    return Policy::make_room(_window, _tid);
+  }
+#endif
+
+#ifdef TRACR_ASYNC_FLUSH
+  /**
+   * Hand the buffer over to the flush engine, which releases it once written
+   * (back into the pool with TRACR_BUFFER_POOL)
+   */
+  inline std::shared_ptr<TraceBuffer<TraceRecord>> hand_over() {
+#ifdef TRACR_BUFFER_POOL
+    return tracr_buffer_pool.hand_over(std::move(_traces));
+#else
+    return std::make_shared<TraceBuffer<TraceRecord>>(std::move(_traces));
+#endif
+  }
+#endif
+
+#ifdef TRACR_POOL_CHUNK
+  /**
+   * Take chunks from the pool until the first end records are backed. Once
+   * the whole capacity is, the buffer never grows again (e.g. a wrapped
+   * periodic one).
+   */
+  inline void grow(size_t end) {
+    tracr_buffer_pool.grow(_traces, end);
+    _growAt = (_traces.populated() < RECORD_CAPACITY) ? _traces.populated()
+                                                      : SIZE_MAX;
+  }
+#endif
+
+  /**
+   * The index of the next record, ahead of the published one by the records
+   * not yet published
+   */
+  inline size_t next_index() const {
+#ifdef TRACR_NT_STORES
+    return _stagedIdx;
+#else
+    return _traceIdx;
+#endif
+  }
+
+#ifdef TRACR_NT_STORES
+  /**
+   * Collect the payload in the staging line. A full line is streamed into the
+   * buffer past the caches, and each page of lines is fenced and published.
+   */
+  inline void stage(const TraceRecord &record) {
+    _stage[_stagedIdx % RECORDS_PER_LINE] = record;
+    ++_stagedIdx;
+
+    if (_stagedIdx % RECORDS_PER_LINE == 0) {
+#ifdef TRACR_POLICY_PERIODIC
+      const size_t line = (_stagedIdx - RECORDS_PER_LINE) % RECORD_CAPACITY;
+#else
+      const size_t line = _stagedIdx - RECORDS_PER_LINE;
+#endif
+      nt_store_line(&_traces[line], _stage);
+
+      if (unlikely(_stagedIdx % RECORDS_PER_FENCE == 0)) {
+        nt_store_fence();
+        publish(_stagedIdx);
+      }
+    }
+  }
+#endif
+
+  /**
+   * Make room for count records according to the policy. Returns false if the
+   * record has to be dropped.
+   */
+  inline bool reserve(size_t count) {
+#if defined(TRACR_POLICY_IGNORE_IF_FULL)
+    if (unlikely(next_index() + count > RECORD_CAPACITY)) {
+      debug_print("WARNING: TID[%lu] is full, this thread will now ignore "
+                  "incoming traces.",
+                  _tid);
+      ++_numDropped;
+      return false;
+    }
+#elif defined(TRACR_POLICY_STREAMING)
+    if (unlikely(_traceIdx + count > _halfEnd)) {
+      swap_halves();
+    }
+#elif defined(TRACR_POLICY_SEGMENTED)
+    if (unlikely(_traceIdx + count > RECORD_CAPACITY ||
+                 SegmentManager::epoch() != _seenEpoch)) {
+      next_segment();
+    }
+#elif defined(TRACR_RUNTIME_POLICY)
+    // The same for all policies, the chosen one only steps in once full
+    if (unlikely(next_index() + count > _window.end)) {
+      return (this->*_makeRoom)();
+    }
+#else /* Abort if full */
+    if (unlikely(next_index() + count > RECORD_CAPACITY)) {
+      std::cerr << "Warning: TID[" << _tid
+                << "] is full, terminating with a Runtime Error.\n";
+      std::exit(EXIT_FAILURE);
+    }
+#endif
+
+#ifdef TRACR_POOL_CHUNK
+    // The records reach past the chunks taken so far
+    if (unlikely(next_index() + count > _growAt)) {
+      grow(next_index() + count);
+    }
+#endif
+    return true;
+  }
+
+#ifndef TRACR_DISABLE_FLUSH
+  /**
+   * Describe the records of this TraCR thread for the .bts header
+   */
+  inline BtsHeader make_header() const {
+    BtsHeader header{};
+    std::memcpy(header.magic, BTS_MAGIC, sizeof(header.magic));
+    header.version = BTS_VERSION;
+    header.header_size = sizeof(BtsHeader);
+    header.record_size = sizeof(TraceRecord);
+#ifdef TRACR_COMPACT_PAYLOAD
+    header.payload_format = static_cast<uint8_t>(BtsPayloadFormat::COMPACT);
+#else
+    header.payload_format = static_cast<uint8_t>(BtsPayloadFormat::STANDARD);
+#endif
+#if defined(TRACR_POLICY_PERIODIC)
+    header.policy = static_cast<uint8_t>(BtsPolicy::PERIODIC);
+#elif defined(TRACR_POLICY_IGNORE_IF_FULL)
+    header.policy = static_cast<uint8_t>(BtsPolicy::IGNORE_IF_FULL);
+#elif defined(TRACR_POLICY_STREAMING)
+    header.policy = static_cast<uint8_t>(BtsPolicy::STREAMING);
+#elif defined(TRACR_POLICY_SEGMENTED)
+    header.policy = static_cast<uint8_t>(BtsPolicy::SEGMENTED);
+    header.segment = _segment;
+#elif defined(TRACR_RUNTIME_POLICY)
+    header.policy = static_cast<uint8_t>(_policy);
+#else
+    header.policy = static_cast<uint8_t>(BtsPolicy::ABORT);
+#endif
+    header.timer_backend = static_cast<uint8_t>(NanoTimer::backend());
+#ifdef TRACR_RAW_TIMESTAMPS
+    header.flags |= BTS_FLAG_RAW_TIMESTAMPS;
+#endif
+#ifdef TRACR_CAPTURE_CPU
+    header.flags |= BTS_FLAG_CAPTURE_CPU;
+#endif
+#ifdef TRACR_MAPPED_BUFFER
+    header.flags |= BTS_FLAG_MAPPED;
+#endif
+#ifdef TRACR_COMPRESS
+    header.flags |= BTS_FLAG_COMPRESSED;
+#endif
+    header.capacity = capacity();
+#ifdef USE_HW_COUNTER
+    header.frequency = NanoTimer::frequency();
+#endif
+    header.tid = _tid;
+    return header;
+  }
+
+  /**
+   * The name of the trace file of this TraCR thread
+   */
+  inline std::string bts_filename() const {
+#ifdef TRACR_POLICY_SEGMENTED
+    return "traces." + std::to_string(_segment) + ".bts";
+#else
+    return "traces.bts";
+#endif
+  }
+
+  /**
+   * Add count records to the statistics of the trailer. prev is the decoding
+   * state of compact records.
+   */
+  static inline void collect_stats(const TraceRecord *records, size_t count,
+                                   BtsStats &stats, uint64_t &prev) {
+#ifdef TRACR_COMPACT_PAYLOAD
+    size_t pos = 0;
+    while (pos < count) {
+      Payload payload;
+      size_t used =
+          CompactCodec::decode(&records[pos], count - pos, prev, payload);
+      if (used == 0) {
+        break;
+      }
+      stats.add(payload.eventId, payload.timestamp & ~COARSE_TIMESTAMP_FLAG);
+      pos += used;
+    }
+#else
+    (void)prev;
+    for (size_t i = 0; i < count; ++i) {
+      stats.add(records[i].eventId,
+                records[i].timestamp & ~COARSE_TIMESTAMP_FLAG);
+    }
+#endif
+  }
+
+  /**
+   * Write the trace file into folder holding the records of first followed by
+   * the ones of second. owner keeps the records alive while they are written.
+   * With TRACR_ASYNC_FLUSH this only queues the file to the flush engine.
+   * With TRACR_SINGLE_FILE the file becomes a section of the container instead.
+   * With TRACR_COMPRESS the records are compressed by whoever writes the file.
+   */
+  inline void write_bts_file(const std::string &folder,
+                             std::shared_ptr<const void> owner,
+                             const TraceRecord *first, size_t firstCount,
+                             const TraceRecord *second, size_t secondCount,
+                             const BtsTrailer &trailer) const {
+    FlushJob job = make_bts_job(folder, std::move(owner), first, firstCount,
+                                second, secondCount, trailer);
+
+#ifdef TRACR_ASYNC_FLUSH
+    _flushEngine->submit(std::move(job));
+#else
+    FlushEngine::write(job);
+#endif
+  }
+
+  /**
+   * The job writing the trace file of write_bts_file(). It does not refer to
+   * this TraCR thread, so it may be written after the thread is gone.
+   */
+  inline FlushJob make_bts_job(const std::string &folder,
+                               std::shared_ptr<const void> owner,
+                               const TraceRecord *first, size_t firstCount,
+                               const TraceRecord *second, size_t secondCount,
+                               const BtsTrailer &trailer) const {
+    const BtsHeader header = make_header();
+
+    FlushJob job;
+#ifdef TRACR_SINGLE_FILE
+    (void)folder;
+    job.filepath = _container->getPath();
+#else
+    job.folder = folder;
+    job.filepath = folder + bts_filename();
+#endif
+    job.head.assign(reinterpret_cast<const char *>(&header), sizeof(header));
+    job.first = first;
+    job.firstBytes = sizeof(TraceRecord) * firstCount;
+    job.second = second;
+    job.secondBytes = sizeof(TraceRecord) * secondCount;
+    job.owner = std::move(owner);
+
+    // The statistics scan all records, leave this to the I/O thread too
+    job.prepare = [first, firstCount, second, secondCount,
+                   trailer](FlushJob &job) {
+      BtsStats stats;
+      uint64_t prev = 0;
+      collect_stats(first, firstCount, stats, prev);
+      collect_stats(second, secondCount, stats, prev);
+      job.tail = bts_trailer_bytes(stats, trailer);
+
+#ifdef TRACR_COMPRESS
+      // The compressed blocks replace the records, which are released now
+      auto blocks = std::make_shared<std::string>(BlockCodec::compress(
+          job.first, job.firstBytes, job.second, job.secondBytes,
+          sizeof(TraceRecord), std::is_same<TraceRecord, Payload>::value));
+      job.first = blocks->data();
+      job.firstBytes = blocks->size();
+      job.second = nullptr;
+      job.secondBytes = 0;
+      job.owner = std::move(blocks);
+#endif
+    };
+
+#ifdef TRACR_SINGLE_FILE
+    // The section is reserved once the size of the tail is known
+    job.prepare = [prepare = std::move(job.prepare), container = _container,
+                   tid = _tid](FlushJob &job) {
+      prepare(job);
+      job.fd = container->getFd();
+      job.offset = container->append(tid, job.head.size() + job.firstBytes +
+                                              job.secondBytes +
+                                              job.tail.size());
+    };
+#endif
+
+    return job;
+  }
+
+#ifdef TRACR_MAPPED_BUFFER
+  /**
+   * Create traces.bts of the given TraCR thread, sized for the whole buffer.
+   * The file stays sparse until records are written.
+   */
+  static inline int open_mapped_file(const std::string &path, long tid) {
+    const std::string folder = path + "thread." + std::to_string(tid) + "/";
+    create_folder(folder);
+
+    const std::string filepath = folder + "traces.bts";
+    int fd = open(filepath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(BtsHeader) +
+                                    sizeof(TraceRecord) * RECORD_CAPACITY) !=
+                      0) {
+      std::cerr << "Failed to create file: " << filepath << " errno=" << errno
+                << " (" << std::strerror(errno) << ")\n";
+      std::exit(EXIT_FAILURE);
+    }
+
+    return fd;
+  }
+#endif
+
+  /**
+   * Create a folder, it may already exist
+   */
+  static inline void create_folder(const std::string &folder) {
+    if (mkdir(folder.c_str(), 0755) != 0) {
+      if (errno != EEXIST) { // ignore "already exists"
+        std::cerr << "mkdir failed for: " << folder << " errno=" << errno
+                  << " (" << std::strerror(errno) << ")\n";
+        std::exit(EXIT_FAILURE);
+      }
+    }
+  }
+
+  /**
+   * Create the folder of this TraCR thread inside the given proc folder
+   */
+  inline void create_thread_folder(const std::string &path) {
+    _thread_folder_name = path + "thread." + std::to_string(_tid) + "/";
+
+    // Create the last thread ID folder
+    create_folder(_thread_folder_name);
+  }
+#endif
+
+#ifdef TRACR_POLICY_SEGMENTED
+  /**
+   * Write the records up to end as the current segment and register it for
+   * the rotation
+   */
+  inline void write_segment(size_t end) {
+    if (end == 0) {
+      return;
+    }
+
+    BtsTrailer trailer{};
+    trailer.num_records = end;
+
+    std::shared_ptr<const void> owner;
+    const TraceRecord *records = _traces.data();
+#ifdef TRACR_ASYNC_FLUSH
+    // Hand the buffer over and continue in a fresh one, which is committed
+    // page by page again (unless recycled by the pool)
+    auto buffer = hand_over();
+    _traces = new_buffer();
+#ifdef TRACR_POOL_CHUNK
+    _growAt = 0;
+#endif
+    records = buffer->data();
+    owner = buffer;
+#endif
+
+    FlushJob job = make_bts_job(_thread_folder_name, owner, records, end,
+                                nullptr, 0, trailer);
+    write_segment_job(std::move(job));
+
+    debug_print("TID[%lu] wrote segment %zu with %zu records", _tid, _segment,
+                end);
+    ++_segment;
+  }
+
+  /**
+   * Write the job of a segment. The segment is registered for the rotation
+   * once written, with the size it takes on disk (trailer and compression
+   * included), so the rotation never removes a file still queued.
+   */
+  inline void write_segment_job(FlushJob &&job) {
+    job.done = [segments = _segments, order = _segments->reserve(),
+                filepath = job.filepath](size_t bytes) {
+      segments->add(order, filepath, bytes);
+    };
+
+#ifdef TRACR_ASYNC_FLUSH
+    _flushEngine->submit(std::move(job));
+#else
+    FlushEngine::write(job);
+#endif
+  }
+#endif
+
+#ifdef TRACR_POLICY_STREAMING
+  /**
+   * Hand the current half over to the writer and continue in the other one.
+   * Stalls if the writer did not yet finish writing the other half.
+   */
+  inline void swap_halves() {
+    std::lock_guard<std::mutex> lock(_swapMutex);
+
+    if (unlikely(_detached)) {
+      // Flushed by instrumentation_end(), there is no writer anymore
+      _traceIdx = _halfBase;
+      return;
+    }
+
+    submit_half(_traceIdx);
+
+    size_t next = (_halfBase == 0) ? 1 : 0;
+
+    if (unlikely(_halfPending[next].load(std::memory_order_acquire))) {
+      ++_streamStalls;
+      debug_print("WARNING: TID[%lu] stalls, the writer fell behind.", _tid);
+      _writer->wait(_halfPending[next]);
+    }
+
+    _halfBase = next * HALF_CAPACITY;
+    _halfEnd = _halfBase + HALF_CAPACITY;
+    _traceIdx = _halfBase;
+  }
+
+  /**
+   * Hand over what is left up to end in the current half, wait for the writer
+   * and finish traces.bts with its trailer
+   */
+  inline void finish_stream(size_t end) {
+    if (end != _halfBase) {
+      submit_half(end);
+    }
+
+    if (!_streamOpened) {
+      return; // This TraCR thread never recorded anything
+    }
+
+    // Also makes the statistics of the writer thread visible
+    _writer->wait(_headerPending);
+    _writer->wait(_halfPending[0]);
+    _writer->wait(_halfPending[1]);
+
+    BtsTrailer trailer{};
+    trailer.num_records = _streamedRecords;
+    std::string bytes = bts_trailer_bytes(_stats, trailer);
+
+    std::atomic<bool> pending{false};
+    _writer->submit(&_streamFd, bytes.data(), bytes.size(), &pending);
+    _writer->wait(pending);
+
+    if (close(_streamFd) != 0) {
+      std::cerr << "Failed to close file: " << _thread_folder_name
+                << "traces.bts\n";
+      std::exit(EXIT_FAILURE);
+    }
+    _streamFd = -1;
+    _streamOpened = false;
+
+    debug_print("TID[%lu] streamed %zu halves and stalled %zu times.", _tid,
+                _streamHandoffs, _streamStalls);
+  }
+
+  /**
+   * Queue the traces of the current half up to end to be appended to
+   * traces.bts. The file is opened and the statistics are collected by the
+   * writer thread.
+   */
+  inline void submit_half(size_t end) {
+    // Lazily open the file, so empty TraCR threads leave no folder behind.
+    // Blocks are written in order, so the header goes first.
+    if (!_streamOpened) {
+      _streamOpened = true;
+      _thread_folder_name =
+          _proc_folder_name + "thread." + std::to_string(_tid) + "/";
+      _streamHeader = make_header();
+      _writer->submit(&_streamFd, &_streamHeader, sizeof(_streamHeader),
+                      &_headerPending, [this] { open_stream(); });
+    }
+
+    const TraceRecord *records = &_traces[_halfBase];
+    const size_t count = end - _halfBase;
+    _streamedRecords += count;
+
+    size_t half = (_halfBase == 0) ? 0 : 1;
+    _writer->submit(&_streamFd, records, sizeof(TraceRecord) * count,
+                    &_halfPending[half], [this, records, count] {
+                      collect_stats(records, count, _stats, _statsPrev);
+                    });
+    ++_streamHandoffs;
+  }
+
+  /**
+   * Create the thread folder and open traces.bts, on the writer thread
+   */
+  inline void open_stream() {
+    create_folder(_thread_folder_name);
+
+    std::string filepath = _thread_folder_name + "traces.bts";
+    _streamFd =
+        open(filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (_streamFd < 0) {
+      std::cerr << "Failed to open file: " << filepath << "\n";
+      std::exit(EXIT_FAILURE);
+    }
+  }
+
+  // The number of records of each half of the buffer
+  static constexpr size_t HALF_CAPACITY = RECORD_CAPACITY / 2;
+
+  static_assert(HALF_CAPACITY >= CompactCodec::MAX_WORDS,
+                "TRACR_CAPACITY too small for streaming");
+
+  // The writer thread streaming the halves into the file
+  TraceWriter *_writer = nullptr;
+
+  // The file descriptor of traces.bts (opened by the writer thread on the
+  // first hand-over)
+  int _streamFd = -1;
+
+  // Set once the header has been handed over
+  bool _streamOpened = false;
+
+  // The header of traces.bts, kept alive until written
+  BtsHeader _streamHeader{};
+  std::atomic<bool> _headerPending{false};
+
+  // First and one past the last index of the half currently filled
+  size_t _halfBase = 0;
+  size_t _halfEnd = HALF_CAPACITY;
+
+  // Set while a half is owned by the writer
+  std::atomic<bool> _halfPending[2] = {false, false};
+
+  // Number of halves handed over to the writer
+  size_t _streamHandoffs = 0;
+
+  // Number of times this thread had to wait for the writer
+  size_t _streamStalls = 0;
+
+  // Number of records handed over to the writer
+  size_t _streamedRecords = 0;
+#endif
+
+#ifdef TRACR_POLICY_SEGMENTED
+  // Rotates the segments of all TraCR threads of the proc
+  SegmentManager *_segments = nullptr;
+
+  // The index of the segment currently recorded
+  size_t _segment = 0;
+
+  // The auto-flush epoch of the current segment
+  uint64_t _seenEpoch = 0;
+#endif
+
+#if defined(TRACR_POLICY_STREAMING) || defined(TRACR_POLICY_SEGMENTED)
+  // The path of the proc folder
+  std::string _proc_folder_name;
+
+  // Keeps instrumentation_end() and the owner's hand-over of records apart
+  std::mutex _swapMutex;
+
+  // Set once instrumentation_end() flushed this still running TraCR thread
+  bool _detached = false;
+#endif
+
+#ifdef TRACR_ASYNC_FLUSH
+  // The I/O threads writing the trace file
+  FlushEngine *_flushEngine = nullptr;
+#endif
+
+#ifdef TRACR_SINGLE_FILE
+  // The container of the proc holding the trace file
+  TraceContainer *_container = nullptr;
+#endif
+
+#ifndef TRACR_DISABLE_FLUSH
+  // Set once the owner or instrumentation_end() took over the flush
+  bool _flushed = false;
+
+  // Statistics of the flushed records for the .bts trailer
+  BtsStats _stats;
+
+  // The decoding state of collect_stats()
+  uint64_t _statsPrev = 0;
+#endif
 
-    debug_print("The filepath of this TraCR thread[%lu] is: %s", _tid,
-                filepath.c_str());
+#ifdef TRACR_POLICY_IGNORE_IF_FULL
+  // Number of events dropped as the buffer was full
+  size_t _numDropped = 0;
+#endif
 
-    std::ofstream ofs(filepath, std::ios::binary);
-    if (!ofs) {
-      std::cerr << "Failed to open file: " << filepath << "\n";
-      std::exit(EXIT_FAILURE);
-    }
+#ifdef TRACR_RUNTIME_POLICY
+  // The indices recorded without the policy
+  FillWindow _window;
 
-    // Write raw memory
-    ofs.write(reinterpret_cast<const char *>(_traces.data()),
-              sizeof(Payload) * _traceIdx);
+  // The policy, and its full-buffer path taken at the end of _window
+  BtsPolicy _policy = BtsPolicy::ABORT;
+  bool (TraCRThread::*_makeRoom)() = &TraCRThread::make_room<AbortIfFull>;
+#endif
 
-    if (!ofs.good()) {
-      std::cerr << "Failed to write into file: " << filepath << "\n";
-      std::exit(EXIT_FAILURE);
-    }
+#ifdef TRACR_MAPPED_BUFFER
+  // The header in front of the buffer, inside the mapping of traces.bts
+  BtsHeader *_mappedHeader = nullptr;
+#endif
 
-    // Closing file
-    ofs.close();
+#ifdef TRACR_CAPTURE_CPU
+  // The CPU of the previous event
+  uint32_t _lastCpu = UINT32_MAX;
+#endif
 
-    if (ofs.fail()) {
-      std::cerr << "Failed to close file: " << filepath << "\n";
-      std::exit(EXIT_FAILURE);
-    }
-  }
+#ifdef TRACR_COMPACT_PAYLOAD
+  // The timestamp the next compact record is relative to
+  uint64_t _lastTimestamp = 0;
 #endif
 
-  /**
-   *
-   */
-  inline long getTID() { return _tid; }
+#ifdef TRACR_POOL_CHUNK
+  // The number of records backed by chunks, SIZE_MAX once all of them are
+  size_t _growAt = 0;
+#endif
 
-  // The array to keep track of the traces
-  std::array<Payload, CAPACITY> _traces;
+#ifdef TRACR_NT_STORES
+  // The records of the current cache line, streamed into _traces once full
+  alignas(CACHE_LINE_SIZE) TraceRecord _stage[RECORDS_PER_LINE];
 
-  // The index at which point to add the next marker
-  size_t _traceIdx = 0;
+  // The index of the next record, staged records included
+  size_t _stagedIdx = 0;
+#endif
 
-private:
   // kernel thread ID
   long _tid;
 
@@ -306,10 +1691,38 @@ public:
    * Constructor
    */
   TraCRProc(long tid)
-      : _tracr_init_time(NanoTimer::now()), _tid(tid), _lCPUid(sched_getcpu()) {
+      : _tracr_init_time(NanoTimer::stamp()), _tid(tid),
+        _lCPUid(sched_getcpu()) {
+#ifdef USE_HW_COUNTER
+    // Reference pair to anchor the counter ticks to CLOCK_MONOTONIC_RAW
+    _refTicks = NanoTimer::raw();
+    _refNs = NanoTimer::clock_ns();
+#endif
+
+    add_clock_sync();
+
+    _timerProbes = NanoTimer::probe();
 
     _proc_folder_name = "proc." + std::to_string(_lCPUid) + "/";
 
+#if defined(TRACR_CAPTURE_CPU) || defined(TRACR_PER_CPU)
+    // Read once, the metadata may be rewritten on every segment
+    for (long cpu = 0; cpu < sysconf(_SC_NPROCESSORS_CONF); ++cpu) {
+      std::ifstream ifs("/sys/devices/system/cpu/cpu" + std::to_string(cpu) +
+                        "/topology/physical_package_id");
+      int socket = -1;
+      if (!(ifs >> socket)) {
+        socket = -1;
+      }
+      _cpuSockets.push_back(socket);
+    }
+#endif
+
+#ifdef TRACR_POLICY_SEGMENTED
+    // A daemon may never reach instrumentation_end()
+    _segments.on_segment([this] { dump_JSON(); });
+#endif
+
     debug_print("_proc_folder_name: %s", _proc_folder_name.c_str());
   };
 
@@ -319,9 +1732,13 @@ public:
   TraCRProc() = delete;
 
   /**
-   * Default Destructor as we obey RAII
+   * Destructor, stops the metadata refreshes before the members they read
    */
-  ~TraCRProc() = default;
+  ~TraCRProc() {
+#ifdef TRACR_POLICY_SEGMENTED
+    _segments.stop();
+#endif
+  }
 
   /**
    *
@@ -330,7 +1747,12 @@ public:
   inline bool create_folder_recursive(const std::string &path = "") {
     _proc_folder_name = path + "tracr/" + _proc_folder_name;
 
+#ifdef TRACR_SINGLE_FILE
+    // Only tracr/ itself, the proc is the file proc.<pid>.tracr inside it
+    std::istringstream iss(path + "tracr/");
+#else
     std::istringstream iss(_proc_folder_name);
+#endif
     std::string token;
     std::string current;
 
@@ -353,6 +1775,11 @@ public:
       }
     }
 
+#ifdef TRACR_SINGLE_FILE
+    _container.open(path + "tracr/proc." + std::to_string(_lCPUid) + ".tracr",
+                    _lCPUid);
+#endif
+
     return true;
   }
 
@@ -362,29 +1789,51 @@ public:
   inline std::string getFolderPath() { return _proc_folder_name; }
 
   /**
-   *
+   * Write metadata.json. Thread safe, as TraCR threads dump it after each
+   * segment. The file is replaced atomically, so readers never see it torn.
+   * With TRACR_SINGLE_FILE it finishes the container instead (only once).
    */
   inline void dump_JSON() {
-    if (!json_is_ready) {
-      write_JSON();
+    std::lock_guard<std::mutex> dumpLock(_dump_mutex);
+
+    // Always refresh, as clock synchronization points and thread information
+    // may have been added since the last write_JSON()
+    write_JSON();
+
+    std::string text;
+    {
+      std::lock_guard<std::mutex> lock(_json_mutex);
+      // Pretty-printed with 4 spaces
+      text = _json_file.dump(4);
     }
 
+#ifdef TRACR_SINGLE_FILE
+    _container.finish(text);
+
+    debug_print("'%s' successfully written!", _container.getPath().c_str());
+#else
     // Create and open the metadata.json file
     std::string filename = _proc_folder_name + "metadata.json";
-    std::ofstream file(filename);
+    std::string tmpname = filename + ".tmp";
+    std::ofstream file(tmpname);
 
     if (!file.is_open()) {
-      std::cerr << "Failed to open file: " << filename << " for writing!\n";
+      std::cerr << "Failed to open file: " << tmpname << " for writing!\n";
       std::exit(EXIT_FAILURE);
     }
 
-    // Dump JSON into file (pretty-printed with 4 spaces)
-    file << _json_file.dump(4);
+    file << text;
 
     // Close the file
     file.close();
 
+    if (file.fail() || std::rename(tmpname.c_str(), filename.c_str()) != 0) {
+      std::cerr << "Failed to write file: " << filename << "\n";
+      std::exit(EXIT_FAILURE);
+    }
+
     debug_print("'%s' successfully written!", filename.c_str());
+#endif
   }
 #endif
 
@@ -392,21 +1841,42 @@ public:
    *
    */
   inline void addCustomChannelNames(const nlohmann::json &channel_names) {
-    _json_file["channel_names"] = channel_names;
-    _json_file["num_channels"] = channel_names.size();
+    {
+      std::lock_guard<std::mutex> lock(_json_mutex);
+      _json_file["channel_names"] = channel_names;
+      _json_file["num_channels"] = channel_names.size();
+    }
+    checkpoint_JSON();
   }
 
   /**
    *
    */
   inline void addNumberOfChannels(const u_int16_t num_channels) {
-    _json_file["num_channels"] = num_channels;
+    {
+      std::lock_guard<std::mutex> lock(_json_mutex);
+      _json_file["num_channels"] = num_channels;
+    }
+    checkpoint_JSON();
+  }
+
+  /**
+   * With TRACR_MAPPED_BUFFER and TRACR_POLICY_SEGMENTED the metadata on disk is
+   * kept up to date as it changes, so the traces of a run that died or never
+   * ends can still be processed
+   */
+  inline void checkpoint_JSON() {
+#if defined(TRACR_MAPPED_BUFFER) || defined(TRACR_POLICY_SEGMENTED)
+    dump_JSON();
+#endif
   }
 
   /**
    *
    */
   inline void write_JSON() {
+    std::lock_guard<std::mutex> lock(_json_mutex);
+
     _json_file["pid"] = _lCPUid;
     _json_file["start_time"] = _tracr_init_time;
 
@@ -414,8 +1884,483 @@ public:
       _json_file["markerTypes"][std::to_string(key)] = value;
     }
 
-    json_is_ready = true;
+    _json_file["clock_sync"] = nlohmann::json::array();
+    for (const auto &point : _clockSyncs) {
+      _json_file["clock_sync"].push_back(
+          {{"stamp", point.stamp},
+           {"monotonic_raw", point.monotonic_raw},
+           {"realtime", point.realtime}});
+    }
+
+#if defined(TRACR_COMPACT_PAYLOAD)
+    _json_file["payload_format"] = "compact";
+#elif defined(TRACR_PER_CPU)
+    _json_file["payload_format"] = "per_cpu";
+#else
+    _json_file["payload_format"] = "standard";
+#endif
+
+    _json_file["timer"]["unit"] = NanoTimer::stamp_unit();
+    _json_file["timer"]["backend"] = NanoTimer::name(NanoTimer::backend());
+    for (const auto &probe : _timerProbes) {
+      _json_file["timer"]["backends"][NanoTimer::name(probe.backend)] = {
+          {"cost_ns", probe.cost_ns}, {"resolution_ns", probe.resolution_ns}};
+    }
+#ifdef USE_HW_COUNTER
+    _json_file["timer"]["frequency"] = NanoTimer::frequency();
+    _json_file["timer"]["source"] = NanoTimer::calibration().source;
+    _json_file["timer"]["error_ppm"] = NanoTimer::calibration().error_ppm;
+    _json_file["timer"]["reference"]["ticks"] = _refTicks;
+    _json_file["timer"]["reference"]["ns"] = _refNs;
+#endif
+
+#if defined(TRACR_CAPTURE_CPU) || defined(TRACR_PER_CPU)
+    // The socket of each CPU, to flag migrations across sockets
+    _json_file["cpu_sockets"] = _cpuSockets;
+#endif
+
+    if (_coarseClock) {
+      _json_file["coarse_clock"]["period_us"] = _coarseClock->getPeriodUs();
+      _json_file["coarse_clock"]["ticks"] = _coarseClock->getTicks();
+      _json_file["coarse_clock"]["mean_period_ns"] =
+          _coarseClock->getMeanPeriodNs();
+    }
+
+    if (_numSnapshots > 0) {
+      _json_file["snapshots"] = _numSnapshots.load();
+    }
+
+#ifdef TRACR_ASYNC_FLUSH
+    const double seconds = _flushEngine.getBusySeconds();
+    const size_t bytes = _flushEngine.getBytes();
+    _json_file["flush"] = {
+        {"backend", _flushEngine.getBackend()},
+        {"threads", _flushEngine.getNumThreads()},
+        {"files", _flushEngine.getFiles()},
+        {"bytes", bytes},
+        {"seconds", seconds},
+        {"mb_per_s", (seconds > 0) ? bytes / seconds / 1e6 : 0.0}};
+#endif
+
+#ifdef TRACR_SINGLE_FILE
+    // The trace sections, the metadata itself comes next
+    _json_file["container"] = {{"sections", _container.getNumSections()},
+                               {"alignment", CONTAINER_ALIGNMENT}};
+#endif
+
+#ifdef TRACR_HUGE_PAGES
+    for (PageBacking backing :
+         {PageBacking::HUGETLB, PageBacking::THP, PageBacking::BASE}) {
+      _json_file["huge_pages"][page_backing_name(backing)] =
+          _pageBackings[static_cast<size_t>(backing)].load();
+    }
+    _json_file["huge_pages"]["huge_page_bytes"] = _hugePageBytes.load();
+    _json_file["huge_pages"]["thp_mode"] = transparent_huge_pages_mode();
+#endif
+
+#ifdef TRACR_NT_STORES
+    _json_file["nt_stores"]["isa"] = nt_store_isa();
+    _json_file["nt_stores"]["records_per_fence"] = RECORDS_PER_FENCE;
+#endif
+
+#ifdef TRACR_RUNTIME_POLICY
+    _json_file["runtime_policy"] = {{"policy", full_policy_name(tracr_policy)},
+                                    {"capacity", tracr_capacity}};
+#endif
+
+#ifdef TRACR_BUFFER_POOL
+    const BufferPoolStats pool = tracr_buffer_pool.stats();
+    _json_file["buffer_pool"] = {{"chunk", tracr_buffer_pool.chunk()},
+                                 {"buffers_created", pool.buffers_created},
+                                 {"buffers_reused", pool.buffers_reused},
+                                 {"buffers_pooled", pool.buffers_pooled}};
+#ifdef TRACR_POOL_CHUNK
+    _json_file["buffer_pool"]["chunks_created"] = pool.chunks_created;
+    _json_file["buffer_pool"]["chunks_reused"] = pool.chunks_reused;
+    _json_file["buffer_pool"]["chunks_pooled"] = pool.chunks_pooled;
+#endif
+#endif
+
+#ifdef TRACR_PER_CPU
+    size_t cpus = 0, records = 0, dropped = 0;
+    for (size_t cpu = 0; cpu < tracr_cpu_buffers.num_cpus(); ++cpu) {
+      if (tracr_cpu_buffers.records(cpu) != nullptr) {
+        ++cpus;
+        records += tracr_cpu_buffers.count(cpu);
+        dropped += tracr_cpu_buffers.dropped(cpu);
+      }
+    }
+    _json_file["cpu_buffers"] = {
+        {"mode", tracr_cpu_buffers.mode()},
+        {"cpus", cpus},
+        {"records", records},
+        {"dropped", dropped},
+        {"unregistered", tracr_cpu_buffers.unregistered()}};
+#endif
+
+#ifdef TRACR_NUMA_LOCAL
+    _json_file["numa"]["nodes"] = num_numa_nodes();
+    _json_file["numa"]["policy"] = numa_policy_name(requested_numa_policy());
+#endif
+
+#ifdef TRACR_POLICY_SEGMENTED
+    size_t written, removed, bytes_kept;
+    _segments.getStats(written, removed, bytes_kept);
+    _json_file["segments"] = {{"written", written},
+                              {"removed", removed},
+                              {"bytes_kept", bytes_kept},
+                              {"auto_flush_ms", _segments.getPeriodMs()}};
+#endif
+
+#ifdef TRACR_POLICY_STREAMING
+    _json_file["streaming"]["bytes_written"] = _writer.getBytesWritten();
+    _json_file["streaming"]["handoffs"] = _streamHandoffs.load();
+    _json_file["streaming"]["stalls"] = _streamStalls.load();
+#endif
+  }
+
+  /**
+   * Record a clock synchronization point (at start, on flushes and at the end).
+   * Thread safe.
+   */
+  inline ClockSyncPoint add_clock_sync() {
+    ClockSyncPoint point = NanoTimer::sync_point();
+
+    std::lock_guard<std::mutex> lock(_json_mutex);
+    _clockSyncs.push_back(point);
+    return point;
+  }
+
+  /**
+   * Store per-thread information under "threads" in the metadata.
+   * Thread safe, as TraCR threads report themselves on finalize.
+   */
+  inline void add_thread_info(long tid, const nlohmann::json &info) {
+    std::lock_guard<std::mutex> lock(_json_mutex);
+    _json_file["threads"][std::to_string(tid)].update(info);
+  }
+
+  /**
+   * Make a TraCR thread reachable for snapshots. Thread safe.
+   */
+  inline void register_thread(TraCRThread *thread) {
+    std::lock_guard<std::mutex> lock(_threads_mutex);
+    _threads.push_back(thread);
+  }
+
+  /**
+   * Remove a TraCR thread before it gets destroyed. Waits for a running
+   * snapshot. Thread safe.
+   */
+  inline void unregister_thread(TraCRThread *thread) {
+    std::lock_guard<std::mutex> lock(_threads_mutex);
+    _threads.erase(std::remove(_threads.begin(), _threads.end(), thread),
+                   _threads.end());
+  }
+
+#ifndef TRACR_DISABLE_FLUSH
+  /**
+   * Flush all registered TraCR threads except self, which are still running
+   */
+  inline void flush_live_threads(const TraCRThread *self) {
+    std::lock_guard<std::mutex> lock(_threads_mutex);
+
+    for (TraCRThread *thread : _threads) {
+      if (thread == self || !thread->claim_flush()) {
+        continue;
+      }
+
+      debug_print("Flushing the still running TraCR thread TID[%lu]",
+                  thread->getTID());
+
+#ifdef TRACR_HUGE_PAGES
+      add_page_info(thread);
+#endif
+
+      thread->flush_live(_proc_folder_name);
+
+      nlohmann::json info = {{"flushed_live", true}};
+      if (thread->wraps()) {
+        info["overwritten"] = thread->getOverwritten();
+      }
+#ifdef TRACR_POLICY_STREAMING
+      _streamHandoffs += thread->getStreamHandoffs();
+      _streamStalls += thread->getStreamStalls();
+      info["stream_handoffs"] = thread->getStreamHandoffs();
+      info["stream_stalls"] = thread->getStreamStalls();
+#endif
+      add_thread_info(thread->getTID(), info);
+    }
+  }
+
+#ifdef TRACR_PER_CPU
+  /**
+   * Write the records committed to each per-CPU buffer so far into
+   * cpu.<cpu>/traces.bts inside folder. The threads keep recording meanwhile,
+   * committed records are never changed.
+   */
+  inline void flush_cpu_buffers(const std::string &folder) {
+    for (size_t cpu = 0; cpu < tracr_cpu_buffers.num_cpus(); ++cpu) {
+      const CpuRecord *records = tracr_cpu_buffers.records(cpu);
+      const size_t count = tracr_cpu_buffers.count(cpu);
+      if (records == nullptr || count == 0) {
+        continue;
+      }
+
+      BtsHeader header{};
+      std::memcpy(header.magic, BTS_MAGIC, sizeof(header.magic));
+      header.version = BTS_VERSION;
+      header.header_size = sizeof(BtsHeader);
+      header.record_size = sizeof(CpuRecord);
+      header.payload_format = static_cast<uint8_t>(BtsPayloadFormat::PER_CPU);
+#ifdef TRACR_POLICY_IGNORE_IF_FULL
+      header.policy = static_cast<uint8_t>(BtsPolicy::IGNORE_IF_FULL);
+#else
+      header.policy = static_cast<uint8_t>(BtsPolicy::ABORT);
+#endif
+      header.timer_backend = static_cast<uint8_t>(NanoTimer::backend());
+#ifdef TRACR_RAW_TIMESTAMPS
+      header.flags |= BTS_FLAG_RAW_TIMESTAMPS;
+#endif
+#ifdef TRACR_COMPRESS
+      header.flags |= BTS_FLAG_COMPRESSED;
+#endif
+      header.capacity = RECORD_CAPACITY;
+#ifdef USE_HW_COUNTER
+      header.frequency = NanoTimer::frequency();
+#endif
+      // Shared by many threads
+      header.tid = -1;
+      header.cpu = static_cast<uint32_t>(cpu);
+
+      BtsTrailer trailer{};
+      trailer.num_records = count;
+      trailer.num_dropped = tracr_cpu_buffers.dropped(cpu);
+
+      FlushJob job;
+      job.folder = folder + "cpu." + std::to_string(cpu) + "/";
+      job.filepath = job.folder + "traces.bts";
+      job.head.assign(reinterpret_cast<const char *>(&header), sizeof(header));
+      job.first = records;
+      job.firstBytes = sizeof(CpuRecord) * count;
+
+      // The buffers are never freed, hence need no owner
+      job.prepare = [records, count, trailer](FlushJob &job) {
+        BtsStats stats;
+        for (size_t i = 0; i < count; ++i) {
+          // Skip the slots reserved by a running thread
+          if (records[i].tid != 0) {
+            stats.add(records[i].payload.eventId,
+                      records[i].payload.timestamp & ~COARSE_TIMESTAMP_FLAG);
+          }
+        }
+        job.tail = bts_trailer_bytes(stats, trailer);
+
+#ifdef TRACR_COMPRESS
+        auto blocks = std::make_shared<std::string>(
+            BlockCodec::compress(job.first, job.firstBytes, nullptr, 0,
+                                 sizeof(CpuRecord), false));
+        job.first = blocks->data();
+        job.firstBytes = blocks->size();
+        job.owner = std::move(blocks);
+#endif
+      };
+
+#ifdef TRACR_ASYNC_FLUSH
+      _flushEngine.submit(std::move(job));
+#else
+      FlushEngine::write(job);
+#endif
+    }
+  }
+#endif
+
+  /**
+   * Write the records of all live TraCR threads into the next snapshot.K
+   * folder of this proc, together with a copy of the metadata.
+   */
+  inline void snapshot() {
+    const size_t index = _numSnapshots++;
+    const std::string folder =
+        _proc_folder_name + "snapshot." + std::to_string(index) + "/";
+
+    if (mkdir(folder.c_str(), 0755) != 0 && errno != EEXIST) {
+      std::cerr << "mkdir failed for: " << folder << " errno=" << errno
+                << " (" << std::strerror(errno) << ")\n";
+      return; // Don't take down the application for a snapshot
+    }
+
+    const ClockSyncPoint point = add_clock_sync();
+
+    // Only copy the records under the lock, so registering and unregistering
+    // TraCR threads doesn't wait for the files to be written
+    std::vector<FlushJob> jobs;
+    {
+      std::lock_guard<std::mutex> lock(_threads_mutex);
+      jobs.reserve(_threads.size());
+      for (TraCRThread *thread : _threads) {
+        FlushJob job;
+        if (thread->copy_traces(folder, job)) {
+          jobs.push_back(std::move(job));
+        }
+      }
+    }
+
+    for (FlushJob &job : jobs) {
+#ifdef TRACR_ASYNC_FLUSH
+      _flushEngine.submit(std::move(job));
+#else
+      FlushEngine::write(job);
+#endif
+    }
+
+#ifdef TRACR_PER_CPU
+    flush_cpu_buffers(folder);
+#endif
+
+#ifdef TRACR_ASYNC_FLUSH
+    // The metadata marks the snapshot as complete
+    _flushEngine.drain();
+#endif
+
+    write_JSON();
+
+    nlohmann::json json;
+    {
+      std::lock_guard<std::mutex> lock(_json_mutex);
+      json = _json_file;
+    }
+    json["snapshot"] = {{"index", index},
+                        {"stamp", point.stamp},
+                        {"monotonic_raw", point.monotonic_raw},
+                        {"realtime", point.realtime}};
+
+    // Renamed once complete, a snapshot without metadata.json failed
+    const std::string filename = folder + "metadata.json";
+    const std::string tmpname = filename + ".tmp";
+    std::ofstream file(tmpname);
+
+    if (!file.is_open()) {
+      std::cerr << "Failed to open file: " << tmpname << " for writing!\n";
+      return;
+    }
+
+    file << json.dump(4);
+    file.close();
+
+    if (file.fail() || std::rename(tmpname.c_str(), filename.c_str()) != 0) {
+      std::cerr << "Failed to write file: " << filename << "\n";
+      std::remove(tmpname.c_str());
+      return;
+    }
+
+    debug_print("Snapshot %zu written into '%s'", index, folder.c_str());
+  }
+
+  /**
+   * Take a snapshot whenever signum arrives
+   */
+  inline void start_snapshot_signal(int signum) {
+    if (_snapshotTrigger) {
+      std::cerr << "The TraCR snapshot signal is already installed\n";
+      std::exit(EXIT_FAILURE);
+    }
+
+    _snapshotTrigger =
+        std::make_unique<SignalTrigger>(signum, [this] { snapshot(); });
+  }
+#endif
+
+  /**
+   * Start the ticker thread of the coarse clock
+   */
+  inline void start_coarse_clock(uint64_t period_us) {
+    if (_coarseClock) {
+      std::cerr << "The TraCR coarse clock is already running\n";
+      std::exit(EXIT_FAILURE);
+    }
+
+    _coarseClock = std::make_unique<CoarseClock>(period_us);
+  }
+
+#ifdef TRACR_POLICY_SEGMENTED
+  /**
+   *
+   */
+  inline SegmentManager *getSegmentManager() { return &_segments; }
+#endif
+
+#ifdef TRACR_SINGLE_FILE
+  /**
+   *
+   */
+  inline TraceContainer *getContainer() { return &_container; }
+#endif
+
+#ifdef TRACR_ASYNC_FLUSH
+  /**
+   *
+   */
+  inline FlushEngine *getFlushEngine() { return &_flushEngine; }
+
+  /**
+   * Wait until the flush engine wrote all trace files queued so far
+   */
+  inline void finish_flushes() {
+    _flushEngine.drain();
+
+    debug_print("Flushed %zu files (%zu bytes) in %f s via %s",
+                _flushEngine.getFiles(), _flushEngine.getBytes(),
+                _flushEngine.getBusySeconds(), _flushEngine.getBackend());
+  }
+#endif
+
+#ifdef TRACR_POLICY_STREAMING
+  /**
+   *
+   */
+  inline TraceWriter *getWriter() { return &_writer; }
+
+  /**
+   * Accumulate the streaming statistics of a finalized TraCR thread
+   */
+  inline void add_stream_stats(long tid, size_t handoffs, size_t stalls) {
+    _streamHandoffs += handoffs;
+    _streamStalls += stalls;
+    add_thread_info(tid, {{"stream_handoffs", handoffs},
+                          {"stream_stalls", stalls}});
+  }
+#endif
+
+#ifdef TRACR_HUGE_PAGES
+  /**
+   * Report the pages behind the buffer of a TraCR thread, before its flush
+   * hands the buffer over. Thread safe.
+   */
+  inline void add_page_info(TraCRThread *thread) {
+    const PageBacking backing = thread->_traces.backing();
+    const size_t hugeBytes = thread->_traces.huge_page_bytes();
+
+    ++_pageBackings[static_cast<size_t>(backing)];
+    _hugePageBytes += hugeBytes;
+    add_thread_info(thread->getTID(),
+                    {{"page_backing", page_backing_name(backing)},
+                     {"huge_page_bytes", hugeBytes}});
+  }
+#endif
+
+#ifdef TRACR_NUMA_LOCAL
+  /**
+   * Report the NUMA node the buffer of a new TraCR thread is tied to. Thread
+   * safe.
+   */
+  inline void add_numa_info(TraCRThread *thread) {
+    add_thread_info(
+        thread->getTID(),
+        {{"numa_node", thread->_traces.numa_node()},
+         {"numa_policy", numa_policy_name(thread->_traces.numa_policy())}});
   }
+#endif
 
   /**
    *
@@ -432,17 +2377,84 @@ private:
   // The name of the proc folder
   std::string _proc_folder_name;
 
-  //
-  bool json_is_ready = false;
-
-  // TraCR start time
+  // TraCR start time (in the unit of NanoTimer::stamp())
   uint64_t _tracr_init_time;
 
+#ifdef USE_HW_COUNTER
+  // Counter ticks and CLOCK_MONOTONIC_RAW taken back to back at start
+  uint64_t _refTicks;
+  uint64_t _refNs;
+#endif
+
   // kernel thread ID
   long _tid;
 
   // logical CPU ID
   int _lCPUid;
+
+  // Protects _json_file and _clockSyncs against concurrently finalizing
+  // TraCR threads
+  std::mutex _json_mutex;
+
+  // Serializes the writers of metadata.json
+  std::mutex _dump_mutex;
+
+  // Clock synchronization points in the order they were taken
+  std::vector<ClockSyncPoint> _clockSyncs;
+
+  // Cost and resolution of the available timer backends, measured at start
+  std::vector<TimerProbe> _timerProbes;
+
+  // The coarse clock, if started
+  std::unique_ptr<CoarseClock> _coarseClock;
+
+#if defined(TRACR_CAPTURE_CPU) || defined(TRACR_PER_CPU)
+  // The physical package of each configured CPU (-1 if unknown)
+  std::vector<int> _cpuSockets;
+#endif
+
+#ifdef TRACR_POLICY_STREAMING
+  // Total number of halves streamed and stalls of all TraCR threads
+  std::atomic<size_t> _streamHandoffs{0};
+  std::atomic<size_t> _streamStalls{0};
+
+  // The writer thread of this proc
+  TraceWriter _writer;
+#endif
+
+#ifdef TRACR_POLICY_SEGMENTED
+  // Rotation and auto-flush of the segments of all TraCR threads (outlives
+  // the flush engine, which registers the segments it wrote)
+  SegmentManager _segments;
+#endif
+
+#ifdef TRACR_ASYNC_FLUSH
+  // The I/O threads writing the trace files of this proc
+  FlushEngine _flushEngine;
+#endif
+
+#ifdef TRACR_SINGLE_FILE
+  // The single file holding the trace files and metadata of this proc
+  TraceContainer _container;
+#endif
+
+#ifdef TRACR_HUGE_PAGES
+  // Number of reported buffers per PageBacking and their huge page bytes
+  std::atomic<size_t> _pageBackings[3] = {};
+  std::atomic<size_t> _hugePageBytes{0};
+#endif
+
+  // Protects _threads
+  std::mutex _threads_mutex;
+
+  // The live TraCR threads of this proc
+  std::vector<TraCRThread *> _threads;
+
+  // Number of snapshots taken
+  std::atomic<size_t> _numSnapshots{0};
+
+  // Runs snapshot() on a helper thread on each signal (destroyed first)
+  std::unique_ptr<SignalTrigger> _snapshotTrigger;
 };
 
 } // namespace TraCR
\ No newline at end of file
@@ -0,0 +1,678 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file nano_timer.hpp
+ * @brief The TraCR timer and the calibration of its hardware counter
+ * @author Noah Andrés Baumann
+ * @date 16/10/2026
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <cpuid.h> // __get_cpuid_max(), __cpuid()
+#endif
+
+#ifdef TRACR_CAPTURE_CPU
+#include <sched.h> // sched_getcpu()
+#if __has_include(<sys/rseq.h>)
+#include <sys/rseq.h> // __rseq_offset, __rseq_size (glibc >= 2.35)
+#ifdef RSEQ_SIG
+#define TRACR_HAS_RSEQ
+#endif
+#endif
+#endif
+
+namespace TraCR {
+
+/**
+ * The result of calibrating the hardware counter
+ */
+struct TimerCalibration {
+  // Counter frequency (ticks per second)
+  uint64_t frequency;
+
+  // Where the frequency came from (stored in the metadata)
+  const char *source;
+
+  // Estimated error of the frequency in parts per million
+  double error_ppm;
+};
+
+/**
+ * A point in time read from the TraCR timer and the system clocks. The
+ * post-processing maps the timestamps onto CLOCK_MONOTONIC_RAW by fitting a
+ * piecewise-linear function through these points, correcting the drift of an
+ * inaccurately calibrated counter.
+ */
+struct ClockSyncPoint {
+  // NanoTimer::stamp(), i.e. the unit of the payload timestamps
+  uint64_t stamp;
+
+  // CLOCK_MONOTONIC_RAW in nanoseconds
+  uint64_t monotonic_raw;
+
+  // CLOCK_REALTIME in nanoseconds since the epoch
+  uint64_t realtime;
+};
+
+/**
+ * The timer backends TraCR can take its timestamps from. The counter backends
+ * need USE_HW_COUNTER.
+ */
+enum class TimerBackend : uint8_t {
+  // rdtsc (x86) or cntvct_el0 (AArch64), not serialized (fastest)
+  COUNTER,
+
+  // lfence;rdtsc (x86) or isb;cntvct_el0 (AArch64), waits for all prior
+  // instructions to complete (precise short regions)
+  COUNTER_SERIALIZED,
+
+  // rdtscp (x86 only), waits for all prior instructions to complete
+  RDTSCP,
+
+  // clock_gettime(CLOCK_MONOTONIC) through the vDSO (portable)
+  CLOCK_MONOTONIC_VDSO,
+
+  // clock_gettime(CLOCK_MONOTONIC_RAW)
+  CLOCK_MONOTONIC_RAW_VDSO
+};
+
+/**
+ * The measured cost and resolution of one timer backend
+ */
+struct TimerProbe {
+  TimerBackend backend;
+
+  // Average cost of one timestamp in nanoseconds
+  double cost_ns;
+
+  // Smallest non-zero difference of two consecutive timestamps in nanoseconds
+  double resolution_ns;
+};
+
+/**
+ * Our nanosecond timer
+ *
+ * This timer can also be changed by the chrono (or PyPTO get_cycle()) method
+ */
+class NanoTimer {
+public:
+  // The backend used if none is selected
+#ifdef USE_HW_COUNTER
+  static constexpr TimerBackend DEFAULT_BACKEND = TimerBackend::COUNTER;
+#else
+  static constexpr TimerBackend DEFAULT_BACKEND =
+      TimerBackend::CLOCK_MONOTONIC_RAW_VDSO;
+#endif
+
+  // Always returns nanoseconds. The default backend is checked first, so
+  // only a well predicted compare is added on the hot path (no indirect call).
+  static inline uint64_t now() {
+    const TimerBackend backend = _backend;
+    if (__builtin_expect(backend == DEFAULT_BACKEND, 1)) {
+      return to_ns(DEFAULT_BACKEND, read_as<DEFAULT_BACKEND>());
+    }
+    return to_ns(backend, read(backend));
+  }
+
+  // The timestamp stored in the payloads. With TRACR_RAW_TIMESTAMPS these are
+  // the raw values of the backend (counter ticks), converted to nanoseconds
+  // offline by tracr_process.
+  static inline uint64_t stamp() {
+#ifdef TRACR_RAW_TIMESTAMPS
+    const TimerBackend backend = _backend;
+    if (__builtin_expect(backend == DEFAULT_BACKEND, 1)) {
+      return read_as<DEFAULT_BACKEND>();
+    }
+    return read(backend);
+#else
+    return now();
+#endif
+  }
+
+  // The unit of stamp(), stored in the metadata
+  static inline const char *stamp_unit() {
+#ifdef TRACR_RAW_TIMESTAMPS
+    return is_counter(_backend) ? "ticks" : "ns";
+#else
+    return "ns";
+#endif
+  }
+
+  // CLOCK_MONOTONIC_RAW in nanoseconds
+  static inline uint64_t clock_ns(clockid_t clock = CLOCK_MONOTONIC_RAW) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000ULL +
+           static_cast<uint64_t>(ts.tv_nsec);
+  }
+
+  // Reads stamp() bracketed by two CLOCK_MONOTONIC_RAW reads (whose midpoint
+  // is taken) followed by CLOCK_REALTIME
+  static inline ClockSyncPoint sync_point() {
+    uint64_t n0 = clock_ns();
+    uint64_t s = stamp();
+    uint64_t n1 = clock_ns();
+
+    return {s, n0 + (n1 - n0) / 2, clock_ns(CLOCK_REALTIME)};
+  }
+
+#ifdef TRACR_CAPTURE_CPU
+  // The CPU this thread runs on. Read from the rseq area the kernel keeps up
+  // to date (registered by glibc) if available, else sched_getcpu().
+  static inline uint32_t current_cpu() {
+#ifdef TRACR_HAS_RSEQ
+    if (__builtin_expect(__rseq_size > 0, 1)) {
+      const volatile struct rseq *area =
+          reinterpret_cast<const volatile struct rseq *>(
+              static_cast<char *>(__builtin_thread_pointer()) + __rseq_offset);
+      return area->cpu_id;
+    }
+#endif
+    return static_cast<uint32_t>(sched_getcpu());
+  }
+
+  // stamp() together with the CPU it was taken on. With the counter backends
+  // on x86 both come from a single rdtscp (TSC_AUX holds node << 12 | cpu).
+  static inline uint64_t stamp_cpu(uint32_t &cpu) {
+#if defined(__x86_64__) && defined(USE_HW_COUNTER)
+    const TimerBackend backend = _backend;
+    if (__builtin_expect(backend == TimerBackend::COUNTER ||
+                             backend == TimerBackend::RDTSCP,
+                         1)) {
+      unsigned hi, lo, aux;
+      asm volatile("rdtscp" : "=a"(lo), "=d"(hi), "=c"(aux));
+      cpu = aux & 0xfff;
+
+      uint64_t ticks = ((uint64_t)hi << 32) | lo;
+#ifdef TRACR_RAW_TIMESTAMPS
+      return ticks;
+#else
+      return ticks_to_ns(ticks);
+#endif
+    }
+#endif
+    cpu = current_cpu();
+    return stamp();
+  }
+#endif
+
+  /**
+   * Backend selection
+   *
+   * NOTE: Not thread safe, select the backend before instrumentation_start()
+   */
+  static inline void select(TimerBackend backend) { _backend = backend; }
+
+  static inline TimerBackend backend() { return _backend; }
+
+  static inline bool is_counter(TimerBackend backend) {
+    return backend == TimerBackend::COUNTER ||
+           backend == TimerBackend::COUNTER_SERIALIZED ||
+           backend == TimerBackend::RDTSCP;
+  }
+
+  static inline const char *name(TimerBackend backend) {
+    switch (backend) {
+    case TimerBackend::COUNTER:
+      return "counter";
+    case TimerBackend::COUNTER_SERIALIZED:
+      return "counter_serialized";
+    case TimerBackend::RDTSCP:
+      return "rdtscp";
+    case TimerBackend::CLOCK_MONOTONIC_VDSO:
+      return "clock_monotonic";
+    case TimerBackend::CLOCK_MONOTONIC_RAW_VDSO:
+      return "clock_monotonic_raw";
+    }
+    return "unknown";
+  }
+
+  // Parses the name of a backend, false if there is no such backend
+  static inline bool parse(const std::string &str, TimerBackend &backend) {
+    for (TimerBackend candidate : ALL_BACKENDS) {
+      if (str == name(candidate)) {
+        backend = candidate;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Whether this build and CPU support the backend
+  static inline bool available(TimerBackend backend) {
+    switch (backend) {
+    case TimerBackend::COUNTER:
+    case TimerBackend::COUNTER_SERIALIZED:
+#ifdef USE_HW_COUNTER
+      return true;
+#else
+      return false;
+#endif
+    case TimerBackend::RDTSCP:
+#if defined(__x86_64__) && defined(USE_HW_COUNTER)
+    {
+      unsigned eax, ebx, ecx, edx;
+      return __get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) &&
+             (edx & (1u << 27));
+    }
+#else
+      return false;
+#endif
+    case TimerBackend::CLOCK_MONOTONIC_VDSO:
+    case TimerBackend::CLOCK_MONOTONIC_RAW_VDSO:
+      return true;
+    }
+    return false;
+  }
+
+  // Measures the per-call cost and the minimum resolvable interval of each
+  // available backend
+  static inline std::vector<TimerProbe> probe() {
+    constexpr int N = 2000;
+    std::vector<TimerProbe> probes;
+
+    for (TimerBackend backend : ALL_BACKENDS) {
+      if (!available(backend)) {
+        continue;
+      }
+
+      uint64_t prev = read(backend);
+      uint64_t min_delta = UINT64_MAX;
+
+      uint64_t start = clock_ns();
+      for (int i = 0; i < N; ++i) {
+        uint64_t value = read(backend);
+        if (value > prev) {
+          min_delta = std::min(min_delta, value - prev);
+        }
+        prev = value;
+      }
+      uint64_t elapsed = clock_ns() - start;
+
+      double resolution_ns =
+          (min_delta == UINT64_MAX)
+              ? 0.0
+              : static_cast<double>(to_ns(backend, min_delta));
+
+      probes.push_back(
+          {backend, static_cast<double>(elapsed) / N, resolution_ns});
+    }
+
+    return probes;
+  }
+
+#ifdef USE_HW_COUNTER
+
+  // Raw hardware counter ticks
+  static inline uint64_t raw() {
+#if defined(__aarch64__)
+    uint64_t val;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(val));
+    return val;
+#elif defined(__x86_64__)
+    unsigned hi, lo;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+#else
+#error "Unsupported architecture for HW counter"
+#endif
+  }
+
+  // Counter frequency (ticks per second)
+  static inline uint64_t frequency() { return calibration().frequency; }
+
+  // Calibrates the counter once (thread safe). instrumentation_start() calls
+  // it eagerly, so the first traced event doesn't pay for it.
+  static inline const TimerCalibration &calibration() {
+    static const TimerCalibration result = calibrate();
+    return result;
+  }
+
+#endif
+
+private:
+  static constexpr TimerBackend ALL_BACKENDS[] = {
+      TimerBackend::COUNTER, TimerBackend::COUNTER_SERIALIZED,
+      TimerBackend::RDTSCP, TimerBackend::CLOCK_MONOTONIC_VDSO,
+      TimerBackend::CLOCK_MONOTONIC_RAW_VDSO};
+
+  // The selected backend
+  static inline TimerBackend _backend = DEFAULT_BACKEND;
+
+  // Reads the given backend, resolved at compile time
+  template <TimerBackend B> static inline uint64_t read_as() {
+#ifdef USE_HW_COUNTER
+    if constexpr (B == TimerBackend::COUNTER) {
+      return raw();
+    }
+    if constexpr (B == TimerBackend::COUNTER_SERIALIZED) {
+#if defined(__aarch64__)
+      asm volatile("isb" ::: "memory");
+#elif defined(__x86_64__)
+      asm volatile("lfence" ::: "memory");
+#endif
+      return raw();
+    }
+#if defined(__x86_64__)
+    if constexpr (B == TimerBackend::RDTSCP) {
+      unsigned hi, lo, aux;
+      asm volatile("rdtscp" : "=a"(lo), "=d"(hi), "=c"(aux));
+      return ((uint64_t)hi << 32) | lo;
+    }
+#endif
+#endif
+    if constexpr (B == TimerBackend::CLOCK_MONOTONIC_VDSO) {
+      return clock_ns(CLOCK_MONOTONIC);
+    }
+    return clock_ns();
+  }
+
+  // Reads the given backend, resolved at runtime (off the default path)
+  static inline uint64_t read(TimerBackend backend) {
+    switch (backend) {
+    case TimerBackend::COUNTER:
+      return read_as<TimerBackend::COUNTER>();
+    case TimerBackend::COUNTER_SERIALIZED:
+      return read_as<TimerBackend::COUNTER_SERIALIZED>();
+    case TimerBackend::RDTSCP:
+      return read_as<TimerBackend::RDTSCP>();
+    case TimerBackend::CLOCK_MONOTONIC_VDSO:
+      return read_as<TimerBackend::CLOCK_MONOTONIC_VDSO>();
+    case TimerBackend::CLOCK_MONOTONIC_RAW_VDSO:
+      break;
+    }
+    return read_as<TimerBackend::CLOCK_MONOTONIC_RAW_VDSO>();
+  }
+
+  // Converts a value of the given backend into nanoseconds
+  static inline uint64_t to_ns(TimerBackend backend, uint64_t value) {
+#ifdef USE_HW_COUNTER
+    if (is_counter(backend)) {
+      return ticks_to_ns(value);
+    }
+#else
+    (void)backend;
+#endif
+    return value;
+  }
+
+#ifdef USE_HW_COUNTER
+  // 128-bit intermediate, as ticks * 10^9 overflows 64 bits after a few
+  // seconds of uptime at GHz counter rates
+  static inline uint64_t ticks_to_ns(uint64_t ticks) {
+    static const uint64_t freq = frequency();
+    return static_cast<uint64_t>(
+        (static_cast<unsigned __int128>(ticks) * 1'000'000'000ULL) / freq);
+  }
+
+  // Picks the most accurate frequency source available
+  static inline TimerCalibration calibrate() {
+#if defined(__aarch64__)
+    // The architected counter reports its exact frequency
+    uint64_t freq;
+    asm volatile("mrs %0, cntfrq_el0" : "=r"(freq));
+    return {freq, "cntfrq_el0", 0.0};
+#elif defined(__x86_64__)
+    TimerCalibration result;
+
+    if (cpuid_frequency(result)) {
+      return result;
+    }
+
+    // Only on patched kernels
+    if (sysfs_frequency(result)) {
+      return result;
+    }
+
+    return refine_frequency();
+#endif
+  }
+#endif
+
+#if defined(__x86_64__) && defined(USE_HW_COUNTER)
+  // CPUID leaf 0x15 reports the TSC/crystal ratio and (mostly) the crystal
+  // frequency. If the crystal is missing, it is derived from the base
+  // frequency of leaf 0x16 as described in the Intel SDM.
+  static inline bool cpuid_frequency(TimerCalibration &result) {
+    unsigned eax, ebx, ecx, edx;
+
+    if (__get_cpuid_max(0, nullptr) < 0x15) {
+      return false;
+    }
+
+    __cpuid(0x15, eax, ebx, ecx, edx);
+    const uint64_t denominator = eax, numerator = ebx;
+    uint64_t crystal_hz = ecx;
+
+    if (denominator == 0 || numerator == 0) {
+      return false;
+    }
+
+    // Nominal crystal, typical tolerance of a quartz oscillator
+    double error_ppm = 50.0;
+
+    if (crystal_hz == 0) {
+      if (__get_cpuid_max(0, nullptr) < 0x16) {
+        return false;
+      }
+
+      __cpuid(0x16, eax, ebx, ecx, edx);
+      const uint64_t base_mhz = eax & 0xffff;
+      if (base_mhz == 0) {
+        return false;
+      }
+
+      crystal_hz = base_mhz * 1'000'000ULL * denominator / numerator;
+
+      // The base frequency is rounded to MHz
+      error_ppm = 1e6 / static_cast<double>(base_mhz);
+    }
+
+    result = {crystal_hz * numerator / denominator, "cpuid", error_ppm};
+    return true;
+  }
+
+  // tsc_freq_khz is not a mainline kernel interface, it only exists on
+  // kernels with an out-of-tree patch exporting their TSC calibration.
+  // Elsewhere refine_frequency() measures the frequency instead.
+  static inline bool sysfs_frequency(TimerCalibration &result) {
+    std::ifstream ifs("/sys/devices/system/cpu/cpu0/tsc_freq_khz");
+    uint64_t khz = 0;
+
+    if (!ifs || !(ifs >> khz) || khz == 0) {
+      return false;
+    }
+
+    // The frequency is rounded to kHz
+    result = {khz * 1'000ULL, "sysfs", 1e6 / static_cast<double>(khz)};
+    return true;
+  }
+
+  // Short busy-wait calibration against CLOCK_MONOTONIC_RAW. Each round
+  // brackets the counter reads by two clock reads and measures over ~1ms. The
+  // median of the rounds is returned, the error combines the spread of the
+  // rounds with the clock read uncertainty.
+  static inline TimerCalibration refine_frequency() {
+    constexpr int ROUNDS = 5;
+    constexpr uint64_t WINDOW_NS = 1'000'000;
+
+    uint64_t freqs[ROUNDS];
+    uint64_t max_uncertainty_ns = 0;
+
+    for (int r = 0; r < ROUNDS; ++r) {
+      uint64_t n0a = clock_ns();
+      uint64_t t0 = raw();
+      uint64_t n0b = clock_ns();
+
+      uint64_t n1a, t1, n1b;
+      do {
+        n1a = clock_ns();
+        t1 = raw();
+        n1b = clock_ns();
+      } while (n1a - n0b < WINDOW_NS);
+
+      uint64_t dn = (n1a + n1b) / 2 - (n0a + n0b) / 2;
+      freqs[r] = static_cast<uint64_t>(
+          static_cast<unsigned __int128>(t1 - t0) * 1'000'000'000ULL / dn);
+
+      max_uncertainty_ns =
+          std::max(max_uncertainty_ns, ((n0b - n0a) + (n1b - n1a)) / 2);
+    }
+
+    std::sort(freqs, freqs + ROUNDS);
+    const uint64_t median = freqs[ROUNDS / 2];
+
+    double spread_ppm =
+        1e6 * static_cast<double>(freqs[ROUNDS - 1] - freqs[0]) / 2.0 /
+        static_cast<double>(median);
+    double read_ppm = 1e6 * static_cast<double>(max_uncertainty_ns) /
+                      static_cast<double>(WINDOW_NS);
+
+    return {median, "refinement", std::max(spread_ppm, read_ppm)};
+  }
+#endif
+};
+
+/**
+ * Payload timestamps taken from the coarse clock have this bit set, so the
+ * post-processing knows their precision. Real timestamps never reach it.
+ */
+constexpr uint64_t COARSE_TIMESTAMP_FLAG = 1ULL << 63;
+
+/**
+ * The timestamp published by the coarse clock, alone in its cache line so the
+ * ticker doesn't invalidate anything else the TraCR threads read
+ */
+struct alignas(64) CoarseStamp {
+  std::atomic<uint64_t> value{0};
+};
+
+/**
+ * Coarse clock for ultra-high-frequency markers.
+ *
+ * A TraCR ticker thread publishes NanoTimer::stamp() every period into its own
+ * cache line. Reading the coarse clock is a single relaxed load instead of a
+ * counter read, at the price of a precision of one period.
+ */
+class CoarseClock {
+public:
+  /**
+   * Constructor, publishes a first timestamp and starts the ticker thread
+   */
+  CoarseClock(uint64_t period_us) : _period_us(period_us) {
+    _stamp.value.store(NanoTimer::stamp(), std::memory_order_relaxed);
+    _startNs = NanoTimer::clock_ns();
+    _thread = std::thread([this] { run(); });
+  }
+
+  /**
+   * No default constructor allowed.
+   */
+  CoarseClock() = delete;
+
+  /**
+   * The ticker thread is owned exclusively, hence no copies.
+   */
+  CoarseClock(const CoarseClock &) = delete;
+  CoarseClock &operator=(const CoarseClock &) = delete;
+
+  /**
+   * Destructor, stops the ticker thread
+   */
+  ~CoarseClock() {
+    _stop.store(true, std::memory_order_relaxed);
+    _thread.join();
+  }
+
+  /**
+   * The last published timestamp
+   */
+  static inline uint64_t now() {
+    return _stamp.value.load(std::memory_order_relaxed);
+  }
+
+  /**
+   *
+   */
+  inline uint64_t getPeriodUs() const { return _period_us; }
+
+  /**
+   * Number of timestamps published so far
+   */
+  inline uint64_t getTicks() const {
+    return _ticks.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * The measured mean period in nanoseconds (sleeps tend to overshoot)
+   */
+  inline double getMeanPeriodNs() const {
+    uint64_t ticks = getTicks();
+    if (ticks == 0) {
+      return 0.0;
+    }
+    return static_cast<double>(NanoTimer::clock_ns() - _startNs) /
+           static_cast<double>(ticks);
+  }
+
+private:
+  /**
+   * The loop of the ticker thread
+   */
+  inline void run() {
+    struct timespec period = {
+        static_cast<time_t>(_period_us / 1'000'000),
+        static_cast<long>((_period_us % 1'000'000) * 1'000)};
+
+    while (!_stop.load(std::memory_order_relaxed)) {
+      clock_nanosleep(CLOCK_MONOTONIC, 0, &period, nullptr);
+      _stamp.value.store(NanoTimer::stamp(), std::memory_order_relaxed);
+      _ticks.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  // The published timestamp
+  static inline CoarseStamp _stamp;
+
+  // Publishing period
+  uint64_t _period_us;
+
+  // When the ticker was started (CLOCK_MONOTONIC_RAW)
+  uint64_t _startNs;
+
+  // Number of published timestamps
+  std::atomic<uint64_t> _ticks{0};
+
+  // Set on destruction
+  std::atomic<bool> _stop{false};
+
+  // The ticker thread
+  std::thread _thread;
+};
+
+} // namespace TraCR
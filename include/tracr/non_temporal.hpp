@@ -0,0 +1,101 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file non_temporal.hpp
+ * @brief Cache line stores that bypass the caches (TRACR_NT_STORES)
+ * @author Noah Andrés Baumann
+ * @date 16/10/2026
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h> // _mm256_stream_si256(), _mm_stream_si128()
+#endif
+
+namespace TraCR {
+
+/**
+ * The unit of the non-temporal stores
+ */
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+/**
+ * The instructions nt_store_line() is compiled to
+ */
+inline const char *nt_store_isa() {
+#if defined(__x86_64__) && defined(__AVX__)
+  return "avx";
+#elif defined(__x86_64__)
+  return "sse2";
+#elif defined(__aarch64__)
+  return "stnp";
+#else
+  return "plain";
+#endif
+}
+
+/**
+ * Write the cache line at src to dst without pulling dst into the caches. Both
+ * have to be CACHE_LINE_SIZE aligned. The stores are weakly ordered, so other
+ * threads may only read dst after nt_store_fence().
+ */
+inline void nt_store_line(void *dst, const void *src) {
+#if defined(__x86_64__) && defined(__AVX__)
+  // vmovntdq, the line leaves through one write-combining buffer
+  const __m256i *from = static_cast<const __m256i *>(src);
+  __m256i *to = static_cast<__m256i *>(dst);
+  _mm256_stream_si256(to, _mm256_load_si256(from));
+  _mm256_stream_si256(to + 1, _mm256_load_si256(from + 1));
+#elif defined(__x86_64__)
+  // movntdq
+  const __m128i *from = static_cast<const __m128i *>(src);
+  __m128i *to = static_cast<__m128i *>(dst);
+  for (int i = 0; i < 4; ++i) {
+    _mm_stream_si128(to + i, _mm_load_si128(from + i));
+  }
+#elif defined(__aarch64__)
+  // A hint only, the core may still allocate the line
+  const unsigned long *from = static_cast<const unsigned long *>(src);
+  for (int i = 0; i < 8; i += 2) {
+    asm volatile("stnp %0, %1, [%2]"
+                 :
+                 : "r"(from[i]), "r"(from[i + 1]),
+                   "r"(static_cast<char *>(dst) + 8 * i)
+                 : "memory");
+  }
+#else
+  // Plain stores elsewhere
+  std::memcpy(dst, src, CACHE_LINE_SIZE);
+#endif
+}
+
+/**
+ * Order all earlier non-temporal stores before any later store
+ */
+inline void nt_store_fence() {
+#if defined(__x86_64__)
+  _mm_sfence();
+#else
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+} // namespace TraCR
@@ -0,0 +1,157 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file numa_placement.hpp
+ * @brief Places memory on the NUMA node of the calling thread
+ * @author Noah Andrés Baumann
+ * @date 16/10/2026
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <linux/mempolicy.h> // MPOL_PREFERRED, MPOL_BIND
+#include <string>
+#include <sys/syscall.h> // SYS_getcpu, SYS_mbind
+#include <unistd.h>      // syscall()
+
+namespace TraCR {
+
+/**
+ * The largest NUMA node ID a range can be placed on
+ */
+constexpr int MAX_NUMA_NODES = 1024;
+
+/**
+ * How a range is tied to its node
+ */
+enum class NumaPolicy : uint8_t {
+  // No policy of its own, the pages end up wherever the task policy (e.g. of
+  // numactl) or the first touch puts them
+  NONE = 0,
+
+  // Pages come from the node while it has free memory, else from any other
+  PREFERRED = 1,
+
+  // Pages only come from the node
+  BIND = 2
+};
+
+/**
+ *
+ */
+inline const char *numa_policy_name(NumaPolicy policy) {
+  switch (policy) {
+  case NumaPolicy::BIND:
+    return "bind";
+  case NumaPolicy::PREFERRED:
+    return "preferred";
+  default:
+    return "none";
+  }
+}
+
+/**
+ * The policy for new ranges. By default preferred, chosen with the
+ * environment variable TRACR_NUMA_POLICY=preferred|bind|none.
+ */
+inline NumaPolicy requested_numa_policy() {
+  const char *env = std::getenv("TRACR_NUMA_POLICY");
+  if (env == nullptr || std::strcmp(env, "preferred") == 0) {
+    return NumaPolicy::PREFERRED;
+  }
+  if (std::strcmp(env, "bind") == 0) {
+    return NumaPolicy::BIND;
+  }
+  if (std::strcmp(env, "none") == 0) {
+    return NumaPolicy::NONE;
+  }
+
+  std::cerr << "Unknown TRACR_NUMA_POLICY: " << env
+            << " (expected preferred, bind or none)\n";
+  std::exit(EXIT_FAILURE);
+}
+
+/**
+ * The NUMA node of the CPU the calling thread runs on, -1 if unknown
+ */
+inline int current_numa_node() {
+  unsigned cpu = 0, node = 0;
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+    return -1;
+  }
+  return static_cast<int>(node);
+}
+
+/**
+ * The number of online NUMA nodes (1 without NUMA support)
+ */
+inline int num_numa_nodes() {
+  static const int count = [] {
+    // A list of ranges such as "0-1,4"
+    std::ifstream file("/sys/devices/system/node/online");
+    std::string list;
+    if (!std::getline(file, list) || list.empty()) {
+      return 1;
+    }
+
+    int nodes = 0;
+    size_t pos = 0;
+    while (pos < list.size()) {
+      size_t end = list.find(',', pos);
+      end = (end == std::string::npos) ? list.size() : end;
+      const std::string range = list.substr(pos, end - pos);
+
+      const int first = std::atoi(range.c_str());
+      const size_t dash = range.find('-');
+      const int last =
+          (dash == std::string::npos) ? first : std::atoi(&range[dash + 1]);
+      nodes += last - first + 1;
+      pos = end + 1;
+    }
+    return nodes;
+  }();
+  return count;
+}
+
+/**
+ * Tie the page aligned range [addr, addr + bytes) to node before it is touched.
+ * Returns false if the policy is NONE or the kernel refused it (no NUMA
+ * support, seccomp), then the range keeps the task policy.
+ */
+inline bool bind_to_numa_node(void *addr, size_t bytes, int node,
+                              NumaPolicy policy) {
+  if (policy == NumaPolicy::NONE || node < 0 || node >= MAX_NUMA_NODES) {
+    return false;
+  }
+
+  constexpr int BITS = 8 * sizeof(unsigned long);
+  unsigned long mask[MAX_NUMA_NODES / BITS] = {};
+  mask[node / BITS] = 1UL << (node % BITS);
+
+  const int mode = (policy == NumaPolicy::BIND) ? MPOL_BIND : MPOL_PREFERRED;
+
+  // The kernel reads one bit less than maxnode
+  return syscall(SYS_mbind, addr, bytes, mode, mask, MAX_NUMA_NODES + 1, 0) ==
+         0;
+}
+
+} // namespace TraCR
@@ -0,0 +1,320 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file segment_manager.hpp
+ * @brief Rotation and periodic auto-flush of segmented trace files
+ * @author Noah Andrés Baumann
+ * @date 16/10/2026
+ */
+
+#pragma once
+
+#include <algorithm> // std::min(), std::upper_bound()
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio> // std::remove()
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace TraCR {
+
+/**
+ * Keeps track of the segments written by the TraCR threads of a proc. Once
+ * more than the allowed number of segments or bytes are on disk, the oldest
+ * segments are removed, regardless of the thread that wrote them.
+ *
+ * With auto-flush, a ticker thread advances a global epoch periodically. Each
+ * TraCR thread compares it on every event and starts a new segment once it
+ * changed, so the ticker never touches a buffer itself.
+ *
+ * The same thread runs the on_segment() callback, at most once every
+ * REFRESH_MS, so a rollover never waits for the metadata to be rewritten.
+ */
+class SegmentManager {
+public:
+  /**
+   * Default constructor, no rotation and no auto-flush
+   */
+  SegmentManager() = default;
+
+  /**
+   * The ticker thread is owned exclusively, hence no copies.
+   */
+  SegmentManager(const SegmentManager &) = delete;
+  SegmentManager &operator=(const SegmentManager &) = delete;
+
+  /**
+   * Destructor, stops the ticker thread
+   */
+  ~SegmentManager() { stop(); }
+
+  /**
+   * Stop the ticker thread, waiting for a running callback. A refresh still
+   * pending is dropped.
+   */
+  inline void stop() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _tickerCv.notify_one();
+
+    if (_ticker.joinable()) {
+      _ticker.join();
+    }
+  }
+
+  /**
+   * Keep at most maxSegments segments and maxBytes bytes on disk (0 means no
+   * bound). The latest segment is always kept.
+   */
+  inline void set_rotation(size_t maxSegments, size_t maxBytes) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _maxSegments = maxSegments;
+    _maxBytes = maxBytes;
+    rotate();
+  }
+
+  /**
+   * Call callback on the ticker thread after new segments, e.g. to refresh
+   * the metadata on disk. Starts the ticker thread.
+   */
+  inline void on_segment(std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _onSegment = std::move(callback);
+    start();
+  }
+
+  /**
+   * The position of a segment about to be written. Segments written in
+   * parallel are registered in any order, but rotated in this one. Thread
+   * safe.
+   */
+  inline size_t reserve() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _reserved++;
+  }
+
+  /**
+   * Register a segment written at filepath, taking bytes on disk. Thread
+   * safe.
+   */
+  inline void add(const std::string &filepath, size_t bytes) {
+    add(reserve(), filepath, bytes);
+  }
+
+  /**
+   * Register a segment written at filepath at the position got from
+   * reserve(). Thread safe.
+   */
+  inline void add(size_t order, const std::string &filepath, size_t bytes) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      auto pos = std::upper_bound(
+          _segments.begin(), _segments.end(), order,
+          [](size_t order, const Segment &segment) {
+            return order < segment.order;
+          });
+      _segments.insert(pos, {order, filepath, bytes});
+      _bytes += bytes;
+      ++_written;
+      rotate();
+
+      if (!_onSegment) {
+        return;
+      }
+      _refreshPending = true;
+    }
+
+    _tickerCv.notify_one();
+  }
+
+  /**
+   * Advance the epoch every period_ms on the ticker thread
+   */
+  inline void start_auto_flush(uint64_t period_ms) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (_periodMs > 0) {
+        std::cerr << "The TraCR auto-flush is already running\n";
+        std::exit(EXIT_FAILURE);
+      }
+
+      _periodMs = period_ms;
+      start();
+    }
+
+    _tickerCv.notify_one();
+  }
+
+  /**
+   * The current epoch of the auto-flush. Global, so a TraCR thread that still
+   * runs after instrumentation_end() never reads a destroyed proc.
+   */
+  static inline uint64_t epoch() {
+    return _epoch.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * The auto-flush period (0 if not started)
+   */
+  inline uint64_t getPeriodMs() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _periodMs;
+  }
+
+  /**
+   * Number of segments, number removed by the rotation and bytes kept
+   */
+  inline void getStats(size_t &written, size_t &removed, size_t &bytes) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    written = _written;
+    removed = _removed;
+    bytes = _bytes;
+  }
+
+private:
+  /**
+   * A segment on disk
+   */
+  struct Segment {
+    size_t order;
+    std::string filepath;
+    size_t bytes;
+  };
+
+  /**
+   * Remove the oldest segments until the bounds hold (_mutex held)
+   */
+  inline void rotate() {
+    while (_segments.size() > 1 &&
+           ((_maxSegments > 0 && _segments.size() > _maxSegments) ||
+            (_maxBytes > 0 && _bytes > _maxBytes))) {
+      std::remove(_segments.front().filepath.c_str());
+      _bytes -= _segments.front().bytes;
+      _segments.pop_front();
+      ++_removed;
+    }
+  }
+
+  /**
+   * Start the ticker thread, if not running yet (_mutex held)
+   */
+  inline void start() {
+    if (!_ticker.joinable()) {
+      _ticker = std::thread([this] { run(); });
+    }
+  }
+
+  /**
+   * The loop of the ticker thread
+   */
+  inline void run() {
+    using Clock = std::chrono::steady_clock;
+    const auto never = Clock::time_point::max();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    uint64_t periodMs = 0;
+    auto nextTick = never;
+    auto nextRefresh = Clock::now();
+
+    while (!_stop) {
+      const auto now = Clock::now();
+
+      // The auto-flush got started
+      if (_periodMs != periodMs) {
+        periodMs = _periodMs;
+        nextTick = now + std::chrono::milliseconds(periodMs);
+      }
+
+      if (now >= nextTick) {
+        _epoch.fetch_add(1, std::memory_order_relaxed);
+        nextTick = now + std::chrono::milliseconds(periodMs);
+      }
+
+      // The callback may take _mutex itself, e.g. through getStats()
+      if (_refreshPending && now >= nextRefresh) {
+        _refreshPending = false;
+        nextRefresh = now + std::chrono::milliseconds(REFRESH_MS);
+
+        lock.unlock();
+        _onSegment();
+        lock.lock();
+        continue;
+      }
+
+      const auto wakeup =
+          std::min(nextTick, _refreshPending ? nextRefresh : never);
+      if (wakeup == never) {
+        _tickerCv.wait(lock);
+      } else {
+        _tickerCv.wait_until(lock, wakeup);
+      }
+    }
+  }
+
+  // Minimum time between two calls of the on_segment() callback
+  static constexpr uint64_t REFRESH_MS = 1000;
+
+  // Advanced by the ticker thread
+  static inline std::atomic<uint64_t> _epoch{0};
+
+  // Protects everything below
+  std::mutex _mutex;
+
+  // The segments on disk, oldest first
+  std::deque<Segment> _segments;
+
+  // The position of the next segment
+  size_t _reserved = 0;
+
+  // Bounds of the rotation (0 means no bound)
+  size_t _maxSegments = 0;
+  size_t _maxBytes = 0;
+
+  // Statistics
+  size_t _bytes = 0;
+  size_t _written = 0;
+  size_t _removed = 0;
+
+  // Called on the ticker thread after new segments
+  std::function<void()> _onSegment;
+
+  // Set by add(), cleared once the callback runs
+  bool _refreshPending = false;
+
+  // The auto-flush period (0 if not started)
+  uint64_t _periodMs = 0;
+
+  // Set on destruction
+  bool _stop = false;
+
+  // Wakes the ticker thread up on new segments, auto-flush and destruction
+  std::condition_variable _tickerCv;
+
+  // The ticker thread (started last)
+  std::thread _ticker;
+};
+
+} // namespace TraCR
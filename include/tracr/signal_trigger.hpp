@@ -0,0 +1,170 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file signal_trigger.hpp
+ * @brief Runs a callback on a helper thread whenever a signal arrives
+ * @author Noah Andrés Baumann
+ * @date 16/10/2026
+ */
+
+#pragma once
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h> // pipe2(), fcntl()
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <unistd.h> // read(), write()
+
+namespace TraCR {
+
+/**
+ * The signal handler may only do async-signal-safe work. It writes a byte into
+ * a pipe, and a helper thread blocked on the other end runs the callback. The
+ * interrupted thread therefore only pays for one write().
+ *
+ * Only one SignalTrigger may exist at a time.
+ */
+class SignalTrigger {
+public:
+  /**
+   * Constructor, installs the handler for signum and starts the helper thread
+   */
+  SignalTrigger(int signum, std::function<void()> callback)
+      : _signum(signum), _callback(std::move(callback)) {
+    if (_writeFd >= 0) {
+      std::cerr << "A TraCR signal trigger is already installed\n";
+      std::exit(EXIT_FAILURE);
+    }
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+      std::cerr << "TraCR failed to create the signal pipe errno=" << errno
+                << " (" << std::strerror(errno) << ")\n";
+      std::exit(EXIT_FAILURE);
+    }
+    _readFd = fds[0];
+    _writeFd = fds[1];
+
+    // A burst of signals must never block the interrupted thread
+    fcntl(_writeFd, F_SETFL, fcntl(_writeFd, F_GETFL) | O_NONBLOCK);
+
+    _thread = std::thread([this] { run(); });
+
+    struct sigaction action {};
+    action.sa_handler = handle;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    if (sigaction(_signum, &action, &_previous) != 0) {
+      std::cerr << "TraCR failed to install the handler of signal " << _signum
+                << " errno=" << errno << " (" << std::strerror(errno) << ")\n";
+      std::exit(EXIT_FAILURE);
+    }
+  }
+
+  /**
+   * The handler and the helper thread are owned exclusively, hence no copies.
+   */
+  SignalTrigger(const SignalTrigger &) = delete;
+  SignalTrigger &operator=(const SignalTrigger &) = delete;
+
+  /**
+   * Destructor, restores the previous handler and joins the helper thread
+   * once it finished the callbacks already requested
+   */
+  ~SignalTrigger() {
+    sigaction(_signum, &_previous, nullptr);
+
+    char stop = STOP;
+    while (::write(_writeFd, &stop, 1) < 0 && errno == EAGAIN) {
+      std::this_thread::yield(); // The pipe is full of pending requests
+    }
+    _thread.join();
+
+    close(_readFd);
+    close(_writeFd);
+    _writeFd = -1;
+  }
+
+  /**
+   *
+   */
+  inline size_t getTriggered() const { return _triggered; }
+
+private:
+  static constexpr char FIRE = 1;
+  static constexpr char STOP = 0;
+
+  /**
+   * The signal handler (async-signal-safe)
+   */
+  static void handle(int) {
+    const int saved = errno;
+    char fire = FIRE;
+    ssize_t ret = ::write(_writeFd, &fire, 1); // Dropped if the pipe is full
+    (void)ret;
+    errno = saved;
+  }
+
+  /**
+   * The loop of the helper thread
+   */
+  inline void run() {
+    while (true) {
+      char request;
+      ssize_t ret = ::read(_readFd, &request, 1);
+
+      if (ret < 0 && errno == EINTR) {
+        continue;
+      }
+
+      if (ret <= 0 || request == STOP) {
+        return;
+      }
+
+      ++_triggered;
+      _callback();
+    }
+  }
+
+  // The write end of the pipe, global as the signal handler needs it
+  static inline int _writeFd = -1;
+
+  // The read end of the pipe
+  int _readFd = -1;
+
+  // The signal handled
+  int _signum;
+
+  // The handler installed before
+  struct sigaction _previous {};
+
+  // Run on the helper thread for each signal
+  std::function<void()> _callback;
+
+  // Number of callbacks run
+  size_t _triggered = 0;
+
+  // The helper thread itself
+  std::thread _thread;
+};
+
+} // namespace TraCR
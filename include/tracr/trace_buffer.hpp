@@ -0,0 +1,491 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file trace_buffer.hpp
+ * @brief mmap-backed storage of the traces of one TraCR thread
+ * @author Noah Andrés Baumann
+ * @date 16/10/2026
+ */
+
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/mman.h> // mmap(), munmap(), madvise(), mremap()
+#include <unistd.h>   // close(), sysconf()
+#include <utility>    // std::swap()
+
+#include "numa_placement.hpp"
+
+namespace TraCR {
+
+/**
+ * The size of a huge page (2 MiB on x86-64, and on AArch64 with 4 KiB pages)
+ */
+constexpr size_t HUGE_PAGE_SIZE = 2 << 20;
+
+/**
+ * The pages behind an anonymous trace buffer, from best to worst
+ */
+enum class PageBacking : uint8_t {
+  // Base pages of the kernel (4 KiB), one TLB entry per page
+  BASE = 0,
+
+  // Transparent huge pages, the kernel backs the buffer with huge pages where
+  // it can find them on the first touch
+  THP = 1,
+
+  // Huge pages of the hugetlbfs pool, reserved up front
+  HUGETLB = 2
+};
+
+/**
+ *
+ */
+inline const char *page_backing_name(PageBacking backing) {
+  switch (backing) {
+  case PageBacking::HUGETLB:
+    return "hugetlb";
+  case PageBacking::THP:
+    return "thp";
+  default:
+    return "base";
+  }
+}
+
+/**
+ * The system-wide mode of transparent huge pages ("always", "madvise" or
+ * "never"), empty if the kernel has none
+ */
+inline const std::string &transparent_huge_pages_mode() {
+  static const std::string mode = [] {
+    std::ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string line;
+    std::getline(file, line);
+
+    // The active mode is the one in brackets
+    const size_t open = line.find('[');
+    const size_t close = line.find(']', open);
+    if (open == std::string::npos || close == std::string::npos) {
+      return std::string();
+    }
+    return line.substr(open + 1, close - open - 1);
+  }();
+  return mode;
+}
+
+/**
+ * The best page backing to try for new buffers. By default hugetlb, lowered
+ * with the environment variable TRACR_PAGE_BACKING=thp|base (e.g. to compare
+ * the per-event cost of both in the same binary).
+ */
+inline PageBacking requested_page_backing() {
+  const char *env = std::getenv("TRACR_PAGE_BACKING");
+  if (env == nullptr || std::strcmp(env, "hugetlb") == 0) {
+    return PageBacking::HUGETLB;
+  }
+  if (std::strcmp(env, "thp") == 0) {
+    return PageBacking::THP;
+  }
+  if (std::strcmp(env, "base") == 0) {
+    return PageBacking::BASE;
+  }
+
+  std::cerr << "Unknown TRACR_PAGE_BACKING: " << env
+            << " (expected hugetlb, thp or base)\n";
+  std::exit(EXIT_FAILURE);
+}
+
+/**
+ * Fixed-capacity trace storage backed by an anonymous mapping.
+ *
+ * Only virtual address space is reserved at construction. The kernel commits
+ * (and zeroes) a page the first time it is written, so the memory footprint
+ * and the init cost of a TraCR thread scale with the number of traces actually
+ * recorded instead of with the capacity.
+ *
+ * Alternatively, the buffer is a shared mapping of a file behind a prefix of
+ * the given size (e.g. a file header). Then the page cache holds the traces,
+ * which reach the file even if the process dies.
+ *
+ * With TRACR_HUGE_PAGES, an anonymous buffer is backed by huge pages, so the
+ * hot path walks through one TLB entry per 2 MiB of traces instead of one per
+ * 4 KiB. The first backing that works is taken: hugetlb pages, transparent huge
+ * pages, base pages.
+ *
+ * With TRACR_NUMA_LOCAL, an anonymous buffer is tied to the NUMA node of the
+ * thread constructing it, before any of its pages is touched.
+ *
+ * With TRACR_POOL_CHUNK, the reserved pages are replaced chunk by chunk with
+ * already faulted ones taken from the buffer pool (see attach_chunk()), or
+ * faulted in place if the pool has none.
+ */
+template <typename T> class TraceBuffer {
+public:
+  /**
+   * Constructor
+   */
+  TraceBuffer(size_t capacity)
+      : _capacity(capacity), _bytes(capacity * sizeof(T)) {
+#ifdef TRACR_HUGE_PAGES
+    map_huge(requested_page_backing());
+#else
+    map(MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1);
+#endif
+
+#ifdef TRACR_NUMA_LOCAL
+    _numaNode = current_numa_node();
+    if (bind_to_numa_node(_base, _bytes, _numaNode, requested_numa_policy())) {
+      _numaPolicy = requested_numa_policy();
+    }
+#endif
+  }
+
+  /**
+   * Constructor of a file-backed buffer. The file behind fd has to be at least
+   * prefix + capacity * sizeof(T) bytes large. Takes ownership of fd.
+   */
+  TraceBuffer(size_t capacity, int fd, size_t prefix)
+      : _capacity(capacity), _bytes(prefix + capacity * sizeof(T)),
+        _prefix(prefix) {
+    map(MAP_SHARED | MAP_NORESERVE, fd);
+    close(fd); // The mapping keeps the file alive
+  }
+
+  /**
+   * No default constructor allowed.
+   */
+  TraceBuffer() = delete;
+
+  /**
+   * The mapping is owned exclusively, hence no copies.
+   */
+  TraceBuffer(const TraceBuffer &) = delete;
+  TraceBuffer &operator=(const TraceBuffer &) = delete;
+
+  /**
+   * Move constructor, takes over the mapping (e.g. to hand it to an I/O thread)
+   */
+  TraceBuffer(TraceBuffer &&other) noexcept
+      : _base(other._base), _data(other._data), _capacity(other._capacity),
+        _bytes(other._bytes), _prefix(other._prefix),
+        _backing(other._backing), _numaNode(other._numaNode),
+        _numaPolicy(other._numaPolicy), _populated(other._populated) {
+    other._base = nullptr;
+    other._data = nullptr;
+  }
+
+  /**
+   * Move assignment, the mapping of this buffer is released along with other
+   */
+  TraceBuffer &operator=(TraceBuffer &&other) noexcept {
+    std::swap(_base, other._base);
+    std::swap(_data, other._data);
+    std::swap(_capacity, other._capacity);
+    std::swap(_bytes, other._bytes);
+    std::swap(_prefix, other._prefix);
+    std::swap(_backing, other._backing);
+    std::swap(_numaNode, other._numaNode);
+    std::swap(_numaPolicy, other._numaPolicy);
+    std::swap(_populated, other._populated);
+    return *this;
+  }
+
+  /**
+   * Destructor, releases the reserved address space
+   */
+  ~TraceBuffer() {
+    if (_base != nullptr) {
+      munmap(_base, _bytes);
+    }
+  }
+
+  /**
+   *
+   */
+  inline T &operator[](size_t idx) { return _data[idx]; }
+
+  /**
+   *
+   */
+  inline const T &operator[](size_t idx) const { return _data[idx]; }
+
+  /**
+   *
+   */
+  inline T *data() { return _data; }
+
+  /**
+   *
+   */
+  inline const T *data() const { return _data; }
+
+  /**
+   * The number of elements this buffer can hold
+   */
+  inline size_t size() const { return _capacity; }
+
+  /**
+   * The prefix in front of the elements of a file-backed buffer
+   */
+  inline void *prefix() { return _base; }
+
+  /**
+   * The pages this buffer was mapped with
+   */
+  inline PageBacking backing() const { return _backing; }
+
+  /**
+   * The NUMA node of the thread that constructed this buffer (-1 if unknown)
+   */
+  inline int numa_node() const { return _numaNode; }
+
+  /**
+   * The policy tying the buffer to numa_node()
+   */
+  inline NumaPolicy numa_policy() const { return _numaPolicy; }
+
+  /**
+   * The number of elements at the start of the buffer backed by attached chunks
+   */
+  inline size_t populated() const { return _populated; }
+
+  /**
+   * Move the pages of chunk, a page aligned anonymous mapping of elements, to
+   * the populated end of this anonymous buffer. They replace the reserved pages
+   * there, so the elements keep their contents and need no page faults.
+   */
+  inline void attach_chunk(void *chunk, size_t elements) {
+    const size_t bytes = elements * sizeof(T);
+    void *ptr = mremap(chunk, bytes, bytes, MREMAP_MAYMOVE | MREMAP_FIXED,
+                       _data + _populated);
+
+    if (ptr == MAP_FAILED) {
+      std::cerr << "mremap of a trace buffer chunk failed for: " << bytes
+                << " bytes errno=" << errno << " (" << std::strerror(errno)
+                << ")\n";
+      std::exit(EXIT_FAILURE);
+    }
+    _populated += elements;
+  }
+
+  /**
+   * Fault the reserved pages of the next elements at the populated end of
+   * this anonymous buffer. Unlike an attached chunk, they stay part of the
+   * mapping of the buffer, so they take no mapping of their own.
+   */
+  inline void populate_chunk(size_t elements) {
+    const size_t bytes = elements * sizeof(T);
+    char *start = reinterpret_cast<char *>(_data + _populated);
+
+#ifdef MADV_POPULATE_WRITE
+    // Linux 5.14 and newer fault the whole range at once
+    if (madvise(start, bytes, MADV_POPULATE_WRITE) != 0)
+#endif
+    {
+      const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+      for (size_t offset = 0; offset < bytes; offset += pageSize) {
+        *static_cast<volatile char *>(start + offset) = 0;
+      }
+    }
+    _populated += elements;
+  }
+
+  /**
+   * Move the pages of the last elements populated out of this buffer, to a
+   * new mapping that is returned. They may span several mappings, so they are
+   * moved chunk by chunk, next to each other. Their address space stays
+   * reserved, empty again and in a single mapping.
+   */
+  inline void *detach_chunks(size_t elements, size_t chunk) {
+    const size_t bytes = elements * sizeof(T);
+    const size_t chunkBytes = chunk * sizeof(T);
+    _populated -= elements;
+    char *src = reinterpret_cast<char *>(_data + _populated);
+
+    // Replaced chunk by chunk by the moved pages
+    char *run = static_cast<char *>(
+        mmap(nullptr, bytes, PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0));
+    bool moved = (run != MAP_FAILED);
+
+    for (size_t offset = 0; moved && offset < bytes; offset += chunkBytes) {
+      void *ptr = MAP_FAILED;
+#ifdef MREMAP_DONTUNMAP
+      // Linux 5.7 and newer leave the source mapped (and empty) by themselves
+      ptr = mremap(src + offset, chunkBytes, chunkBytes,
+                   MREMAP_MAYMOVE | MREMAP_FIXED | MREMAP_DONTUNMAP,
+                   run + offset);
+#endif
+      if (ptr == MAP_FAILED) {
+        ptr = mremap(src + offset, chunkBytes, chunkBytes,
+                     MREMAP_MAYMOVE | MREMAP_FIXED, run + offset);
+      }
+      moved = (ptr != MAP_FAILED);
+    }
+
+    // One fresh reservation instead of the pieces left behind
+    if (!moved ||
+        mmap(src, bytes, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1,
+             0) == MAP_FAILED) {
+      std::cerr << "mremap of the trace buffer chunks failed for: " << bytes
+                << " bytes errno=" << errno << " (" << std::strerror(errno)
+                << ")\n";
+      std::exit(EXIT_FAILURE);
+    }
+    return run;
+  }
+
+  /**
+   * The number of bytes of this buffer backed by huge pages right now. For
+   * transparent huge pages, the kernel reports them per mapping in
+   * /proc/self/smaps, hence this is not meant for the hot path.
+   */
+  inline size_t huge_page_bytes() const {
+    if (_base == nullptr || _backing == PageBacking::BASE) {
+      return 0;
+    }
+    if (_backing == PageBacking::HUGETLB) {
+      return _bytes;
+    }
+
+    const unsigned long base = reinterpret_cast<uintptr_t>(_base);
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    bool inside = false;
+
+    while (std::getline(smaps, line)) {
+      unsigned long start, end;
+      if (std::sscanf(line.c_str(), "%lx-%lx ", &start, &end) == 2) {
+        inside = (start <= base && base < end);
+      } else if (inside && line.compare(0, 14, "AnonHugePages:") == 0) {
+        // The kernel may have merged the mapping with its neighbours
+        const size_t bytes =
+            std::strtoull(line.c_str() + 14, nullptr, 10) << 10;
+        return (bytes < _bytes) ? bytes : _bytes;
+      }
+    }
+    return 0;
+  }
+
+private:
+  /**
+   *
+   */
+  inline void map(int flags, int fd) {
+    void *ptr = mmap(nullptr, _bytes, PROT_READ | PROT_WRITE, flags, fd, 0);
+
+    if (ptr == MAP_FAILED) {
+      std::cerr << "mmap of the trace buffer failed for: " << _bytes
+                << " bytes errno=" << errno << " (" << std::strerror(errno)
+                << ")\n";
+      std::exit(EXIT_FAILURE);
+    }
+
+    _base = static_cast<char *>(ptr);
+    _data = reinterpret_cast<T *>(_base + _prefix);
+  }
+
+  /**
+   * Map an anonymous buffer with the best backing up to the requested one. The
+   * size is rounded up to whole huge pages.
+   */
+  inline void map_huge(PageBacking requested) {
+    const size_t bytes =
+        (_bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+    // Without MAP_NORESERVE, so an empty pool fails here instead of raising a
+    // SIGBUS on the hot path
+    if (requested == PageBacking::HUGETLB) {
+      void *ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (ptr != MAP_FAILED) {
+        _bytes = bytes;
+        _base = static_cast<char *>(ptr);
+        _data = reinterpret_cast<T *>(_base);
+        _backing = PageBacking::HUGETLB;
+        return;
+      }
+    }
+
+    // Transparent huge pages only back aligned 2 MiB ranges, hence one more
+    // huge page is reserved and the unaligned ends are cut off again
+    if (requested != PageBacking::BASE) {
+      const size_t reserved = bytes + HUGE_PAGE_SIZE;
+      void *ptr = mmap(nullptr, reserved, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (ptr != MAP_FAILED) {
+        char *raw = static_cast<char *>(ptr);
+        char *aligned = reinterpret_cast<char *>(
+            (reinterpret_cast<uintptr_t>(raw) + HUGE_PAGE_SIZE - 1) &
+            ~static_cast<uintptr_t>(HUGE_PAGE_SIZE - 1));
+        const size_t head = aligned - raw;
+        if (head > 0) {
+          munmap(raw, head);
+        }
+        munmap(aligned + bytes, reserved - head - bytes);
+
+        _bytes = bytes;
+        _base = aligned;
+        _data = reinterpret_cast<T *>(_base);
+
+        const std::string &mode = transparent_huge_pages_mode();
+        if (madvise(_base, _bytes, MADV_HUGEPAGE) == 0 && !mode.empty() &&
+            mode != "never") {
+          _backing = PageBacking::THP;
+        }
+        return;
+      }
+    }
+
+    map(MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1);
+  }
+
+  // Start of the mapping
+  char *_base = nullptr;
+
+  // Start of the elements
+  T *_data = nullptr;
+
+  // The number of elements reserved
+  size_t _capacity;
+
+  // The number of bytes reserved
+  size_t _bytes;
+
+  // The number of bytes in front of the elements
+  size_t _prefix = 0;
+
+  // The pages behind the mapping
+  PageBacking _backing = PageBacking::BASE;
+
+  // The NUMA node the mapping is tied to with _numaPolicy
+  int _numaNode = -1;
+  NumaPolicy _numaPolicy = NumaPolicy::NONE;
+
+  // The number of elements backed by attached chunks
+  size_t _populated = 0;
+};
+
+} // namespace TraCR
@@ -0,0 +1,203 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file trace_container.hpp
+ * @brief The single container file of a proc (TRACR_SINGLE_FILE)
+ * @author Noah Andrés Baumann
+ * @date 16/10/2026
+ */
+
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h> // open()
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unistd.h> // pwrite()
+#include <vector>
+
+#include "bts_format.hpp"
+
+namespace TraCR {
+
+/**
+ * Hands out aligned byte ranges of the container of a proc to the trace files
+ * of its TraCR threads, which are written into them concurrently with
+ * positional writes. On finish, the metadata, the section directory and the
+ * footer are appended.
+ */
+class TraceContainer {
+public:
+  /**
+   * Default constructor, the file is created by open()
+   */
+  TraceContainer() = default;
+
+  /**
+   * The file descriptor is owned exclusively, hence no copies.
+   */
+  TraceContainer(const TraceContainer &) = delete;
+  TraceContainer &operator=(const TraceContainer &) = delete;
+
+  /**
+   * Destructor, closes the file (finished or not)
+   */
+  ~TraceContainer() {
+    if (_fd >= 0) {
+      close(_fd);
+    }
+  }
+
+  /**
+   * Create the container at filepath and write its header
+   */
+  inline void open(const std::string &filepath, int64_t pid) {
+    _filepath = filepath;
+    _fd = ::open(filepath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                 0644);
+    if (_fd < 0) {
+      std::cerr << "Failed to create file: " << filepath << " errno=" << errno
+                << " (" << std::strerror(errno) << ")\n";
+      std::exit(EXIT_FAILURE);
+    }
+
+    ContainerHeader header{};
+    std::memcpy(header.magic, CONTAINER_MAGIC, sizeof(header.magic));
+    header.version = CONTAINER_VERSION;
+    header.header_size = sizeof(ContainerHeader);
+    header.alignment = CONTAINER_ALIGNMENT;
+    header.pid = pid;
+
+    write_at(&header, sizeof(header), 0);
+    _end = align(sizeof(header));
+  }
+
+  /**
+   * Reserve the section for a trace file of bytes bytes of the given TraCR
+   * thread and return its offset. Thread safe.
+   */
+  inline off_t append(int64_t tid, size_t bytes) {
+    return add_section(ContainerSectionKind::TRACES, tid, bytes);
+  }
+
+  /**
+   * Append the metadata, the section directory and the footer. All sections
+   * have to be written by now.
+   */
+  inline void finish(const std::string &metadata) {
+    const off_t offset =
+        add_section(ContainerSectionKind::METADATA, -1, metadata.size());
+    write_at(metadata.data(), metadata.size(), offset);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    ContainerFooter footer{};
+    std::memcpy(footer.magic, CONTAINER_FOOTER_MAGIC, sizeof(footer.magic));
+    footer.directory_offset = offset + metadata.size();
+    footer.num_sections = _sections.size();
+
+    const size_t directoryBytes = sizeof(ContainerSection) * _sections.size();
+    write_at(_sections.data(), directoryBytes, footer.directory_offset);
+    write_at(&footer, sizeof(footer), footer.directory_offset + directoryBytes);
+  }
+
+  /**
+   *
+   */
+  inline int getFd() const { return _fd; }
+
+  /**
+   *
+   */
+  inline const std::string &getPath() const { return _filepath; }
+
+  /**
+   * Number of sections so far
+   */
+  inline size_t getNumSections() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _sections.size();
+  }
+
+private:
+  /**
+   * Round bytes up to the alignment of the sections
+   */
+  static inline uint64_t align(uint64_t bytes) {
+    return (bytes + CONTAINER_ALIGNMENT - 1) / CONTAINER_ALIGNMENT *
+           CONTAINER_ALIGNMENT;
+  }
+
+  /**
+   * Register a section of bytes bytes at the end of the container
+   */
+  inline off_t add_section(ContainerSectionKind kind, int64_t tid,
+                           size_t bytes) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    const uint64_t offset = _end;
+    _end = align(offset + bytes);
+    _sections.push_back(
+        {static_cast<uint32_t>(kind), 0, tid, offset, bytes});
+
+    return static_cast<off_t>(offset);
+  }
+
+  /**
+   * Write all bytes at offset, retrying short writes
+   */
+  inline void write_at(const void *data, size_t bytes, uint64_t offset) {
+    const char *ptr = static_cast<const char *>(data);
+
+    while (bytes > 0) {
+      ssize_t written = pwrite(_fd, ptr, bytes, static_cast<off_t>(offset));
+      if (written < 0 && errno == EINTR) {
+        continue;
+      }
+      if (written <= 0) {
+        std::cerr << "Failed to write into file: " << _filepath
+                  << " errno=" << errno << " (" << std::strerror(errno)
+                  << ")\n";
+        std::exit(EXIT_FAILURE);
+      }
+
+      ptr += written;
+      bytes -= static_cast<size_t>(written);
+      offset += static_cast<uint64_t>(written);
+    }
+  }
+
+  // The path of the container
+  std::string _filepath;
+
+  int _fd = -1;
+
+  // Protects everything below
+  std::mutex _mutex;
+
+  // The end of the last section, rounded up to the alignment
+  uint64_t _end = 0;
+
+  // The section directory in the order the sections were reserved
+  std::vector<ContainerSection> _sections;
+};
+
+} // namespace TraCR
@@ -0,0 +1,199 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file trace_writer.hpp
+ * @brief Background writer thread appending trace blocks to their files
+ * @author Noah Andrés Baumann
+ * @date 16/10/2026
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unistd.h> // write()
+
+namespace TraCR {
+
+/**
+ * The TraCR writer thread.
+ *
+ * TraCR threads hand over a filled block of their buffer together with a
+ * pending flag. The writer appends the block to the given file descriptor and
+ * clears the flag once the block may be reused. Blocks are written in the
+ * order they were submitted. The file descriptor is read by the writer thread,
+ * so the prepare of an earlier block may open it.
+ */
+class TraceWriter {
+public:
+  /**
+   * Constructor, starts the writer thread
+   */
+  TraceWriter() : _thread([this] { run(); }){};
+
+  /**
+   * The writer thread is owned exclusively, hence no copies.
+   */
+  TraceWriter(const TraceWriter &) = delete;
+  TraceWriter &operator=(const TraceWriter &) = delete;
+
+  /**
+   * Destructor, writes all remaining blocks and joins the writer thread
+   */
+  ~TraceWriter() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _jobCv.notify_one();
+    _thread.join();
+  }
+
+  /**
+   * Queue a block to be appended to *fd. The pending flag is set now and
+   * cleared by the writer thread once the block has been written. prepare
+   * runs on the writer thread right before writing (e.g. to open *fd or to
+   * compute statistics over the block).
+   */
+  inline void submit(int *fd, const void *data, size_t bytes,
+                     std::atomic<bool> *pending,
+                     std::function<void()> prepare = nullptr) {
+    pending->store(true, std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _jobs.push_back({fd, data, bytes, pending, std::move(prepare)});
+    }
+    _jobCv.notify_one();
+  }
+
+  /**
+   * Block the caller until the given pending flag got cleared
+   */
+  inline void wait(const std::atomic<bool> &pending) {
+    if (!pending.load(std::memory_order_acquire)) {
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _doneCv.wait(lock,
+                 [&] { return !pending.load(std::memory_order_acquire); });
+  }
+
+  /**
+   *
+   */
+  inline size_t getBytesWritten() const { return _bytesWritten.load(); }
+
+private:
+  /**
+   * A block waiting to be written
+   */
+  struct Job {
+    int *fd;
+    const void *data;
+    size_t bytes;
+    std::atomic<bool> *pending;
+    std::function<void()> prepare;
+  };
+
+  /**
+   * The loop of the writer thread
+   */
+  inline void run() {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (true) {
+      _jobCv.wait(lock, [this] { return _stop || !_jobs.empty(); });
+
+      if (_jobs.empty()) {
+        return; // _stop is set and everything is written
+      }
+
+      Job job = std::move(_jobs.front());
+      _jobs.pop_front();
+
+      // Don't hold the lock while doing I/O
+      lock.unlock();
+      if (job.prepare) {
+        job.prepare();
+      }
+      write_all(job);
+      lock.lock();
+
+      job.pending->store(false, std::memory_order_release);
+      _doneCv.notify_all();
+    }
+  }
+
+  /**
+   * Write the whole block, retrying on partial writes
+   */
+  inline void write_all(const Job &job) {
+    const char *ptr = static_cast<const char *>(job.data);
+    size_t remaining = job.bytes;
+
+    while (remaining > 0) {
+      ssize_t written = ::write(*job.fd, ptr, remaining);
+
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        std::cerr << "TraCR writer failed to write into fd: " << *job.fd
+                  << " errno=" << errno << " (" << std::strerror(errno)
+                  << ")\n";
+        std::exit(EXIT_FAILURE);
+      }
+
+      ptr += written;
+      remaining -= static_cast<size_t>(written);
+    }
+
+    _bytesWritten += job.bytes;
+  }
+
+  // Protects the job queue
+  std::mutex _mutex;
+
+  // Signals the writer thread that there is work
+  std::condition_variable _jobCv;
+
+  // Signals the TraCR threads that a block has been written
+  std::condition_variable _doneCv;
+
+  // The blocks waiting to be written
+  std::deque<Job> _jobs;
+
+  // Set on destruction
+  bool _stop = false;
+
+  // Total number of bytes written so far
+  std::atomic<size_t> _bytesWritten{0};
+
+  // The writer thread itself (initialized last)
+  std::thread _thread;
+};
+
+} // namespace TraCR
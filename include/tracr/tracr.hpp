@@ -101,6 +101,26 @@ enum mark_color : uint16_t {
 #define INSTRUMENTATION_MARK_RESET(channelId)                                  \
   instrumentation_mark_reset(channelId)
 
+#define INSTRUMENTATION_MARK_SET_COARSE(channelId, eventId, extraId)           \
+  instrumentation_mark_set_coarse(channelId, eventId, extraId)
+
+#define INSTRUMENTATION_MARK_RESET_COARSE(channelId)                           \
+  instrumentation_mark_reset_coarse(channelId)
+
+#define INSTRUMENTATION_COARSE_CLOCK(period_us)                                \
+  instrumentation_coarse_clock(period_us)
+
+#define INSTRUMENTATION_SNAPSHOT_SIGNAL(signum)                                \
+  instrumentation_snapshot_signal(signum)
+
+#define INSTRUMENTATION_FLUSH() instrumentation_flush()
+
+#define INSTRUMENTATION_AUTO_FLUSH(period_ms)                                  \
+  instrumentation_auto_flush(period_ms)
+
+#define INSTRUMENTATION_SEGMENT_ROTATION(max_segments, max_bytes)              \
+  instrumentation_segment_rotation(max_segments, max_bytes)
+
 #define INSTRUMENTATION_ADD_CHANNEL_NAMES(channel_names)                       \
   tracrProc->addCustomChannelNames(channel_names)
 
@@ -116,6 +136,12 @@ enum mark_color : uint16_t {
 
 #define INSTRUMENTATION_TRACE_PATH(path) instrumentation_trace_path(path)
 
+#define INSTRUMENTATION_TIMER_BACKEND(name) instrumentation_timer_backend(name)
+
+#define INSTRUMENTATION_POLICY(name) instrumentation_policy(name)
+
+#define INSTRUMENTATION_CAPACITY(events) instrumentation_capacity(events)
+
 #define INSTRUMENTATION_IS_PROC_READY() instrumentation_is_proc_ready()
 
 #define INSTRUMENTATION_NUM_TRACR_THREADS() instrumentation_num_tracr_threads()
@@ -166,6 +192,25 @@ enum mark_color : uint16_t {
 
 #define INSTRUMENTATION_MARK_RESET(channelId) (void)(channelId)
 
+#define INSTRUMENTATION_MARK_SET_COARSE(channelId, eventId, extraId)           \
+  (void)(channelId);                                                           \
+  (void)(eventId);                                                             \
+  (void)(extraId)
+
+#define INSTRUMENTATION_MARK_RESET_COARSE(channelId) (void)(channelId)
+
+#define INSTRUMENTATION_COARSE_CLOCK(period_us) (void)(period_us)
+
+#define INSTRUMENTATION_SNAPSHOT_SIGNAL(signum) (void)(signum)
+
+#define INSTRUMENTATION_FLUSH()
+
+#define INSTRUMENTATION_AUTO_FLUSH(period_ms) (void)(period_ms)
+
+#define INSTRUMENTATION_SEGMENT_ROTATION(max_segments, max_bytes)              \
+  (void)(max_segments);                                                        \
+  (void)(max_bytes)
+
 #define INSTRUMENTATION_ADD_CHANNEL_NAMES(channel_names) (void)(channel_names)
 
 #define INSTRUMENTATION_ADD_NUM_CHANNELS(num_channels) (void)(num_channels)
@@ -179,6 +224,12 @@ enum mark_color : uint16_t {
 
 #define INSTRUMENTATION_TRACE_PATH(path) (void)(path)
 
+#define INSTRUMENTATION_TIMER_BACKEND(name) (void)(name)
+
+#define INSTRUMENTATION_POLICY(name) (void)(name)
+
+#define INSTRUMENTATION_CAPACITY(events) (void)(events)
+
 #define INSTRUMENTATION_IS_PROC_READY() false
 
 #define INSTRUMENTATION_NUM_TRACR_THREADS() 0
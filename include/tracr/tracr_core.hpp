@@ -24,6 +24,10 @@
 #pragma once
 
 #include <atomic>
+#include <cctype> // std::isdigit()
+#include <cerrno>
+#include <condition_variable>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <string>
 #include <sys/syscall.h> // syscall()
@@ -43,6 +47,21 @@ inline std::unique_ptr<TraCRProc> tracrProc;
  */
 inline thread_local std::unique_ptr<TraCRThread> tracrThread;
 
+#ifdef TRACR_PER_CPU
+/**
+ * With TRACR_PER_CPU the kernel thread ID stored with each record of the
+ * calling thread, taken by its first marker. Threads then need no TraCR thread,
+ * nor instrumentation_thread_init().
+ */
+inline thread_local long tracr_tid = 0;
+
+/**
+ * With TRACR_PER_CPU, set between instrumentation_thread_init() and
+ * instrumentation_thread_finalize() of the calling thread
+ */
+inline thread_local bool tracr_thread_active = false;
+#endif
+
 /**
  * Global variable to check if TraCR tracing is enabled (at runtime)
  * Doesn't have to be atomic as slipping some traces is not dramatic.
@@ -60,6 +79,36 @@ inline std::atomic<bool> tracr_proc_init{false};
  */
 inline std::atomic<int> num_tracr_threads{0};
 
+/**
+ * Serializes the registration of TraCR threads and the hand-over of their
+ * flush against instrumentation_end(), which flushes the ones still running
+ * and then tears down the TraCR proc. The flushes themselves run outside of
+ * it, in parallel.
+ */
+inline std::mutex tracr_threads_mutex;
+
+/**
+ * Number of TraCR threads flushing in instrumentation_thread_finalize(), which
+ * keep the TraCR proc alive. instrumentation_end() waits for them on
+ * tracr_flush_done. Guarded by tracr_threads_mutex.
+ */
+inline size_t tracr_flushing_threads = 0;
+inline std::condition_variable tracr_flush_done;
+
+/**
+ * Flushes the TraCR thread of a thread that exits without calling
+ * instrumentation_thread_finalize()
+ */
+struct ThreadExitGuard {
+  ~ThreadExitGuard();
+};
+
+/**
+ * Constructed by instrumentation_thread_init(), after tracrThread, hence
+ * destroyed before it on thread exit
+ */
+inline thread_local ThreadExitGuard thread_exit_guard;
+
 /**
  * Lazy add color definition method for the Paraver format
  */
@@ -74,6 +123,19 @@ inline std::string trace_folder_path{""};
  *
  */
 static inline void instrumentation_thread_init() {
+#ifdef TRACR_PER_CPU
+  // Nothing to allocate, the markers record into the buffer of the CPU
+  if (tracr_thread_active) {
+    std::cerr << "TraCR Thread already exists with TID: " << tracr_tid << "\n";
+    std::exit(EXIT_FAILURE);
+  }
+  tracr_thread_active = true;
+  tracr_tid = syscall(SYS_gettid);
+
+  ++num_tracr_threads;
+  return;
+#endif
+
   // Check if this C++ thread already has an Instance if so, abort
   if (tracrThread) {
     std::cerr << "TraCR Thread already exists with TID: "
@@ -81,8 +143,59 @@ static inline void instrumentation_thread_init() {
     std::exit(EXIT_FAILURE);
   }
 
-  // Add tracr Thread
-  tracrThread = std::make_unique<TraCRThread>(syscall(SYS_gettid));
+  // Add tracr Thread, its buffer is mapped before taking the lock
+#ifdef TRACR_MAPPED_BUFFER
+  // The proc may end concurrently, so its folder is read under the lock
+  std::string folder;
+  {
+    std::lock_guard<std::mutex> lock(tracr_threads_mutex);
+
+    if (!tracrProc) {
+      std::cerr << "TraCR Proc has not been initialized\n";
+      std::exit(EXIT_FAILURE);
+    }
+    folder = tracrProc->getFolderPath();
+  }
+
+  auto thread = std::make_unique<TraCRThread>(syscall(SYS_gettid), folder);
+#else
+  auto thread = std::make_unique<TraCRThread>(syscall(SYS_gettid));
+#endif
+
+  std::lock_guard<std::mutex> lock(tracr_threads_mutex);
+
+  if (!tracrProc) {
+    std::cerr << "TraCR Proc has not been initialized\n";
+    std::exit(EXIT_FAILURE);
+  }
+
+  tracrThread = std::move(thread);
+  tracrProc->register_thread(tracrThread.get());
+
+#ifdef TRACR_NUMA_LOCAL
+  tracrProc->add_numa_info(tracrThread.get());
+#endif
+
+#ifdef TRACR_POLICY_STREAMING
+  tracrThread->attach_writer(tracrProc->getWriter(),
+                             tracrProc->getFolderPath());
+#endif
+
+#ifdef TRACR_ASYNC_FLUSH
+  tracrThread->attach_flush_engine(tracrProc->getFlushEngine());
+#endif
+
+#ifdef TRACR_SINGLE_FILE
+  tracrThread->attach_container(tracrProc->getContainer());
+#endif
+
+#ifdef TRACR_POLICY_SEGMENTED
+  tracrThread->attach_segments(tracrProc->getSegmentManager(),
+                               tracrProc->getFolderPath());
+#endif
+
+  // Arm the flush on thread exit
+  static_cast<void>(&thread_exit_guard);
 
   // Increase global thread counter
   ++num_tracr_threads;
@@ -92,22 +205,166 @@ static inline void instrumentation_thread_init() {
  *
  */
 static inline void instrumentation_thread_finalize() {
+#ifdef TRACR_PER_CPU
+  // The records stay in the buffers of the CPUs until instrumentation_end()
+  if (!tracr_thread_active) {
+    std::cerr << "TraCR Thread doesn't exist\n";
+    std::exit(EXIT_FAILURE);
+  }
+  tracr_thread_active = false;
+
+  --num_tracr_threads;
+  return;
+#endif
+
   // Check if the tracr thread exists
   if (!tracrThread) {
     std::cerr << "TraCR Thread doesn't exist\n";
     std::exit(EXIT_FAILURE);
   }
 
-  // Flushing the trace of this TraCR thread now
+  bool flush = false;
+  {
+    std::lock_guard<std::mutex> lock(tracr_threads_mutex);
+
+    // instrumentation_end() already flushed this thread and ended the proc
+    if (!tracrProc) {
+      tracrThread.reset();
+      --num_tracr_threads;
+      return;
+    }
+
 #ifndef TRACR_DISABLE_FLUSH
-  tracrThread->flush_traces(tracrProc->getFolderPath());
+    // Keeps the proc alive until the flush is done
+    flush = tracrThread->claim_flush();
+    tracr_flushing_threads += flush;
+#endif
+
+    // A snapshot must not copy the buffer while it gets flushed (and, with
+    // TRACR_ASYNC_FLUSH, handed over)
+    tracrProc->unregister_thread(tracrThread.get());
+  }
+
+  // Flushing the trace of this TraCR thread now, in parallel to the others
+#ifndef TRACR_DISABLE_FLUSH
+  if (flush) {
+#ifdef TRACR_HUGE_PAGES
+    tracrProc->add_page_info(tracrThread.get());
+#endif
+
+    tracrThread->flush_traces(tracrProc->getFolderPath());
+    tracrProc->add_clock_sync();
+
+#ifdef TRACR_POLICY_STREAMING
+    tracrProc->add_stream_stats(tracrThread->getTID(),
+                                tracrThread->getStreamHandoffs(),
+                                tracrThread->getStreamStalls());
+#endif
+
+    if (tracrThread->wraps()) {
+      tracrProc->add_thread_info(
+          tracrThread->getTID(),
+          {{"overwritten", tracrThread->getOverwritten()}});
+    }
+  }
 #endif
 
+  {
+    std::lock_guard<std::mutex> lock(tracr_threads_mutex);
+
+    // Decrease global thread counter
+    --num_tracr_threads;
+
+    if (flush) {
+      --tracr_flushing_threads;
+      tracr_flush_done.notify_all();
+    }
+  }
+
   // Finalize the thread now (destructor of it is also called)
   tracrThread.reset();
+}
 
-  // Decrease global thread counter
-  --num_tracr_threads;
+inline ThreadExitGuard::~ThreadExitGuard() {
+  if (tracrThread) {
+    instrumentation_thread_finalize();
+  }
+}
+
+/**
+ * Select the timer backend by name (see NanoTimer::name()). Has to be called
+ * before instrumentation_start().
+ */
+static inline void instrumentation_timer_backend(const std::string &name) {
+  if (tracr_proc_init.load()) {
+    std::cerr << "The TraCR timer backend can't be changed after "
+                 "instrumentation_start()\n";
+    std::exit(EXIT_FAILURE);
+  }
+
+  TimerBackend backend;
+  if (!NanoTimer::parse(name, backend)) {
+    std::cerr << "Unknown TraCR timer backend: " << name << "\n";
+    std::exit(EXIT_FAILURE);
+  }
+
+  if (!NanoTimer::available(backend)) {
+    std::cerr << "TraCR timer backend not available on this build/CPU: "
+              << name << "\n";
+    std::exit(EXIT_FAILURE);
+  }
+
+  NanoTimer::select(backend);
+}
+
+/**
+ * Select what a full buffer does by name ("abort", "ignore_if_full" or
+ * "periodic"). Needs TRACR_RUNTIME_POLICY and has to be called before
+ * instrumentation_start().
+ */
+static inline void instrumentation_policy(const std::string &name) {
+  if (tracr_proc_init.load()) {
+    std::cerr << "The TraCR policy can't be changed after "
+                 "instrumentation_start()\n";
+    std::exit(EXIT_FAILURE);
+  }
+
+#ifdef TRACR_RUNTIME_POLICY
+  if (!parse_full_policy(name, tracr_policy)) {
+    std::cerr << "Unknown TraCR policy: " << name
+              << " (expected abort, ignore_if_full or periodic)\n";
+    std::exit(EXIT_FAILURE);
+  }
+#else
+  std::cerr << "The TraCR policy is compiled in, build with "
+               "TRACR_RUNTIME_POLICY to select " << name << " at runtime\n";
+  std::exit(EXIT_FAILURE);
+#endif
+}
+
+/**
+ * Select the number of events per TraCR thread. Needs TRACR_RUNTIME_POLICY
+ * and has to be called before instrumentation_start().
+ */
+static inline void instrumentation_capacity(size_t capacity) {
+  if (tracr_proc_init.load()) {
+    std::cerr << "The TraCR capacity can't be changed after "
+                 "instrumentation_start()\n";
+    std::exit(EXIT_FAILURE);
+  }
+
+#ifdef TRACR_RUNTIME_POLICY
+  if (capacity == 0) {
+    std::cerr << "The TraCR capacity has to be at least one event\n";
+    std::exit(EXIT_FAILURE);
+  }
+  tracr_capacity = capacity;
+#else
+  std::cerr << "The TraCR capacity is compiled in, build with "
+               "TRACR_RUNTIME_POLICY to select " << capacity
+            << " at runtime\n";
+  std::exit(EXIT_FAILURE);
+#endif
 }
 
 /**
@@ -121,9 +378,56 @@ static inline void instrumentation_start() {
     std::exit(EXIT_FAILURE);
   }
 
+  // The TRACR_TIMER environment variable overrides the timer backend
+  if (const char *timer = std::getenv("TRACR_TIMER")) {
+    instrumentation_timer_backend(timer);
+  }
+
+#ifdef TRACR_RUNTIME_POLICY
+  // And TRACR_POLICY and TRACR_CAPACITY the policy and capacity
+  if (const char *policy = std::getenv("TRACR_POLICY")) {
+    instrumentation_policy(policy);
+  }
+  if (const char *capacity = std::getenv("TRACR_CAPACITY")) {
+    // Only digits, strtoull() would skip blanks, negate "-1" and stop early
+    char *end = nullptr;
+    errno = 0;
+    const unsigned long long events = std::strtoull(capacity, &end, 10);
+    if (!std::isdigit(static_cast<unsigned char>(capacity[0])) ||
+        *end != '\0' || errno == ERANGE) {
+      std::cerr << "TRACR_CAPACITY has to be a number of events, not: \""
+                << capacity << "\"\n";
+      std::exit(EXIT_FAILURE);
+    }
+    instrumentation_capacity(events);
+  }
+
+#ifdef TRACR_COMPACT_PAYLOAD
+  // Compact records are variable sized, see TRACR_POLICY_PERIODIC
+  if (tracr_policy == BtsPolicy::PERIODIC) {
+    std::cerr << "The TraCR policy periodic can't be combined with "
+                 "TRACR_COMPACT_PAYLOAD\n";
+    std::exit(EXIT_FAILURE);
+  }
+#endif
+
+#ifdef TRACR_BUFFER_POOL
+  tracr_buffer_pool.set_capacity(record_capacity());
+#endif
+#endif
+
+#ifdef USE_HW_COUNTER
+  // Calibrate the counter now, not inside the first traced region
+  NanoTimer::calibration();
+#endif
+
   // Initialize the TraCRProc
   tracrProc = std::make_unique<TraCRProc>(syscall(SYS_gettid));
 
+#ifdef TRACR_PER_CPU
+  tracr_cpu_buffers.reset(RECORD_CAPACITY);
+#endif
+
   // Create the folders to store the traces (if enabled)
 #ifndef TRACR_DISABLE_FLUSH
   if (!tracrProc->create_folder_recursive(trace_folder_path)) {
@@ -135,6 +439,8 @@ static inline void instrumentation_start() {
   // Initialize the tracr thread of this tracr proc
   instrumentation_thread_init();
 
+  tracrProc->checkpoint_JSON();
+
   // TraCR Proc is now ready
   tracr_proc_init = true;
 }
@@ -148,28 +454,74 @@ static inline void instrumentation_end() {
     std::exit(EXIT_FAILURE);
   }
 
+#ifdef TRACR_PER_CPU
+  if (!tracr_thread_active) {
+#else
   if (!tracrThread) {
+#endif
     std::cerr << "TraCR Thread has not been initialized\n";
     std::exit(EXIT_FAILURE);
   }
 
-  // Flushing the trace of this TraCR thread/proc now (if enabled)
+  // Threads finalizing right now flush outside of the lock, wait for them. No
+  // other thread can start to flush or register from now on.
+  std::unique_lock<std::mutex> lock(tracr_threads_mutex);
+  tracr_flush_done.wait(lock, [] { return tracr_flushing_threads == 0; });
+
+#ifdef TRACR_PER_CPU
 #ifndef TRACR_DISABLE_FLUSH
-  if (num_tracr_threads.load() != 1) {
-    std::cerr << "Only one(this) TraCR Threads allowed but got: "
-              << num_tracr_threads.load() << "\n";
-    std::exit(EXIT_FAILURE);
-  }
+  // The records committed by all threads so far, later ones are not flushed
+  tracrProc->flush_cpu_buffers(tracrProc->getFolderPath());
+
+#ifdef TRACR_ASYNC_FLUSH
+  tracrProc->finish_flushes();
+#endif
+  tracrProc->add_clock_sync();
 
+  // Dump TraCR Proc JSON file
+  tracrProc->dump_JSON();
+#endif
+
+  tracr_thread_active = false;
+#else
+#ifdef TRACR_HUGE_PAGES
+  tracrProc->add_page_info(tracrThread.get());
+#endif
+
+  // Flushing the trace of this TraCR thread/proc now (if enabled)
+#ifndef TRACR_DISABLE_FLUSH
   // flush the traces of this thread
   tracrThread->flush_traces(tracrProc->getFolderPath());
 
+  // and the ones of the threads still running, up to what they published
+  tracrProc->flush_live_threads(tracrThread.get());
+
+#ifdef TRACR_ASYNC_FLUSH
+  // All of them are written in parallel by the flush engine
+  tracrProc->finish_flushes();
+#endif
+  tracrProc->add_clock_sync();
+
+#ifdef TRACR_POLICY_STREAMING
+  tracrProc->add_stream_stats(tracrThread->getTID(),
+                              tracrThread->getStreamHandoffs(),
+                              tracrThread->getStreamStalls());
+#endif
+
+  if (tracrThread->wraps()) {
+    tracrProc->add_thread_info(
+        tracrThread->getTID(),
+        {{"overwritten", tracrThread->getOverwritten()}});
+  }
+
   // Dump TraCR Proc JSON file
   tracrProc->dump_JSON();
 #endif
 
   // Destroys the TraCR Thread pointer and calls the destructor
+  tracrProc->unregister_thread(tracrThread.get());
   tracrThread.reset();
+#endif
 
   // Decrease global thread counter
   --num_tracr_threads;
@@ -177,6 +529,11 @@ static inline void instrumentation_end() {
   // Destroys the TraCR Proc pointer and calls the destructor
   tracrProc.reset();
 
+#ifdef TRACR_BUFFER_POOL
+  // The flush engine gave all buffers back, release the idle ones
+  tracr_buffer_pool.trim();
+#endif
+
   // TraCR Proc is now finalized
   tracr_proc_init = false;
 }
@@ -185,6 +542,31 @@ static inline void instrumentation_end() {
  * Debugging method for checking if something has been stored in tracr thread
  */
 static inline std::string instrumentation_get_thread_trace_str() {
+#ifdef TRACR_PER_CPU
+  // The payloads of this thread, gathered from the buffers of all CPUs
+  std::vector<Payload> payloads;
+  for (size_t cpu = 0; cpu < tracr_cpu_buffers.num_cpus(); ++cpu) {
+    const CpuRecord *records = tracr_cpu_buffers.records(cpu);
+    for (size_t i = 0; records && i < tracr_cpu_buffers.count(cpu); ++i) {
+      if (records[i].tid == tracr_tid) {
+        payloads.push_back(records[i].payload);
+      }
+    }
+  }
+  std::sort(payloads.begin(), payloads.end(),
+            [](const Payload &a, const Payload &b) {
+              return a.timestamp < b.timestamp;
+            });
+
+  std::string tid_str = "Thread(" + std::to_string(tracr_tid) + "):";
+
+  if (payloads.empty()) {
+    return tid_str + "[EMPTY: No trace data]";
+  }
+
+  size_t total_bytes = sizeof(Payload) * payloads.size();
+  const uint8_t *raw_data = reinterpret_cast<const uint8_t *>(payloads.data());
+#else
   // Safety checks
   if (!tracrThread) {
     return "[ERROR: No thread context]";
@@ -193,14 +575,19 @@ static inline std::string instrumentation_get_thread_trace_str() {
   std::string tid_str =
       "Thread(" + std::to_string(tracrThread->getTID()) + "):";
 
+#ifdef TRACR_NT_STORES
+  tracrThread->drain_stage();
+#endif
+
   if (tracrThread->_traceIdx == 0) {
     return tid_str + "[EMPTY: No trace data]";
   }
 
   // Calculate total bytes
-  size_t total_bytes = sizeof(Payload) * tracrThread->_traceIdx;
+  size_t total_bytes = sizeof(TraceRecord) * tracrThread->_traceIdx;
   const uint8_t *raw_data =
       reinterpret_cast<const uint8_t *>(tracrThread->_traces.data());
+#endif
 
   // Convert to hex string
   std::stringstream hex_stream;
@@ -245,6 +632,7 @@ instrumentation_mark_w_color_add(const std::string &label,
   }
 
   tracrProc->_markerTypes[colorId] = label;
+  tracrProc->checkpoint_JSON();
 
   return tracrProc->_markerTypes.size() - 1;
 }
@@ -266,10 +654,45 @@ static inline uint16_t instrumentation_mark_add(const std::string &label) {
   }
 
   tracrProc->_markerTypes[colorId] = label;
+  tracrProc->checkpoint_JSON();
 
   return tracrProc->_markerTypes.size() - 1;
 }
 
+/**
+ * Store a payload of the calling thread. With TRACR_FAST_PATH, straight
+ * through its cursor, unless the policy has to step in. With TRACR_PER_CPU,
+ * into the buffer of the current CPU.
+ */
+static inline void instrumentation_store(const Payload &payload) {
+#ifdef TRACR_PER_CPU
+  if (unlikely(tracr_tid == 0)) {
+    tracr_tid = syscall(SYS_gettid);
+  }
+
+  if (unlikely(!tracr_cpu_buffers.append({payload, tracr_tid}))) {
+#ifndef TRACR_POLICY_IGNORE_IF_FULL
+    std::cerr << "Warning: The buffer of CPU[" << sched_getcpu()
+              << "] is full, terminating with a Runtime Error.\n";
+    std::exit(EXIT_FAILURE);
+#endif
+  }
+  return;
+#endif
+
+#ifdef TRACR_FAST_PATH
+  const size_t idx = tracr_cursor.idx;
+  if (likely(idx < tracr_cursor.end)) {
+    *reinterpret_cast<TraceRecord *>(tracr_cursor.base +
+                                     idx * sizeof(TraceRecord)) = payload;
+    __atomic_store_n(&tracr_cursor.idx, idx + 1, __ATOMIC_RELEASE);
+    return;
+  }
+#endif
+
+  tracrThread->store_trace(payload);
+}
+
 /**
  *
  */
@@ -279,9 +702,16 @@ instrumentation_mark_set(const uint16_t &channelId, const uint16_t &eventId,
   if (unlikely(!enable_tracr))
     return;
 
-  Payload payload{channelId, eventId, extraId, NanoTimer::now()};
+#ifdef TRACR_CAPTURE_CPU
+  uint32_t cpu;
+  Payload payload{channelId, eventId, extraId, NanoTimer::stamp_cpu(cpu)};
 
-  tracrThread->store_trace(payload);
+  tracrThread->track_cpu(channelId, cpu, payload.timestamp);
+#else
+  Payload payload{channelId, eventId, extraId, NanoTimer::stamp()};
+#endif
+
+  instrumentation_store(payload);
 }
 
 /**
@@ -291,9 +721,149 @@ static inline void instrumentation_mark_reset(const uint16_t &channelId) {
   if (unlikely(!enable_tracr))
     return;
 
-  Payload payload{channelId, UINT16_MAX, UINT32_MAX, NanoTimer::now()};
+#ifdef TRACR_CAPTURE_CPU
+  uint32_t cpu;
+  Payload payload{channelId, UINT16_MAX, UINT32_MAX,
+                  NanoTimer::stamp_cpu(cpu)};
 
-  tracrThread->store_trace(payload);
+  tracrThread->track_cpu(channelId, cpu, payload.timestamp);
+#else
+  Payload payload{channelId, UINT16_MAX, UINT32_MAX, NanoTimer::stamp()};
+#endif
+
+  instrumentation_store(payload);
+}
+
+/**
+ * Like instrumentation_mark_set() but with a timestamp of the coarse clock
+ * (see instrumentation_coarse_clock())
+ */
+static inline void
+instrumentation_mark_set_coarse(const uint16_t &channelId,
+                                const uint16_t &eventId,
+                                const uint32_t &extraId = UINT32_MAX) {
+  if (unlikely(!enable_tracr))
+    return;
+
+  Payload payload{channelId, eventId, extraId,
+                  CoarseClock::now() | COARSE_TIMESTAMP_FLAG};
+
+#ifdef TRACR_CAPTURE_CPU
+  tracrThread->track_cpu(channelId, NanoTimer::current_cpu(),
+                         payload.timestamp);
+#endif
+
+  instrumentation_store(payload);
+}
+
+/**
+ * Like instrumentation_mark_reset() but with a timestamp of the coarse clock
+ */
+static inline void
+instrumentation_mark_reset_coarse(const uint16_t &channelId) {
+  if (unlikely(!enable_tracr))
+    return;
+
+  Payload payload{channelId, UINT16_MAX, UINT32_MAX,
+                  CoarseClock::now() | COARSE_TIMESTAMP_FLAG};
+
+#ifdef TRACR_CAPTURE_CPU
+  tracrThread->track_cpu(channelId, NanoTimer::current_cpu(),
+                         payload.timestamp);
+#endif
+
+  instrumentation_store(payload);
+}
+
+/**
+ * Start the ticker thread of the coarse clock, publishing a timestamp every
+ * period_us microseconds. Stopped by instrumentation_end().
+ */
+static inline void instrumentation_coarse_clock(const uint64_t &period_us) {
+  if (period_us == 0) {
+    std::cerr << "The TraCR coarse clock period has to be positive\n";
+    std::exit(EXIT_FAILURE);
+  }
+
+  tracrProc->start_coarse_clock(period_us);
+}
+
+/**
+ * Snapshot the buffers of all live TraCR threads into tracr/proc.N/snapshot.K/
+ * whenever signum arrives, without stopping them.
+ */
+static inline void instrumentation_snapshot_signal(const int &signum) {
+#if defined(TRACR_DISABLE_FLUSH) || defined(TRACR_POLICY_STREAMING) ||         \
+    defined(TRACR_POLICY_SEGMENTED)
+  // Either nothing is written, or the traces are written continuously
+  (void)signum;
+  std::cerr << "TraCR snapshots need the buffers to be flushed at the end, "
+               "which TRACR_DISABLE_FLUSH, TRACR_POLICY_STREAMING and "
+               "TRACR_POLICY_SEGMENTED don't\n";
+  std::exit(EXIT_FAILURE);
+#elif defined(TRACR_SINGLE_FILE)
+  // Snapshots are folders of their own
+  (void)signum;
+  std::cerr << "TraCR snapshots can't be taken with TRACR_SINGLE_FILE\n";
+  std::exit(EXIT_FAILURE);
+#else
+  tracrProc->start_snapshot_signal(signum);
+#endif
+}
+
+/**
+ * Write the events recorded by the calling thread so far as the next segment
+ * traces.<segment>.bts and continue with an empty buffer
+ */
+static inline void instrumentation_flush() {
+#ifdef TRACR_POLICY_SEGMENTED
+  if (!tracrThread) {
+    std::cerr << "TraCR Thread has not been initialized\n";
+    std::exit(EXIT_FAILURE);
+  }
+
+  tracrThread->next_segment();
+#else
+  std::cerr << "INSTRUMENTATION_FLUSH needs TRACR_POLICY_SEGMENTED\n";
+  std::exit(EXIT_FAILURE);
+#endif
+}
+
+/**
+ * Make every TraCR thread start a new segment at its first event after each
+ * period_ms
+ */
+static inline void instrumentation_auto_flush(const uint64_t &period_ms) {
+#ifdef TRACR_POLICY_SEGMENTED
+  if (period_ms == 0) {
+    std::cerr << "The TraCR auto-flush period has to be positive\n";
+    std::exit(EXIT_FAILURE);
+  }
+
+  tracrProc->getSegmentManager()->start_auto_flush(period_ms);
+  tracrProc->checkpoint_JSON();
+#else
+  (void)period_ms;
+  std::cerr << "INSTRUMENTATION_AUTO_FLUSH needs TRACR_POLICY_SEGMENTED\n";
+  std::exit(EXIT_FAILURE);
+#endif
+}
+
+/**
+ * Keep at most max_segments segments and max_bytes bytes of segments of this
+ * proc on disk by removing the oldest ones (0 means no bound)
+ */
+static inline void instrumentation_segment_rotation(const size_t &max_segments,
+                                                    const size_t &max_bytes) {
+#ifdef TRACR_POLICY_SEGMENTED
+  tracrProc->getSegmentManager()->set_rotation(max_segments, max_bytes);
+#else
+  (void)max_segments;
+  (void)max_bytes;
+  std::cerr << "INSTRUMENTATION_SEGMENT_ROTATION needs "
+               "TRACR_POLICY_SEGMENTED\n";
+  std::exit(EXIT_FAILURE);
+#endif
 }
 
 /**
@@ -338,7 +908,11 @@ static inline bool instrumentation_proc_exists() {
  *
  */
 static inline bool instrumentation_thread_exists() {
+#ifdef TRACR_PER_CPU
+  return tracr_thread_active;
+#else
   return (tracrThread != nullptr);
+#endif
 }
 
 /**
@@ -0,0 +1,774 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file trace_reader.hpp
+ * @brief Reading the .bts files, the per-CPU buffers and the containers
+ * @author Noah Andrés Baumann
+ * @date 16/10/2026
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sys/types.h> // pid_t
+#include <thread>
+#include <vector>
+
+#include <tracr/marker_management_engine.hpp>
+
+namespace fs = std::filesystem;
+
+/**
+ * What the header and trailer of a .bts file tell about it
+ */
+struct BtsFileInfo {
+  // Files of older TraCR versions have neither header nor trailer
+  bool legacy = false;
+  bool has_trailer = false;
+
+  TraCR::BtsHeader header{};
+  TraCR::BtsTrailer trailer{};
+  std::vector<TraCR::BtsEventCount> counts;
+
+  // Byte range of the records
+  size_t records_begin = 0;
+  size_t records_end = 0;
+
+  // With BTS_FLAG_COMPRESSED, the block index and where the block data starts
+  std::vector<TraCR::BtsBlock> blocks;
+  size_t blocks_begin = 0;
+};
+
+/**
+ * Reads the header and trailer of a bts file without touching its records.
+ * Rejects layouts this version of tracr_process can't read. A section of a
+ * container is a bts file of length bytes starting at base (the byte ranges
+ * in info are relative to base).
+ */
+inline bool read_bts_info(const fs::path &filepath, BtsFileInfo &info,
+                          uint64_t base = 0, uint64_t length = 0) {
+  std::ifstream ifs(filepath, std::ios::binary);
+  if (!ifs) {
+    std::cerr << "Failed to open file: " << filepath << "\n";
+    return false;
+  }
+
+  ifs.seekg(0, std::ios::end);
+  const size_t filesize =
+      (length > 0) ? length : static_cast<size_t>(ifs.tellg());
+  ifs.seekg(base);
+
+  info = BtsFileInfo{};
+
+  if (filesize < sizeof(TraCR::BtsHeader) ||
+      !ifs.read(reinterpret_cast<char *>(&info.header), sizeof(info.header)) ||
+      std::memcmp(info.header.magic, TraCR::BTS_MAGIC,
+                  sizeof(TraCR::BTS_MAGIC)) != 0) {
+    info.legacy = true;
+    info.records_end = filesize;
+    return true;
+  }
+
+  const TraCR::BtsHeader &header = info.header;
+
+  if (header.version > TraCR::BTS_VERSION) {
+    std::cerr << "  " << filepath << " has version " << header.version
+              << ", but this tracr_process only reads up to version "
+              << TraCR::BTS_VERSION << "\n";
+    return false;
+  }
+
+  size_t record_size = sizeof(TraCR::Payload);
+  if (header.payload_format ==
+      static_cast<uint8_t>(TraCR::BtsPayloadFormat::COMPACT)) {
+    record_size = sizeof(uint64_t);
+  } else if (header.payload_format ==
+             static_cast<uint8_t>(TraCR::BtsPayloadFormat::PER_CPU)) {
+    record_size = sizeof(TraCR::CpuRecord);
+  }
+
+  if (header.payload_format >
+          static_cast<uint8_t>(TraCR::BtsPayloadFormat::PER_CPU) ||
+      header.record_size != record_size ||
+      header.header_size < sizeof(TraCR::BtsHeader) ||
+      header.header_size > filesize) {
+    std::cerr << "  " << filepath << " has an unknown record layout (format "
+              << int(header.payload_format) << ", " << header.record_size
+              << " bytes per record)\n";
+    return false;
+  }
+
+  // A newer header of the same version only appended fields
+  info.records_begin = header.header_size;
+  info.records_end = filesize;
+
+  if (filesize >= info.records_begin + sizeof(TraCR::BtsTrailer)) {
+    ifs.seekg(base + filesize - sizeof(TraCR::BtsTrailer));
+    ifs.read(reinterpret_cast<char *>(&info.trailer), sizeof(info.trailer));
+
+    info.has_trailer =
+        ifs && std::memcmp(info.trailer.magic, TraCR::BTS_TRAILER_MAGIC,
+                           sizeof(TraCR::BTS_TRAILER_MAGIC)) == 0;
+  }
+
+  if (!info.has_trailer && (header.flags & TraCR::BTS_FLAG_MAPPED)) {
+    // The file was the buffer of a run that died, only the published records
+    // are valid. A wrapped periodic buffer starts at its oldest record.
+    const uint64_t published = header.published_records;
+    const uint64_t count = std::min<uint64_t>(
+        std::min<uint64_t>(published, header.capacity),
+        (filesize - info.records_begin) / record_size);
+
+    info.trailer = TraCR::BtsTrailer{};
+    info.trailer.num_records = count;
+    if (published > header.capacity) {
+      info.trailer.num_overwritten = published - header.capacity;
+      info.trailer.wrap_index = published % header.capacity;
+    }
+    info.records_end = info.records_begin + count * record_size;
+
+    std::cerr << "  Warning: " << filepath << " was not flushed, recovered "
+              << count << " published records\n";
+    return true;
+  }
+
+  const bool compressed = header.flags & TraCR::BTS_FLAG_COMPRESSED;
+
+  if (!info.has_trailer && compressed) {
+    std::cerr << "  " << filepath
+              << " has no trailer, its compressed records can't be read\n";
+    return false;
+  }
+
+  if (!info.has_trailer) {
+    std::cerr << "  Warning: " << filepath
+              << " has no trailer, it was not flushed completely\n";
+    info.trailer = TraCR::BtsTrailer{};
+    return true;
+  }
+
+  const size_t counts_bytes =
+      info.trailer.num_event_types * sizeof(TraCR::BtsEventCount);
+  size_t records_bytes = info.trailer.num_records * record_size;
+
+  // The blocks take what the event counts and the trailer leave
+  if (compressed && info.records_begin + counts_bytes +
+                            sizeof(TraCR::BtsTrailer) <=
+                        filesize) {
+    records_bytes = filesize - info.records_begin - counts_bytes -
+                    sizeof(TraCR::BtsTrailer);
+  }
+
+  if (info.records_begin + records_bytes + counts_bytes +
+          sizeof(TraCR::BtsTrailer) !=
+      filesize) {
+    std::cerr << "  " << filepath << " is inconsistent: the trailer holds "
+              << info.trailer.num_records << " records, but the file has "
+              << filesize << " bytes\n";
+    return false;
+  }
+
+  info.records_end = info.records_begin + records_bytes;
+
+  info.counts.resize(info.trailer.num_event_types);
+  ifs.seekg(base + info.records_end);
+  ifs.read(reinterpret_cast<char *>(info.counts.data()), counts_bytes);
+  if (!ifs) {
+    std::cerr << "Failed to read the event counts of: " << filepath << "\n";
+    return false;
+  }
+
+  if (!compressed) {
+    return true;
+  }
+
+  uint64_t num_blocks = 0;
+  ifs.seekg(base + info.records_begin);
+  ifs.read(reinterpret_cast<char *>(&num_blocks), sizeof(num_blocks));
+
+  const size_t index_bytes = sizeof(num_blocks) +
+                             std::min<uint64_t>(num_blocks, records_bytes) *
+                                 sizeof(TraCR::BtsBlock);
+  if (!ifs || index_bytes > records_bytes) {
+    std::cerr << "  " << filepath << " has a corrupt block index\n";
+    return false;
+  }
+
+  info.blocks.resize(num_blocks);
+  ifs.read(reinterpret_cast<char *>(info.blocks.data()),
+           num_blocks * sizeof(TraCR::BtsBlock));
+  info.blocks_begin = info.records_begin + index_bytes;
+
+  uint64_t raw_bytes = 0, stored_bytes = 0;
+  for (const auto &block : info.blocks) {
+    raw_bytes += block.raw_bytes;
+    stored_bytes += block.stored_bytes;
+  }
+
+  if (!ifs || index_bytes + stored_bytes != records_bytes ||
+      raw_bytes != info.trailer.num_records * record_size) {
+    std::cerr << "  " << filepath << " is inconsistent: its blocks don't add "
+              << "up to the " << info.trailer.num_records << " records\n";
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * Decompresses the blocks of a compressed bts file (the bytes of its records
+ * from records_begin on) into raw, using one thread per block up to the number
+ * of cores
+ */
+inline bool decompress_blocks(const fs::path &filepath, const BtsFileInfo &info,
+                              const std::vector<uint8_t> &bytes,
+                              std::vector<uint8_t> &raw) {
+  const size_t record_size = info.header.record_size;
+  const bool delta = info.header.payload_format ==
+                     static_cast<uint8_t>(TraCR::BtsPayloadFormat::STANDARD);
+
+  // Where the data and the records of each block start
+  std::vector<size_t> src(info.blocks.size()), dst(info.blocks.size());
+  size_t src_pos = info.blocks_begin - info.records_begin, dst_pos = 0;
+  for (size_t b = 0; b < info.blocks.size(); ++b) {
+    src[b] = src_pos;
+    dst[b] = dst_pos;
+    src_pos += info.blocks[b].stored_bytes;
+    dst_pos += info.blocks[b].raw_bytes;
+  }
+  raw.resize(dst_pos);
+
+  std::atomic<size_t> next{0};
+  std::atomic<bool> ok{true};
+  auto worker = [&]() {
+    for (size_t b = next++; b < info.blocks.size(); b = next++) {
+      if (!TraCR::BlockCodec::decompress(info.blocks[b], &bytes[src[b]],
+                                         &raw[dst[b]], record_size, delta)) {
+        ok = false;
+      }
+    }
+  };
+
+  const size_t num_threads = std::max<size_t>(
+      1, std::min<size_t>(std::thread::hardware_concurrency(),
+                          info.blocks.size()));
+  std::vector<std::thread> threads;
+  for (size_t t = 1; t < num_threads; ++t) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  if (!ok) {
+    std::cerr << "  " << filepath << " has a corrupt compressed block\n";
+    return false;
+  }
+
+  std::cout << "  Decompressed " << info.blocks.size() << " blocks ("
+            << bytes.size() << " -> " << raw.size() << " bytes) with "
+            << num_threads << " threads\n";
+
+  return true;
+}
+
+/**
+ * Reads the bytes of the records of a bts file described by info,
+ * decompressed if needed
+ */
+inline bool read_bts_records(const fs::path &filepath, const BtsFileInfo &info,
+                             uint64_t base, std::vector<uint8_t> &bytes) {
+  std::ifstream ifs(filepath, std::ios::binary);
+  if (!ifs) {
+    std::cerr << "Failed to open file: " << filepath << "\n";
+    return false;
+  }
+  ifs.seekg(base + info.records_begin);
+
+  bytes.resize(info.records_end - info.records_begin);
+  ifs.read(reinterpret_cast<char *>(bytes.data()), bytes.size());
+  if (!ifs) {
+    std::cerr << "Failed to read all data from file: " << filepath << "\n";
+    return false;
+  }
+
+  if (info.header.flags & TraCR::BTS_FLAG_COMPRESSED) {
+    std::vector<uint8_t> raw;
+    if (!decompress_blocks(filepath, info, bytes, raw)) {
+      return false;
+    }
+    bytes.swap(raw);
+  }
+
+  return true;
+}
+
+/**
+ * A function to load a bts file into a std::vector<Payload>. Files of
+ * TRACR_COMPACT_PAYLOAD builds are decoded into full payloads. For legacy
+ * files without a header, compact tells their layout. base and length select
+ * a section of a container (see read_bts_info()).
+ */
+inline bool load_bts_file(const fs::path &filepath,
+                          std::vector<TraCR::Payload> &traces, bool compact,
+                          uint64_t base = 0, uint64_t length = 0) {
+  BtsFileInfo info;
+  if (!read_bts_info(filepath, info, base, length)) {
+    return false;
+  }
+
+  if (!info.legacy) {
+    compact = info.header.payload_format ==
+              static_cast<uint8_t>(TraCR::BtsPayloadFormat::COMPACT);
+  }
+
+  if (info.trailer.num_overwritten > 0) {
+    std::cout << "  Flight recorder kept the last " << info.trailer.num_records
+              << " events, " << info.trailer.num_overwritten
+              << " older ones were overwritten\n";
+  }
+
+  // The trailer already tells there is nothing to read
+  if (!info.legacy &&
+      (info.has_trailer || info.header.flags & TraCR::BTS_FLAG_MAPPED) &&
+      info.trailer.num_records == 0) {
+    traces.clear();
+    return true;
+  }
+
+  std::vector<uint8_t> bytes;
+  if (!read_bts_records(filepath, info, base, bytes)) {
+    return false;
+  }
+
+  if (!compact) {
+    size_t count = bytes.size() / sizeof(TraCR::Payload);
+    traces.resize(count);
+    std::memcpy(traces.data(), bytes.data(), count * sizeof(TraCR::Payload));
+
+    // Records of a wrapped buffer that were not unwrapped on flush
+    if (info.trailer.wrap_index > 0 && info.trailer.wrap_index < count) {
+      std::rotate(traces.begin(), traces.begin() + info.trailer.wrap_index,
+                  traces.end());
+    }
+
+    return true;
+  }
+
+  std::vector<uint64_t> words(bytes.size() / sizeof(uint64_t));
+  std::memcpy(words.data(), bytes.data(), words.size() * sizeof(uint64_t));
+
+  // Most records are a single word
+  traces.clear();
+  traces.reserve(words.size());
+
+  uint64_t prev = 0;
+  size_t pos = 0;
+  while (pos < words.size()) {
+    TraCR::Payload payload;
+    size_t used = TraCR::CompactCodec::decode(&words[pos], words.size() - pos,
+                                              prev, payload);
+    if (used == 0) {
+      std::cerr << "  Warning: truncated record at the end of: " << filepath
+                << "\n";
+      break;
+    }
+
+    traces.push_back(payload);
+    pos += used;
+  }
+
+  std::cout << "  Decoded " << words.size() * sizeof(uint64_t)
+            << " bytes of compact records ("
+            << traces.size() * sizeof(TraCR::Payload)
+            << " bytes as payloads)\n";
+
+  return true;
+}
+
+/**
+ * The trace files of a thread folder in the order they were written: either
+ * traces.bts, or the segments traces.<segment>.bts of TRACR_POLICY_SEGMENTED
+ */
+inline std::vector<fs::path> thread_trace_files(const fs::path &thread_path) {
+  fs::path trace_file = thread_path / "traces.bts";
+  if (fs::exists(trace_file)) {
+    return {trace_file};
+  }
+
+  std::vector<std::pair<uint64_t, fs::path>> segments;
+  for (const auto &entry : fs::directory_iterator(thread_path)) {
+    const std::string name = entry.path().filename().string();
+    const std::string prefix = "traces.", suffix = ".bts";
+
+    if (name.size() <= prefix.size() + suffix.size() ||
+        name.compare(0, prefix.size(), prefix) != 0 ||
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) !=
+            0) {
+      continue;
+    }
+
+    const std::string index = name.substr(
+        prefix.size(), name.size() - prefix.size() - suffix.size());
+    if (index.find_first_not_of("0123456789") != std::string::npos) {
+      continue;
+    }
+
+    segments.push_back({std::stoull(index), entry.path()});
+  }
+
+  std::sort(segments.begin(), segments.end());
+
+  std::vector<fs::path> files;
+  for (const auto &segment : segments) {
+    files.push_back(segment.second);
+  }
+  return files;
+}
+
+/**
+ * Loads the buffers of the CPUs of a TRACR_PER_CPU proc (its cpu.<cpu>
+ * folders) and splits their records by thread. The events of a thread are
+ * ordered by timestamp, each one recorded on another CPU than the previous
+ * event gets a CPU payload in front, as with TRACR_CAPTURE_CPU.
+ */
+inline bool
+load_cpu_traces(const fs::path &proc_path,
+                std::map<pid_t, std::vector<TraCR::Payload>> &threads) {
+  // The events of each thread with the CPU they were recorded on
+  std::map<pid_t, std::vector<std::pair<uint32_t, TraCR::Payload>>> events;
+
+  for (const auto &cpu_entry : fs::directory_iterator(proc_path)) {
+    const std::string folder_name = cpu_entry.path().filename().string();
+    if (!cpu_entry.is_directory() || folder_name.find("cpu.") != 0) {
+      continue;
+    }
+
+    const fs::path trace_file = cpu_entry.path() / "traces.bts";
+    std::cout << "  Found trace file: " << trace_file << "\n";
+
+    BtsFileInfo info;
+    std::vector<uint8_t> bytes;
+    if (!read_bts_info(trace_file, info) ||
+        !read_bts_records(trace_file, info, 0, bytes)) {
+      std::cerr << "  Failed to load bts file: " << trace_file << "\n";
+      return false;
+    }
+
+    if (info.legacy ||
+        info.header.payload_format !=
+            static_cast<uint8_t>(TraCR::BtsPayloadFormat::PER_CPU)) {
+      std::cerr << "  " << trace_file << " holds no per-CPU records\n";
+      return false;
+    }
+
+    std::vector<TraCR::CpuRecord> records(bytes.size() /
+                                          sizeof(TraCR::CpuRecord));
+    std::memcpy(records.data(), bytes.data(),
+                records.size() * sizeof(TraCR::CpuRecord));
+
+    for (const auto &record : records) {
+      // A slot reserved by a thread that was still running
+      if (record.tid == 0) {
+        continue;
+      }
+      events[static_cast<pid_t>(record.tid)].push_back(
+          {info.header.cpu, record.payload});
+    }
+
+    std::cout << "Loaded " << records.size() << " records from "
+              << folder_name << "\n";
+  }
+
+  for (auto &[tid, thread_events] : events) {
+    // A thread's records of one CPU are in order, the CPUs are interleaved
+    std::stable_sort(thread_events.begin(), thread_events.end(),
+                     [](const auto &a, const auto &b) {
+                       return (a.second.timestamp &
+                               ~TraCR::COARSE_TIMESTAMP_FLAG) <
+                              (b.second.timestamp &
+                               ~TraCR::COARSE_TIMESTAMP_FLAG);
+                     });
+
+    std::vector<TraCR::Payload> &traces = threads[tid];
+    uint32_t last_cpu = UINT32_MAX;
+    for (const auto &[cpu, payload] : thread_events) {
+      if (cpu != last_cpu) {
+        traces.push_back({payload.channelId, TraCR::CPU_EVENT_ID, cpu,
+                          payload.timestamp});
+        last_cpu = cpu;
+      }
+      traces.push_back(payload);
+    }
+  }
+
+  return true;
+}
+
+/**
+ * Goes through all the thread folder and loads all the bts files from
+ * the given proc folder. The segments of a thread are concatenated. The
+ * records of the per-CPU buffers are split into their threads.
+ */
+inline int
+load_thread_traces(const fs::path &proc_path,
+                   std::vector<std::vector<TraCR::Payload>> &bts_files,
+                   std::vector<pid_t> &bts_tids, bool compact) {
+  size_t tot_num_traces = 0;
+  for (const auto &thread_entry : fs::directory_iterator(proc_path)) {
+
+    if (!thread_entry.is_directory())
+      continue;
+
+    const std::string folder_name = thread_entry.path().filename().string();
+
+    if (folder_name.find("thread.") != 0)
+      continue;
+
+    const std::vector<fs::path> trace_files =
+        thread_trace_files(thread_entry.path());
+
+    if (trace_files.empty()) {
+      std::cerr << "  No trace file in: " << thread_entry.path() << "\n";
+      return 1;
+    }
+
+    std::vector<TraCR::Payload> traces;
+
+    for (const auto &trace_file : trace_files) {
+      std::cout << "  Found trace file: " << trace_file << "\n";
+
+      std::vector<TraCR::Payload> segment;
+
+      if (!load_bts_file(trace_file, segment, compact)) {
+        std::cerr << "  Failed to load bts file: " << trace_file << "\n";
+        return 1;
+      }
+
+      traces.insert(traces.end(), segment.begin(), segment.end());
+    }
+
+    if (trace_files.size() > 1) {
+      std::cout << "  Concatenated " << trace_files.size() << " segments of "
+                << folder_name << "\n";
+    }
+
+    // Nothing to merge, e.g. a thread that only recorded before a flush
+    if (traces.empty()) {
+      std::cout << "  Skipping empty trace files of: " << folder_name << "\n";
+      continue;
+    }
+
+    tot_num_traces += traces.size();
+
+    std::cout << "Loaded " << traces.size() << " traces from " << folder_name
+              << "\n";
+
+    std::size_t dot_pos = folder_name.find('.');
+    if (dot_pos == std::string::npos) {
+      std::cerr << "  Invalid thread folder name: " << folder_name << "\n";
+      return 1;
+    }
+
+    pid_t tid;
+    try {
+      tid = std::stoi(folder_name.substr(dot_pos + 1));
+    } catch (const std::exception &) {
+      std::cerr << "  Error parsing TID in folder: " << folder_name << "\n";
+      return 1;
+    }
+
+    bts_files.push_back(std::move(traces));
+    bts_tids.push_back(tid);
+  }
+
+  std::map<pid_t, std::vector<TraCR::Payload>> cpu_threads;
+  if (!load_cpu_traces(proc_path, cpu_threads)) {
+    return 1;
+  }
+
+  for (auto &[tid, traces] : cpu_threads) {
+    std::cout << "Split " << traces.size() << " traces of thread." << tid
+              << " from the CPU buffers\n";
+
+    tot_num_traces += traces.size();
+    bts_files.push_back(std::move(traces));
+    bts_tids.push_back(tid);
+  }
+
+  std::cout << "Total number of traces: " << tot_num_traces << "\n";
+
+  return 0;
+}
+
+/**
+ * What the header, the section directory and the metadata of a container of
+ * TRACR_SINGLE_FILE tell about it
+ */
+struct ContainerInfo {
+  TraCR::ContainerHeader header{};
+  std::vector<TraCR::ContainerSection> sections;
+  std::string metadata;
+};
+
+/**
+ * Reads everything of a container except the trace sections, starting from
+ * the footer at its end
+ */
+inline bool read_container(const fs::path &filepath, ContainerInfo &info) {
+  std::ifstream ifs(filepath, std::ios::binary);
+  if (!ifs) {
+    std::cerr << "Failed to open file: " << filepath << "\n";
+    return false;
+  }
+
+  ifs.seekg(0, std::ios::end);
+  const size_t filesize = static_cast<size_t>(ifs.tellg());
+  ifs.seekg(0, std::ios::beg);
+
+  info = ContainerInfo{};
+
+  if (!ifs.read(reinterpret_cast<char *>(&info.header), sizeof(info.header)) ||
+      std::memcmp(info.header.magic, TraCR::CONTAINER_MAGIC,
+                  sizeof(TraCR::CONTAINER_MAGIC)) != 0) {
+    std::cerr << "  " << filepath << " is not a TraCR container\n";
+    return false;
+  }
+
+  if (info.header.version > TraCR::CONTAINER_VERSION) {
+    std::cerr << "  " << filepath << " has version " << info.header.version
+              << ", but this tracr_process only reads up to version "
+              << TraCR::CONTAINER_VERSION << "\n";
+    return false;
+  }
+
+  TraCR::ContainerFooter footer{};
+  if (filesize >= sizeof(info.header) + sizeof(footer)) {
+    ifs.seekg(filesize - sizeof(footer));
+    ifs.read(reinterpret_cast<char *>(&footer), sizeof(footer));
+  }
+
+  if (!ifs || std::memcmp(footer.magic, TraCR::CONTAINER_FOOTER_MAGIC,
+                          sizeof(TraCR::CONTAINER_FOOTER_MAGIC)) != 0) {
+    std::cerr << "  " << filepath
+              << " has no footer, INSTRUMENTATION_END() was not reached\n";
+    return false;
+  }
+
+  const size_t directory_bytes =
+      footer.num_sections * sizeof(TraCR::ContainerSection);
+  if (footer.directory_offset + directory_bytes + sizeof(footer) !=
+      filesize) {
+    std::cerr << "  " << filepath << " is inconsistent: the directory holds "
+              << footer.num_sections << " sections, but the file has "
+              << filesize << " bytes\n";
+    return false;
+  }
+
+  info.sections.resize(footer.num_sections);
+  ifs.seekg(footer.directory_offset);
+  ifs.read(reinterpret_cast<char *>(info.sections.data()), directory_bytes);
+  if (!ifs) {
+    std::cerr << "Failed to read the section directory of: " << filepath
+              << "\n";
+    return false;
+  }
+
+  for (const auto &section : info.sections) {
+    if (section.offset + section.size > footer.directory_offset) {
+      std::cerr << "  " << filepath << " has a section beyond its end\n";
+      return false;
+    }
+
+    if (section.kind ==
+        static_cast<uint32_t>(TraCR::ContainerSectionKind::METADATA)) {
+      info.metadata.resize(section.size);
+      ifs.seekg(section.offset);
+      ifs.read(info.metadata.data(), section.size);
+      if (!ifs) {
+        std::cerr << "Failed to read the metadata of: " << filepath << "\n";
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+/**
+ * Loads the metadata and the trace sections of a container, seeking straight
+ * to each section
+ */
+inline int load_container(const fs::path &filepath, nlohmann::json &metadata,
+                          std::vector<std::vector<TraCR::Payload>> &bts_files,
+                          std::vector<pid_t> &bts_tids) {
+  ContainerInfo info;
+  if (!read_container(filepath, info)) {
+    return 1;
+  }
+
+  try {
+    metadata = nlohmann::json::parse(info.metadata);
+    std::cout << "  Loaded the metadata section:\n";
+  } catch (const std::exception &e) {
+    std::cerr << "  Failed to parse JSON: " << e.what() << "\n";
+    return 1;
+  }
+
+  size_t tot_num_traces = 0;
+  for (const auto &section : info.sections) {
+    if (section.kind !=
+        static_cast<uint32_t>(TraCR::ContainerSectionKind::TRACES)) {
+      continue;
+    }
+
+    const std::string name = "thread." + std::to_string(section.tid);
+    std::cout << "  Found trace section of " << name << " at offset "
+              << section.offset << "\n";
+
+    std::vector<TraCR::Payload> traces;
+    if (!load_bts_file(filepath, traces, false, section.offset,
+                       section.size)) {
+      std::cerr << "  Failed to load the trace section of: " << name << "\n";
+      return 1;
+    }
+
+    if (traces.empty()) {
+      std::cout << "  Skipping empty trace section of: " << name << "\n";
+      continue;
+    }
+
+    tot_num_traces += traces.size();
+
+    std::cout << "Loaded " << traces.size() << " traces from " << name
+              << "\n";
+
+    bts_files.push_back(std::move(traces));
+    bts_tids.push_back(static_cast<pid_t>(section.tid));
+  }
+
+  std::cout << "Total number of traces: " << tot_num_traces << "\n";
+
+  return 0;
+}
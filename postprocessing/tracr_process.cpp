@@ -14,9 +14,12 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <queue>
 #include <sstream>
 #include <unordered_map>
@@ -25,6 +28,8 @@
 
 #include <tracr/marker_management_engine.hpp>
 
+#include "trace_reader.hpp"
+
 namespace fs = std::filesystem;
 
 constexpr const char PARAVER_HEADER[] = "DEFAULT_OPTIONS\n\n"
@@ -68,10 +73,15 @@ constexpr const char PARAVER_HEADER[] = "DEFAULT_OPTIONS\n\n"
                                         "0 90         TraCR\n"
                                         "VALUES\n";
 
+/**
+ * The Paraver event type of the CPU payloads
+ */
+constexpr int PARAVER_CPU_EVENT_TYPE = 91;
+
 /**
  * Type of tracr file processing format
  */
-enum class Format { PARAVER, DUMP, PERFETTO };
+enum class Format { PARAVER, DUMP, PERFETTO, SUMMARY };
 
 /**
  * string to enum format for switch case
@@ -81,6 +91,8 @@ Format parseFormat(const std::string &format) {
     return Format::PARAVER;
   if (format == "dump")
     return Format::DUMP;
+  if (format == "summary")
+    return Format::SUMMARY;
   return Format::PERFETTO; // default
 }
 
@@ -142,96 +154,6 @@ public:
   }
 };
 
-/**
- * A function to load a bts file into a std::vector<Payload>
- */
-bool load_bts_file(const fs::path &filepath,
-                   std::vector<TraCR::Payload> &traces) {
-  std::ifstream ifs(filepath, std::ios::binary);
-  if (!ifs) {
-    std::cerr << "Failed to open file: " << filepath << "\n";
-    return false;
-  }
-
-  ifs.seekg(0, std::ios::end);
-  std::streamsize filesize = ifs.tellg();
-  ifs.seekg(0, std::ios::beg);
-
-  size_t count = filesize / sizeof(TraCR::Payload);
-  traces.resize(count);
-
-  ifs.read(reinterpret_cast<char *>(traces.data()),
-           count * sizeof(TraCR::Payload));
-  if (!ifs) {
-    std::cerr << "Failed to read all data from file: " << filepath << "\n";
-    return false;
-  }
-
-  return true;
-}
-
-/**
- * Goes through all the thread folder and loads all the bts files from
- * the given proc folder
- */
-int load_thread_traces(const fs::path &proc_path,
-                       std::vector<std::vector<TraCR::Payload>> &bts_files,
-                       std::vector<pid_t> &bts_tids) {
-  size_t tot_num_traces = 0;
-  for (const auto &thread_entry : fs::directory_iterator(proc_path)) {
-
-    if (!thread_entry.is_directory())
-      continue;
-
-    const std::string folder_name = thread_entry.path().filename().string();
-
-    if (folder_name.find("thread.") != 0)
-      continue;
-
-    fs::path trace_file = thread_entry.path() / "traces.bts";
-
-    if (!fs::exists(trace_file)) {
-      std::cerr << "  No trace file in: " << thread_entry.path() << "\n";
-      return 1;
-    }
-
-    std::cout << "  Found trace file: " << trace_file << "\n";
-
-    std::vector<TraCR::Payload> traces;
-
-    if (!load_bts_file(trace_file, traces)) {
-      std::cerr << "  Failed to load bts file: " << trace_file << "\n";
-      return 1;
-    }
-
-    tot_num_traces += traces.size();
-
-    std::cout << "Loaded " << traces.size() << " traces from " << trace_file
-              << "\n";
-
-    std::size_t dot_pos = folder_name.find('.');
-    if (dot_pos == std::string::npos) {
-      std::cerr << "  Invalid thread folder name: " << folder_name << "\n";
-      return 1;
-    }
-
-    pid_t tid;
-    try {
-      tid = std::stoi(folder_name.substr(dot_pos + 1));
-    } catch (const std::exception &) {
-      std::cerr << "  Error parsing TID in folder: " << folder_name << "\n";
-      return 1;
-    }
-
-    bts_files.push_back(std::move(traces));
-    bts_tids.push_back(tid);
-  }
-
-  std::cout << "Total number of traces: " << tot_num_traces << "\n";
-
-  return 0;
-}
-
 /**
  *
  */
@@ -267,11 +189,47 @@ int extract_bts_metadata(std::vector<std::vector<TraCR::Payload>> &bts_files,
                          std::vector<pid_t> &bts_tids, nlohmann::json &metadata,
                          const fs::path base_path, int &pid) {
 
+  // A snapshot folder (tracr/proc.N/snapshot.K/) is laid out like a proc
+  // folder, its pid is the one of the enclosing proc folder
+  if (fs::exists(base_path / "metadata.json")) {
+    fs::path folder = base_path;
+    if (folder.filename().empty()) {
+      folder = folder.parent_path();
+    }
+    const std::string proc_name =
+        fs::absolute(folder).parent_path().filename().string();
+
+    std::cout << "Found snapshot folder: " << base_path << "\n";
+
+    try {
+      pid = std::stoi(proc_name.substr(proc_name.find('.') + 1));
+    } catch (const std::exception &e) {
+      std::cerr << "  Error parsing PID of folder: " << proc_name << "\n";
+      return 1;
+    }
+
+    if (load_metadata_json(base_path, metadata) != 0) {
+      return 1;
+    }
+
+    if (load_thread_traces(base_path, bts_files, bts_tids, false) != 0) {
+      std::cerr << "Error: load_thread_traces() failed.\n";
+      return 1;
+    }
+
+    return 0;
+  }
+
   bool proc_folder_found = false;
   for (const auto &proc_entry : fs::directory_iterator(base_path)) {
-    if (proc_entry.is_directory() &&
+    // The single file of a TRACR_SINGLE_FILE proc
+    const bool container = proc_entry.is_regular_file() &&
+                           proc_entry.path().extension() == ".tracr";
+
+    if ((proc_entry.is_directory() || container) &&
         proc_entry.path().filename().string().find("proc.") == 0) {
-      std::cout << "Found proc folder: " << proc_entry.path() << "\n";
+      std::cout << "Found proc " << (container ? "container" : "folder")
+                << ": " << proc_entry.path() << "\n";
 
       if (proc_folder_found) {
         std::cerr << "Error: Currently, having more than one proc folder is "
@@ -292,11 +250,26 @@ int extract_bts_metadata(std::vector<std::vector<TraCR::Payload>> &bts_files,
         }
       }
 
+      if (container) {
+        if (load_container(proc_entry.path(), metadata, bts_files,
+                           bts_tids) != 0) {
+          std::cerr << "Error: load_container() failed.\n";
+          return 1;
+        }
+        continue;
+      }
+
       if (load_metadata_json(proc_entry.path(), metadata) != 0) {
         return 1;
       }
 
-      if (load_thread_traces(proc_entry.path(), bts_files, bts_tids) != 0) {
+      // Older metadata has no payload_format
+      bool compact =
+          metadata.value("payload_format", std::string("standard")) ==
+          "compact";
+
+      if (load_thread_traces(proc_entry.path(), bts_files, bts_tids,
+                             compact) != 0) {
         std::cerr << "Error: load_thread_traces() failed.\n";
         return 1;
       }
@@ -311,6 +284,236 @@ int extract_bts_metadata(std::vector<std::vector<TraCR::Payload>> &bts_files,
   return 0;
 }
 
+/**
+ * Converts counter ticks into CLOCK_MONOTONIC_RAW nanoseconds, anchored at the
+ * reference pair. The 128-bit intermediate can't overflow for any uptime.
+ */
+static uint64_t ticks_to_ns(uint64_t ticks, uint64_t freq, uint64_t ref_ticks,
+                            uint64_t ref_ns) {
+  if (ticks >= ref_ticks) {
+    return ref_ns + static_cast<uint64_t>(
+                        static_cast<unsigned __int128>(ticks - ref_ticks) *
+                        1'000'000'000ULL / freq);
+  }
+
+  return ref_ns - static_cast<uint64_t>(
+                      static_cast<unsigned __int128>(ref_ticks - ticks) *
+                      1'000'000'000ULL / freq);
+}
+
+/**
+ * Timestamps of the coarse clock carry TraCR::COARSE_TIMESTAMP_FLAG. Strips the
+ * flag and reports the precision of these events. As the coarse clock lags
+ * behind by up to one period, they are clamped to the previous timestamp of
+ * their thread to keep each thread's traces sorted.
+ */
+int strip_coarse_timestamps(std::vector<std::vector<TraCR::Payload>> &bts_files,
+                            const std::vector<pid_t> &bts_tids,
+                            const nlohmann::json &metadata) {
+  size_t total = 0;
+
+  for (size_t i = 0; i < bts_files.size(); ++i) {
+    uint64_t prev = 0;
+    size_t count = 0;
+
+    for (auto &payload : bts_files[i]) {
+      if (payload.timestamp & TraCR::COARSE_TIMESTAMP_FLAG) {
+        payload.timestamp &= ~TraCR::COARSE_TIMESTAMP_FLAG;
+        payload.timestamp = std::max(payload.timestamp, prev);
+        ++count;
+      }
+      prev = payload.timestamp;
+    }
+
+    if (count > 0) {
+      std::cout << "  Thread[" << bts_tids[i] << "]: " << count
+                << " coarse timestamps\n";
+    }
+    total += count;
+  }
+
+  if (total == 0) {
+    return 0;
+  }
+
+  if (!metadata.contains("coarse_clock")) {
+    std::cerr << "WARNING: " << total
+              << " coarse timestamps but the coarse clock was never started "
+                 "(INSTRUMENTATION_COARSE_CLOCK()).\n";
+    return 0;
+  }
+
+  const nlohmann::json &coarse_clock = metadata["coarse_clock"];
+  std::cout << total << " coarse timestamps with a precision of "
+            << coarse_clock["period_us"] << " us";
+  if (coarse_clock["ticks"] > 0) {
+    std::cout << " (measured: " << coarse_clock["mean_period_ns"] << " ns)";
+  }
+  std::cout << "\n";
+
+  return 0;
+}
+
+/**
+ * Linear interpolation (and extrapolation) through (x0, y0) and (x1, y1)
+ */
+static uint64_t interpolate(uint64_t x0, uint64_t y0, uint64_t x1, uint64_t y1,
+                            uint64_t x) {
+  __int128 dx = static_cast<__int128>(x) - static_cast<__int128>(x0);
+  __int128 dy = static_cast<__int128>(y1) - static_cast<__int128>(y0);
+  __int128 span = static_cast<__int128>(x1) - static_cast<__int128>(x0);
+
+  return static_cast<uint64_t>(static_cast<__int128>(y0) + dx * dy / span);
+}
+
+/**
+ * Piecewise-linear mapping of the payload timestamps onto CLOCK_MONOTONIC_RAW
+ * (and CLOCK_REALTIME), fitted through the clock synchronization points of the
+ * metadata. Timestamps outside of the points are extrapolated with the first
+ * or last segment.
+ */
+class ClockMapping {
+public:
+  struct Point {
+    uint64_t stamp;
+    uint64_t monotonic_raw;
+    uint64_t realtime;
+  };
+
+  // Points closer than this to the previous one are merged, as the slope of
+  // such a short segment would mostly consist of clock read noise
+  static constexpr uint64_t MIN_SEGMENT_NS = 10'000'000;
+
+  explicit ClockMapping(const nlohmann::json &clock_sync) {
+    for (const auto &entry : clock_sync) {
+      Point point{entry["stamp"], entry["monotonic_raw"], entry["realtime"]};
+
+      if (!_points.empty()) {
+        const Point &prev = _points.back();
+        if (point.stamp <= prev.stamp ||
+            point.monotonic_raw <= prev.monotonic_raw) {
+          continue;
+        }
+
+        // Keep the first and the last point, drop the ones in between that
+        // are too close
+        if (point.monotonic_raw - prev.monotonic_raw < MIN_SEGMENT_NS &&
+            _points.size() > 1) {
+          _points.back() = point;
+          continue;
+        }
+      }
+
+      _points.push_back(point);
+    }
+  }
+
+  // Number of linear segments
+  size_t segments() const {
+    return _points.size() < 2 ? 0 : _points.size() - 1;
+  }
+
+  uint64_t to_monotonic_raw(uint64_t stamp) const {
+    const size_t i = segment_of(stamp);
+    return interpolate(_points[i].stamp, _points[i].monotonic_raw,
+                       _points[i + 1].stamp, _points[i + 1].monotonic_raw,
+                       stamp);
+  }
+
+  uint64_t to_realtime(uint64_t stamp) const {
+    const size_t i = segment_of(stamp);
+    return interpolate(_points[i].stamp, _points[i].realtime,
+                       _points[i + 1].stamp, _points[i + 1].realtime, stamp);
+  }
+
+private:
+  size_t segment_of(uint64_t stamp) const {
+    auto it = std::upper_bound(
+        _points.begin(), _points.end(), stamp,
+        [](uint64_t value, const Point &p) { return value < p.stamp; });
+
+    size_t idx = (it == _points.begin()) ? 0 : (it - _points.begin()) - 1;
+    return std::min(idx, _points.size() - 2);
+  }
+
+  std::vector<Point> _points;
+};
+
+/**
+ * Brings all timestamps onto CLOCK_MONOTONIC_RAW nanoseconds.
+ *
+ * If the metadata holds at least two clock synchronization points, the
+ * piecewise-linear fit through them is used (correcting counter drift).
+ * Otherwise traces recorded with TRACR_RAW_TIMESTAMPS are converted with the
+ * counter frequency and the reference pair.
+ */
+int convert_timestamps(std::vector<std::vector<TraCR::Payload>> &bts_files,
+                       const nlohmann::json &metadata) {
+  if (metadata.contains("clock_sync")) {
+    ClockMapping mapping(metadata["clock_sync"]);
+
+    if (mapping.segments() > 0) {
+      std::cout << "Mapping timestamps onto CLOCK_MONOTONIC_RAW with "
+                << mapping.segments() << " segment(s)\n";
+
+      uint64_t first_stamp = UINT64_MAX;
+      for (auto &traces : bts_files) {
+        if (!traces.empty()) {
+          first_stamp = std::min(first_stamp, traces.front().timestamp);
+        }
+      }
+
+      if (first_stamp != UINT64_MAX) {
+        uint64_t realtime = mapping.to_realtime(first_stamp);
+        std::cout << "First event at CLOCK_REALTIME: "
+                  << realtime / 1'000'000'000ULL << "." << std::setw(9)
+                  << std::setfill('0') << realtime % 1'000'000'000ULL
+                  << std::setfill(' ') << "\n";
+      }
+
+      for (auto &traces : bts_files) {
+        for (auto &payload : traces) {
+          payload.timestamp = mapping.to_monotonic_raw(payload.timestamp);
+        }
+      }
+
+      return 0;
+    }
+  }
+
+  if (!metadata.contains("timer") || !metadata["timer"].contains("unit") ||
+      metadata["timer"]["unit"] != "ticks") {
+    return 0; // Already in nanoseconds
+  }
+
+  const nlohmann::json &timer = metadata["timer"];
+  if (!timer.contains("frequency") || !timer.contains("reference")) {
+    std::cerr << "Error: timestamps are in ticks but the metadata has no "
+                 "counter frequency or reference.\n";
+    return 1;
+  }
+
+  const uint64_t freq = timer["frequency"];
+  const uint64_t ref_ticks = timer["reference"]["ticks"];
+  const uint64_t ref_ns = timer["reference"]["ns"];
+
+  if (freq == 0) {
+    std::cerr << "Error: counter frequency in the metadata is zero.\n";
+    return 1;
+  }
+
+  std::cout << "Converting ticks into ns (frequency: " << freq << " Hz)\n";
+
+  for (auto &traces : bts_files) {
+    for (auto &payload : traces) {
+      payload.timestamp =
+          ticks_to_ns(payload.timestamp, freq, ref_ticks, ref_ns);
+    }
+  }
+
+  return 0;
+}
+
 /**
  * Store the state.cfg in the given tracr folder
  */
@@ -356,6 +559,16 @@ int create_tracr_pcf(const fs::path &base_path,
     }
   }
 
+  // Event type of the CPU payloads (TRACR_CAPTURE_CPU), value = cpu + 1
+  if (metadata.contains("cpu_sockets")) {
+    out << "\n\nEVENT_TYPE\n"
+        << "0 " << PARAVER_CPU_EVENT_TYPE << "         CPU\n"
+        << "VALUES\n";
+    for (size_t cpu = 0; cpu < metadata["cpu_sockets"].size(); ++cpu) {
+      out << (cpu + 1) << "   CPU " << cpu << "\n";
+    }
+  }
+
   out.close();
   std::cout << "tracr.pcf written successfully.\n";
 
@@ -443,6 +656,13 @@ int create_tracr_prv(const fs::path &base_path, const nlohmann::json &metadata,
       start_time = payload.timestamp;
     }
 
+    if (payload.eventId == TraCR::CPU_EVENT_ID) {
+      out << "2:0:1:1:" << payload.channelId + 1 << ":"
+          << (payload.timestamp - start_time) << ":" << PARAVER_CPU_EVENT_TYPE
+          << ":" << payload.extraId + 1 << "\n";
+      continue;
+    }
+
     std::string colorId;
 
     if (!markerTypes_keys.empty()) {
@@ -618,6 +838,15 @@ int perfetto(const std::vector<std::vector<TraCR::Payload>> &bts_files,
       return 1;
     }
 
+    // CPU payloads become a counter track per channel
+    if (payload.eventId == TraCR::CPU_EVENT_ID) {
+      out << ",\n{\"name\":\"CPU of channel " << (channelId + 1)
+          << "\",\"ph\":\"C\",\"ts\":" << fmt_us(payload.timestamp - start_time)
+          << ",\"pid\":" << pid << ",\"args\":{\"cpu\":" << payload.extraId
+          << "}}";
+      continue;
+    }
+
     if (prev_payloads[channelId].eventId != UINT16_MAX) {
       const TraCR::Payload &prev = prev_payloads[channelId];
       std::string mType = (!markerTypes_values.empty())
@@ -650,17 +879,51 @@ int perfetto(const std::vector<std::vector<TraCR::Payload>> &bts_files,
  * Dump trace info to terminal
  */
 int dump_info(const std::vector<std::vector<TraCR::Payload>> &bts_files,
-              const std::vector<pid_t> &bts_tids, const fs::path base_path) {
+              const std::vector<pid_t> &bts_tids,
+              const nlohmann::json &metadata, const fs::path base_path) {
 
   std::unordered_map<uint16_t, int32_t> channelIds_check;
   std::unordered_map<uint16_t, std::unordered_set<uint32_t>> extraIds_check;
 
+  // CPU payloads (TRACR_CAPTURE_CPU): migrations per channel, across sockets
+  std::vector<uint32_t> last_cpu(bts_files.size(), UINT32_MAX);
+  std::map<uint16_t, size_t> migrations, socket_migrations;
+
+  auto socket_of = [&](uint32_t cpu) -> int {
+    if (!metadata.contains("cpu_sockets") ||
+        cpu >= metadata["cpu_sockets"].size()) {
+      return -1;
+    }
+    return metadata["cpu_sockets"][cpu];
+  };
+
   std::cout << "Thread[x]: [channelId, eventId, extraId, timestamp]\n";
 
   PayloadMerger merger(bts_files);
   while (!merger.empty()) {
     auto [payload, index] = merger.next();
 
+    if (payload.eventId == TraCR::CPU_EVENT_ID) {
+      const uint32_t prev = last_cpu[index];
+      std::cout << "Thread[" << bts_tids[index] << "]: on CPU "
+                << payload.extraId << " at " << payload.timestamp;
+
+      if (prev != UINT32_MAX) {
+        std::cout << " (migrated from CPU " << prev << ")";
+        ++migrations[payload.channelId];
+
+        if (socket_of(prev) != socket_of(payload.extraId)) {
+          ++socket_migrations[payload.channelId];
+          std::cout << " (WARNING: socket " << socket_of(prev) << " -> "
+                    << socket_of(payload.extraId) << ")";
+        }
+      }
+      std::cout << "\n";
+
+      last_cpu[index] = payload.extraId;
+      continue;
+    }
+
     std::cout << "Thread[" << bts_tids[index] << "]: [" << payload.channelId
               << ", " << payload.eventId << ", " << payload.extraId << ", "
               << payload.timestamp << "]\n";
@@ -681,6 +944,15 @@ int dump_info(const std::vector<std::vector<TraCR::Payload>> &bts_files,
     }
   }
 
+  if (!migrations.empty()) {
+    std::cout << "\nThread migrations per channel: {channelId, migrations, "
+                 "across sockets}\n";
+    for (const auto &[channelId, count] : migrations) {
+      std::cout << "{" << channelId << ", " << count << ", "
+                << socket_migrations[channelId] << "}\n";
+    }
+  }
+
   std::cout << "\nChannels which do not follow Push/Pop methology: {channelId, "
                "count}\n";
   for (const auto &[key, value] : channelIds_check) {
@@ -705,6 +977,179 @@ int dump_info(const std::vector<std::vector<TraCR::Payload>> &bts_files,
   return 0;
 }
 
+/**
+ * Prints what the header and trailer of one bts file tell about it
+ */
+bool summarize_bts_file(const fs::path &trace_file, const std::string &label,
+                        const nlohmann::json &marker_types, uint64_t base = 0,
+                        uint64_t length = 0) {
+  static const char *POLICY_NAMES[] = {"abort", "periodic", "ignore_if_full",
+                                       "streaming", "segmented"};
+  static const char *FORMAT_NAMES[] = {"standard", "compact", "per-CPU"};
+
+  BtsFileInfo info;
+  if (!read_bts_info(trace_file, info, base, length)) {
+    return false;
+  }
+
+  std::cout << "  " << label << ": ";
+
+  if (info.legacy) {
+    std::cout << "legacy file without header, " << info.records_end
+              << " bytes\n";
+    return true;
+  }
+
+  const TraCR::BtsHeader &header = info.header;
+  const TraCR::BtsTrailer &trailer = info.trailer;
+  const char *unit =
+      (header.flags & TraCR::BTS_FLAG_RAW_TIMESTAMPS) ? "ticks" : "ns";
+
+  std::cout << "version " << header.version << ", "
+            << FORMAT_NAMES[header.payload_format] << " records, "
+            << (header.policy < 5 ? POLICY_NAMES[header.policy] : "?")
+            << " policy, capacity " << header.capacity << " records\n";
+
+  if (!info.has_trailer && (header.flags & TraCR::BTS_FLAG_MAPPED)) {
+    std::cout << "    not flushed, " << trailer.num_records
+              << " published records recoverable\n";
+    return true;
+  }
+
+  if (!info.has_trailer) {
+    std::cout << "    no trailer, "
+              << (info.records_end - info.records_begin)
+              << " bytes of records\n";
+    return true;
+  }
+
+  if (!info.blocks.empty()) {
+    const size_t stored = info.records_end - info.records_begin;
+    const size_t raw = trailer.num_records * header.record_size;
+    std::cout << "    compressed into " << info.blocks.size() << " blocks, "
+              << stored << " of " << raw << " bytes (ratio "
+              << (stored > 0 ? double(raw) / stored : 0.0) << ")\n";
+  }
+
+  std::cout << "    " << trailer.num_events << " events in "
+            << trailer.num_records << " records, timestamps ["
+            << trailer.min_timestamp << ", " << trailer.max_timestamp
+            << "] " << unit << "\n";
+
+  if (trailer.num_dropped > 0 || trailer.num_overwritten > 0) {
+    std::cout << "    lost events: " << trailer.num_dropped
+              << " dropped, " << trailer.num_overwritten
+              << " overwritten\n";
+  }
+
+  for (const auto &entry : info.counts) {
+    std::string name;
+    if (entry.eventId == UINT16_MAX) {
+      name = "reset";
+    } else if (entry.eventId == TraCR::CPU_EVENT_ID) {
+      name = "cpu";
+    } else {
+      name = marker_types.value(std::to_string(entry.eventId),
+                                std::string("?"));
+    }
+    std::cout << "    event " << entry.eventId << " (" << name
+              << "): " << entry.count << "\n";
+  }
+
+  return true;
+}
+
+/**
+ * Prints what the section directory of a container and the headers and
+ * trailers of its trace sections tell
+ */
+int summarize_container(const fs::path &filepath) {
+  ContainerInfo info;
+  if (!read_container(filepath, info)) {
+    return 1;
+  }
+
+  std::cout << filepath.filename().string() << ": " << info.sections.size()
+            << " sections\n";
+
+  nlohmann::json metadata = nlohmann::json::parse(info.metadata, nullptr,
+                                                  false);
+  if (!metadata.is_object()) {
+    metadata = nlohmann::json::object();
+  }
+  const nlohmann::json marker_types =
+      metadata.value("markerTypes", nlohmann::json::object());
+
+  for (const auto &section : info.sections) {
+    if (section.kind !=
+        static_cast<uint32_t>(TraCR::ContainerSectionKind::TRACES)) {
+      continue;
+    }
+
+    if (!summarize_bts_file(filepath, "thread." + std::to_string(section.tid),
+                            marker_types, section.offset, section.size)) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Prints what the headers and trailers of the bts files tell, without loading
+ * any of their records
+ */
+int summary(const fs::path &base_path) {
+  for (const auto &proc_entry : fs::directory_iterator(base_path)) {
+    if (proc_entry.is_regular_file() &&
+        proc_entry.path().extension() == ".tracr") {
+      if (summarize_container(proc_entry.path()) != 0) {
+        return 1;
+      }
+      continue;
+    }
+
+    if (!proc_entry.is_directory() ||
+        proc_entry.path().filename().string().find("proc.") != 0) {
+      continue;
+    }
+
+    std::cout << proc_entry.path().filename().string() << ":\n";
+
+    // Only needed for the names of the event types
+    nlohmann::json metadata;
+    if (load_metadata_json(proc_entry.path(), metadata) != 0) {
+      metadata = nlohmann::json::object();
+    }
+    const nlohmann::json marker_types =
+        metadata.value("markerTypes", nlohmann::json::object());
+
+    for (const auto &thread_entry : fs::directory_iterator(proc_entry)) {
+      const std::string folder_name = thread_entry.path().filename().string();
+
+      // The buffers of the CPUs of TRACR_PER_CPU are summarized as they are
+      if (!thread_entry.is_directory() || (folder_name.find("thread.") != 0 &&
+                                           folder_name.find("cpu.") != 0)) {
+        continue;
+      }
+
+      for (const auto &trace_file : thread_trace_files(thread_entry.path())) {
+        // Segments are labeled with their file name
+        std::string label = folder_name;
+        if (trace_file.filename() != "traces.bts") {
+          label += "/" + trace_file.filename().string();
+        }
+
+        if (!summarize_bts_file(trace_file, label, marker_types)) {
+          return 1;
+        }
+      }
+    }
+  }
+
+  return 0;
+}
+
 /**
  *  The main function to transform bts files into readable files
  *
@@ -718,11 +1163,15 @@ int dump_info(const std::vector<std::vector<TraCR::Payload>> &bts_files,
  *
  *  3. Dump traces and informations directly in the terminal (for debugging):
  *    - ./tracr_process <path-to-tracr/> dump
+ *
+ *  4. Summarize the headers and trailers of the bts files:
+ *    - ./tracr_process <path-to-tracr/> summary
  */
 int main(int argc, char *argv[]) {
   if (argc < 2 || argc > 3) {
     std::cerr << "Usage: " << argv[0] << " <folder_path>\n OR " << argv[0]
-              << " <folder_path>" << "<'perfetto'|'paraver'|'dump'>\n";
+              << " <folder_path>"
+              << "<'perfetto'|'paraver'|'dump'|'summary'>\n";
     return 1;
   }
 
@@ -738,6 +1187,15 @@ int main(int argc, char *argv[]) {
     format = argv[2];
   }
 
+  // The summary only needs the headers and trailers
+  if (parseFormat(format) == Format::SUMMARY) {
+    if (summary(base_path) != 0) {
+      std::cerr << "summary() failed\n";
+      return 1;
+    }
+    return 0;
+  }
+
   std::vector<std::vector<TraCR::Payload>> bts_files;
   std::vector<pid_t> bts_tids;
   nlohmann::json metadata;
@@ -749,6 +1207,16 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
+  if (strip_coarse_timestamps(bts_files, bts_tids, metadata) != 0) {
+    std::cerr << "strip_coarse_timestamps() failed\n";
+    return 1;
+  }
+
+  if (convert_timestamps(bts_files, metadata) != 0) {
+    std::cerr << "convert_timestamps() failed\n";
+    return 1;
+  }
+
   switch (parseFormat(format)) {
   case Format::PARAVER:
     if (paraver(bts_files, bts_tids, metadata, base_path, pid) != 0) {
@@ -757,11 +1225,13 @@ int main(int argc, char *argv[]) {
     }
     break;
   case Format::DUMP:
-    if (dump_info(bts_files, bts_tids, base_path) != 0) {
+    if (dump_info(bts_files, bts_tids, metadata, base_path) != 0) {
       std::cerr << "dump_info() failed\n";
       return 1;
     }
     break;
+  case Format::SUMMARY:
+    break;
   case Format::PERFETTO:
     if (perfetto(bts_files, bts_tids, metadata, base_path, pid) != 0) {
       std::cerr << "perfetto() failed\n";
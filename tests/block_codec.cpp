@@ -0,0 +1,215 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <tracr/bts_compression.hpp>
+
+#include "check.hpp"
+
+using TraCR::BlockCodec;
+using TraCR::BtsBlock;
+using TraCR::BtsBlockCodec;
+
+/**
+ * count records of recordSize bytes that compress well: repeated ids and
+ * timestamps growing by small steps in the last 8 bytes
+ */
+static std::vector<uint8_t> regular_records(size_t count, size_t recordSize) {
+  std::vector<uint8_t> records(count * recordSize);
+  uint64_t timestamp = 1'000'000'000;
+
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t *record = records.data() + i * recordSize;
+    for (size_t k = 0; k + sizeof(uint64_t) < recordSize; ++k) {
+      record[k] = static_cast<uint8_t>((i % 7) + k);
+    }
+
+    timestamp += 10 + i % 3;
+    std::memcpy(record + recordSize - sizeof(uint64_t), &timestamp,
+                sizeof(timestamp));
+  }
+  return records;
+}
+
+/**
+ * count records of random bytes, which don't compress
+ */
+static std::vector<uint8_t> random_records(size_t count, size_t recordSize) {
+  std::mt19937_64 rng(42);
+  std::vector<uint8_t> records(count * recordSize);
+  for (auto &byte : records) {
+    byte = static_cast<uint8_t>(rng());
+  }
+  return records;
+}
+
+/**
+ * Compress records handed over as the ranges [0, split) and [split, end),
+ * check that every block decompresses to the original records and return the
+ * block index
+ */
+static std::vector<BtsBlock> round_trip(const std::vector<uint8_t> &records,
+                                        size_t split, size_t recordSize,
+                                        bool delta) {
+  const std::string out =
+      BlockCodec::compress(records.data(), split, records.data() + split,
+                           records.size() - split, recordSize, delta);
+
+  uint64_t numBlocks;
+  CHECK(out.size() >= sizeof(numBlocks));
+  std::memcpy(&numBlocks, out.data(), sizeof(numBlocks));
+
+  std::vector<BtsBlock> index(numBlocks);
+  const size_t indexBytes = sizeof(BtsBlock) * numBlocks;
+  CHECK(out.size() >= sizeof(numBlocks) + indexBytes);
+  std::memcpy(index.data(), out.data() + sizeof(numBlocks), indexBytes);
+
+  const uint8_t *src = reinterpret_cast<const uint8_t *>(out.data()) +
+                       sizeof(numBlocks) + indexBytes;
+  const uint8_t *const srcEnd =
+      reinterpret_cast<const uint8_t *>(out.data()) + out.size();
+
+  std::vector<uint8_t> decoded(records.size());
+  size_t offset = 0;
+  for (const BtsBlock &block : index) {
+    CHECK(block.raw_bytes % recordSize == 0);
+    CHECK(offset + block.raw_bytes <= decoded.size());
+    CHECK(block.stored_bytes <= static_cast<size_t>(srcEnd - src));
+
+    CHECK(BlockCodec::decompress(block, src, decoded.data() + offset,
+                                 recordSize, delta));
+    src += block.stored_bytes;
+    offset += block.raw_bytes;
+  }
+
+  CHECK(src == srcEnd);
+  CHECK(offset == records.size());
+  CHECK(decoded == records);
+  return index;
+}
+
+/**
+ * Decompress a hand-written LZ stream into the 16 bytes of a block of 8-byte
+ * records
+ */
+static bool decompress(const std::vector<uint8_t> &stream) {
+  BtsBlock block{};
+  block.raw_bytes = 16;
+  block.stored_bytes = static_cast<uint32_t>(stream.size());
+  block.codec = static_cast<uint8_t>(BtsBlockCodec::SHUFFLE_LZ);
+
+  uint8_t dst[16];
+  return BlockCodec::decompress(block, stream.data(), dst, 8, false);
+}
+
+/*
+ * Records of all sizes TraCR writes survive compression, whether they are
+ * stored, compressed or cut into blocks, and corrupt blocks are rejected
+ */
+int main() {
+  const size_t recordSizes[] = {8, 16, 24};
+
+  for (size_t recordSize : recordSizes) {
+    for (bool delta : {false, true}) {
+      // Nothing to compress, no blocks
+      CHECK(round_trip({}, 0, recordSize, delta).empty());
+
+      // Fewer bytes than the LZ stage ever matches, as a single block
+      const size_t few = (BlockCodec::LAST_LITERALS + BlockCodec::MIN_MATCH) /
+                         recordSize;
+      for (size_t count = 1; count <= few + 1; ++count) {
+        CHECK(round_trip(regular_records(count, recordSize), 0, recordSize,
+                         delta)
+                  .size() == 1);
+      }
+
+      // Regular records compress, random ones fall back to STORED
+      const std::vector<uint8_t> regular = regular_records(4096, recordSize);
+      for (const BtsBlock &block :
+           round_trip(regular, regular.size(), recordSize, delta)) {
+        CHECK(block.codec == static_cast<uint8_t>(BtsBlockCodec::SHUFFLE_LZ));
+        CHECK(block.stored_bytes < block.raw_bytes);
+      }
+
+      const std::vector<uint8_t> random = random_records(4096, recordSize);
+      for (const BtsBlock &block :
+           round_trip(random, random.size(), recordSize, delta)) {
+        CHECK(block.codec == static_cast<uint8_t>(BtsBlockCodec::STORED));
+        CHECK(block.stored_bytes == block.raw_bytes);
+      }
+
+      // Three blocks of whole records, the ranges split inside the first and
+      // inside the second block
+      const size_t blockBytes =
+          TraCR::BTS_BLOCK_BYTES / recordSize * recordSize;
+      const size_t count = (2 * blockBytes + blockBytes / 2) / recordSize;
+      const std::vector<uint8_t> many = regular_records(count, recordSize);
+
+      for (size_t split : {recordSize, blockBytes - 3 * recordSize,
+                           blockBytes + 5 * recordSize, many.size()}) {
+        const std::vector<BtsBlock> index =
+            round_trip(many, split, recordSize, delta);
+        CHECK(index.size() == 3);
+        CHECK(index[0].raw_bytes == blockBytes);
+        CHECK(index[1].raw_bytes == blockBytes);
+        CHECK(index[2].raw_bytes == many.size() - 2 * blockBytes);
+      }
+    }
+  }
+
+  // One literal, a match of 8 bytes at offset 1 and 7 final literals
+  CHECK(decompress({0x14, 'a', 1, 0, 0x70, 1, 2, 3, 4, 5, 6, 7}));
+
+  // Offsets of 0 or before the start of the block
+  CHECK(!decompress({0x14, 'a', 0, 0, 0x70, 1, 2, 3, 4, 5, 6, 7}));
+  CHECK(!decompress({0x14, 'a', 2, 0, 0x70, 1, 2, 3, 4, 5, 6, 7}));
+
+  // Matches and literals beyond the end of the block
+  CHECK(!decompress({0x15, 'a', 1, 0, 0x70, 1, 2, 3, 4, 5, 6, 7}));
+  CHECK(!decompress({0x1f, 'a', 1, 0, 255, 0, 0x70, 1, 2, 3, 4, 5, 6, 7}));
+  CHECK(!decompress({0x14, 'a', 1, 0, 0x80, 1, 2, 3, 4, 5, 6, 7, 8}));
+
+  // Literals beyond the end of the data, a cut offset or length, and too few
+  // bytes in total
+  CHECK(!decompress({0x14, 'a', 1, 0, 0x70, 1, 2, 3}));
+  CHECK(!decompress({0x14, 'a', 1}));
+  CHECK(!decompress({0x1f, 'a', 1, 0}));
+  CHECK(!decompress({0x14, 'a', 1, 0}));
+  CHECK(!decompress({0xf0}));
+
+  // A STORED block of the wrong size, an unknown codec and a block that does
+  // not hold whole records
+  BtsBlock block{};
+  uint8_t data[24] = {};
+  uint8_t dst[24];
+  block.raw_bytes = 16;
+  block.stored_bytes = 8;
+  block.codec = static_cast<uint8_t>(BtsBlockCodec::STORED);
+  CHECK(!BlockCodec::decompress(block, data, dst, 8, false));
+
+  block.stored_bytes = 16;
+  block.codec = 7;
+  CHECK(!BlockCodec::decompress(block, data, dst, 8, false));
+
+  block.codec = static_cast<uint8_t>(BtsBlockCodec::SHUFFLE_LZ);
+  CHECK(!BlockCodec::decompress(block, data, dst, 24, false));
+
+  return 0;
+}
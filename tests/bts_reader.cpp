@@ -0,0 +1,273 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <trace_reader.hpp>
+#include <unistd.h> // getpid()
+
+#include "check.hpp"
+
+using TraCR::Payload;
+
+/**
+ * The header of a file of standard payloads with capacity records
+ */
+static TraCR::BtsHeader standard_header(uint64_t capacity) {
+  TraCR::BtsHeader header{};
+  std::memcpy(header.magic, TraCR::BTS_MAGIC, sizeof(header.magic));
+  header.version = TraCR::BTS_VERSION;
+  header.header_size = sizeof(TraCR::BtsHeader);
+  header.record_size = sizeof(Payload);
+  header.payload_format =
+      static_cast<uint8_t>(TraCR::BtsPayloadFormat::STANDARD);
+  header.capacity = capacity;
+  header.tid = 42;
+  return header;
+}
+
+/**
+ * count payloads with extraId first, first + 1, ... and rising timestamps
+ */
+static std::vector<Payload> payloads(size_t count, uint32_t first = 0) {
+  std::vector<Payload> records;
+  for (size_t i = 0; i < count; ++i) {
+    records.push_back({0, uint16_t(i % 2 ? UINT16_MAX : 1),
+                       uint32_t(first + i), 1000 + 10 * (first + i)});
+  }
+  return records;
+}
+
+/**
+ * Write a .bts file of the header (none if nullptr), the records and a trailer
+ * (none if nullptr). The event counts are taken from the records.
+ */
+static void write_bts(const fs::path &path, const TraCR::BtsHeader *header,
+                      const std::vector<Payload> &records,
+                      const TraCR::BtsTrailer *trailer) {
+  std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+  if (header != nullptr) {
+    ofs.write(reinterpret_cast<const char *>(header), header->header_size);
+  }
+  ofs.write(reinterpret_cast<const char *>(records.data()),
+            records.size() * sizeof(Payload));
+
+  if (trailer != nullptr) {
+    TraCR::BtsStats stats;
+    for (const auto &record : records) {
+      stats.add(record.eventId, record.timestamp);
+    }
+    ofs << TraCR::bts_trailer_bytes(stats, *trailer);
+  }
+  CHECK(ofs.good());
+}
+
+/**
+ * The trailer of a flushed file of num_records records
+ */
+static TraCR::BtsTrailer trailer_of(uint64_t num_records) {
+  TraCR::BtsTrailer trailer{};
+  trailer.num_records = num_records;
+  return trailer;
+}
+
+/**
+ * Check that traces are exactly the expected payloads
+ */
+static void check_traces(const std::vector<Payload> &traces,
+                         const std::vector<Payload> &expected) {
+  CHECK(traces.size() == expected.size());
+  for (size_t i = 0; i < traces.size(); ++i) {
+    CHECK(traces[i].extraId == expected[i].extraId);
+    CHECK(traces[i].eventId == expected[i].eventId);
+    CHECK(traces[i].timestamp == expected[i].timestamp);
+  }
+}
+
+/*
+ * The header and trailer of .bts files as read by tracr_process: flushed,
+ * legacy, unflushed and extended files are read, files of a newer version,
+ * an unknown layout or an inconsistent trailer are rejected
+ */
+int main() {
+  const fs::path dir = fs::temp_directory_path() /
+                       ("tracr_bts_reader." + std::to_string(getpid()));
+  fs::create_directories(dir);
+
+  const std::vector<Payload> records = payloads(1000);
+  BtsFileInfo info;
+  std::vector<Payload> traces;
+
+  // A flushed file
+  {
+    const fs::path path = dir / "flushed.bts";
+    const TraCR::BtsHeader header = standard_header(4096);
+    const TraCR::BtsTrailer trailer = trailer_of(records.size());
+    write_bts(path, &header, records, &trailer);
+
+    CHECK(read_bts_info(path, info));
+    CHECK(!info.legacy && info.has_trailer);
+    CHECK(info.header.tid == 42 && info.header.capacity == 4096);
+    CHECK(info.records_begin == sizeof(TraCR::BtsHeader));
+    CHECK(info.records_end ==
+          info.records_begin + records.size() * sizeof(Payload));
+    CHECK(info.trailer.num_records == records.size());
+    CHECK(info.trailer.num_events == records.size());
+    CHECK(info.trailer.min_timestamp == records.front().timestamp);
+    CHECK(info.trailer.max_timestamp == records.back().timestamp);
+
+    // A SET (1) and a RESET per pair
+    CHECK(info.counts.size() == 2);
+    CHECK(info.counts[0].eventId == 1 && info.counts[0].count == 500);
+    CHECK(info.counts[1].eventId == UINT16_MAX && info.counts[1].count == 500);
+
+    CHECK(load_bts_file(path, traces, false));
+    check_traces(traces, records);
+  }
+
+  // A file of TraCR versions before the header, a plain array of payloads
+  {
+    const fs::path path = dir / "legacy.bts";
+    write_bts(path, nullptr, records, nullptr);
+
+    CHECK(read_bts_info(path, info));
+    CHECK(info.legacy && !info.has_trailer);
+    CHECK(load_bts_file(path, traces, false));
+    check_traces(traces, records);
+  }
+
+  // A file whose flush did not finish has no trailer, its records reach up to
+  // the end of the file
+  {
+    const fs::path path = dir / "unflushed.bts";
+    const TraCR::BtsHeader header = standard_header(4096);
+    write_bts(path, &header, records, nullptr);
+
+    CHECK(read_bts_info(path, info));
+    CHECK(!info.legacy && !info.has_trailer);
+    CHECK(load_bts_file(path, traces, false));
+    check_traces(traces, records);
+  }
+
+  // A newer header of the same version only appended fields
+  {
+    const fs::path path = dir / "extended.bts";
+    std::vector<char> extended(sizeof(TraCR::BtsHeader) + 32, 0x5a);
+    TraCR::BtsHeader header = standard_header(4096);
+    header.header_size = static_cast<uint16_t>(extended.size());
+    std::memcpy(extended.data(), &header, sizeof(header));
+
+    const TraCR::BtsTrailer trailer = trailer_of(records.size());
+    write_bts(path, reinterpret_cast<const TraCR::BtsHeader *>(extended.data()),
+              records, &trailer);
+
+    CHECK(read_bts_info(path, info));
+    CHECK(info.records_begin == extended.size());
+    CHECK(load_bts_file(path, traces, false));
+    check_traces(traces, records);
+  }
+
+  // Files this reader can't read
+  {
+    const fs::path path = dir / "rejected.bts";
+    const TraCR::BtsTrailer trailer = trailer_of(records.size());
+
+    TraCR::BtsHeader header = standard_header(4096);
+    header.version = TraCR::BTS_VERSION + 1;
+    write_bts(path, &header, records, &trailer);
+    CHECK(!read_bts_info(path, info));
+
+    header = standard_header(4096);
+    header.record_size = 12;
+    write_bts(path, &header, records, &trailer);
+    CHECK(!read_bts_info(path, info));
+
+    header = standard_header(4096);
+    header.payload_format = 7;
+    write_bts(path, &header, records, &trailer);
+    CHECK(!read_bts_info(path, info));
+
+    // The trailer holds more records than the file
+    header = standard_header(4096);
+    const TraCR::BtsTrailer wrong = trailer_of(records.size() + 1);
+    write_bts(path, &header, records, &wrong);
+    CHECK(!read_bts_info(path, info));
+  }
+
+  // An empty flushed file
+  {
+    const fs::path path = dir / "empty.bts";
+    const TraCR::BtsHeader header = standard_header(4096);
+    const TraCR::BtsTrailer trailer = trailer_of(0);
+    write_bts(path, &header, {}, &trailer);
+
+    CHECK(read_bts_info(path, info));
+    CHECK(info.has_trailer && info.trailer.num_records == 0);
+    CHECK(load_bts_file(path, traces, false));
+    CHECK(traces.empty());
+  }
+
+  // The buffer of a periodic thread, flushed without unwrapping: the trailer
+  // points at the oldest record
+  {
+    const fs::path path = dir / "wrapped.bts";
+    const size_t capacity = 1000, wrap = 300;
+    std::vector<Payload> ring = payloads(capacity, 5000);
+    std::rotate(ring.begin(), ring.begin() + (capacity - wrap), ring.end());
+
+    TraCR::BtsHeader header = standard_header(capacity);
+    header.policy = static_cast<uint8_t>(TraCR::BtsPolicy::PERIODIC);
+    TraCR::BtsTrailer trailer = trailer_of(capacity);
+    trailer.num_overwritten = 5000;
+    trailer.wrap_index = wrap;
+    write_bts(path, &header, ring, &trailer);
+
+    CHECK(read_bts_info(path, info));
+    CHECK(info.trailer.wrap_index == wrap);
+    CHECK(load_bts_file(path, traces, false));
+    check_traces(traces, payloads(capacity, 5000));
+  }
+
+  // The file behind the buffer of a run that died (TRACR_MAPPED_BUFFER): the
+  // header counts the published records, slot i holds the latest record i of
+  // a lap
+  for (const uint64_t published : {0, 1, 999, 1000, 1001, 123456}) {
+    const fs::path path = dir / "mapped.bts";
+    const size_t capacity = 1000;
+    std::vector<Payload> slots(capacity, Payload{});
+    for (uint64_t i = 0; i < published; ++i) {
+      slots[i % capacity] = payloads(1, uint32_t(i)).front();
+    }
+
+    TraCR::BtsHeader header = standard_header(capacity);
+    header.flags = TraCR::BTS_FLAG_MAPPED;
+    header.published_records = published;
+    write_bts(path, &header, slots, nullptr);
+
+    CHECK(read_bts_info(path, info));
+    const uint64_t kept = std::min<uint64_t>(published, capacity);
+    CHECK(info.trailer.num_records == kept);
+    CHECK(info.trailer.num_overwritten == published - kept);
+
+    CHECK(load_bts_file(path, traces, false));
+    std::vector<Payload> expected;
+    for (uint64_t i = published - kept; i < published; ++i) {
+      expected.push_back(payloads(1, uint32_t(i)).front());
+    }
+    check_traces(traces, expected);
+  }
+
+  fs::remove_all(dir);
+  return 0;
+}
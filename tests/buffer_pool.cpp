@@ -0,0 +1,162 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#include <tracr/buffer_pool.hpp>
+
+#include "check.hpp"
+
+using TraCR::BufferPool;
+using TraCR::BufferPoolStats;
+using TraCR::TraceBuffer;
+
+/**
+ * Check all counters of the pool at once
+ */
+static void check_stats(BufferPool<uint64_t> &pool,
+                        const BufferPoolStats &expected) {
+  const BufferPoolStats stats = pool.stats();
+  CHECK(stats.buffers_created == expected.buffers_created);
+  CHECK(stats.buffers_reused == expected.buffers_reused);
+  CHECK(stats.buffers_pooled == expected.buffers_pooled);
+  CHECK(stats.chunks_created == expected.chunks_created);
+  CHECK(stats.chunks_reused == expected.chunks_reused);
+  CHECK(stats.chunks_pooled == expected.chunks_pooled);
+}
+
+/**
+ * Number of mappings of this process
+ */
+static size_t num_mappings() {
+  std::ifstream maps("/proc/self/maps");
+  std::string line;
+  size_t count = 0;
+  while (std::getline(maps, line)) {
+    ++count;
+  }
+  return count;
+}
+
+/*
+ * The accounting of a BufferPool of whole buffers and of chunks, the buffers
+ * it refuses and the order in which recycled chunks come back
+ */
+int main() {
+  // Whole buffers
+  {
+    BufferPool<uint64_t> pool(1024, 0);
+
+    TraceBuffer<uint64_t> buffer = pool.take();
+    CHECK(buffer.size() == 1024);
+    buffer[1023] = 42;
+    check_stats(pool, {1, 0, 0, 0, 0, 0});
+
+    pool.give(std::move(buffer));
+    check_stats(pool, {1, 0, 1, 0, 0, 0});
+
+    // The same pages come back
+    TraceBuffer<uint64_t> recycled = pool.take();
+    CHECK(recycled.size() == 1024 && recycled[1023] == 42);
+    check_stats(pool, {1, 1, 0, 0, 0, 0});
+
+    // Neither a buffer of another capacity nor one handed over is kept
+    pool.give(TraceBuffer<uint64_t>(512));
+    TraceBuffer<uint64_t> moved = std::move(recycled);
+    pool.give(std::move(recycled));
+    check_stats(pool, {1, 1, 0, 0, 0, 0});
+
+    // A new capacity releases the pooled buffers and refuses the old ones
+    pool.give(std::move(moved));
+    check_stats(pool, {1, 1, 1, 0, 0, 0});
+    pool.set_capacity(2048);
+    check_stats(pool, {1, 1, 0, 0, 0, 0});
+
+    TraceBuffer<uint64_t> larger = pool.take();
+    CHECK(larger.size() == 2048);
+    pool.give(TraceBuffer<uint64_t>(1024));
+    pool.give(std::move(larger));
+    check_stats(pool, {2, 1, 1, 0, 0, 0});
+
+    pool.trim();
+    check_stats(pool, {2, 1, 0, 0, 0, 0});
+  }
+
+  // Chunks of one page each
+  {
+    const size_t chunk = 512, capacity = 8 * chunk;
+    BufferPool<uint64_t> pool(capacity, chunk);
+
+    TraceBuffer<uint64_t> buffer = pool.take();
+    CHECK(buffer.populated() == 0);
+
+    // New chunks are faulted in place, without mappings of their own
+    const size_t mappings = num_mappings();
+    pool.grow(buffer, 1);
+    CHECK(buffer.populated() == chunk);
+    pool.grow(buffer, 3 * chunk - 1);
+    CHECK(buffer.populated() == 3 * chunk);
+    pool.grow(buffer, 100 * capacity);
+    CHECK(buffer.populated() == capacity);
+    CHECK(num_mappings() == mappings);
+    check_stats(pool, {1, 0, 0, 8, 0, 0});
+
+    for (size_t i = 0; i < capacity; ++i) {
+      buffer[i] = i;
+    }
+
+    // The buffer keeps its first chunk, the others become one run
+    pool.give(std::move(buffer));
+    check_stats(pool, {1, 0, 1, 8, 0, 7});
+
+    TraceBuffer<uint64_t> recycled = pool.take();
+    CHECK(recycled.populated() == chunk);
+    check_stats(pool, {1, 1, 0, 8, 0, 7});
+
+    // The run is taken front to back, each chunk with its records
+    pool.grow(recycled, 3 * chunk);
+    check_stats(pool, {1, 1, 0, 8, 2, 5});
+    for (size_t i = 0; i < 3 * chunk; ++i) {
+      CHECK(recycled[i] == i);
+    }
+
+    TraceBuffer<uint64_t> other = pool.take();
+    pool.grow(other, 2 * chunk);
+    check_stats(pool, {2, 1, 0, 8, 4, 3});
+    for (size_t i = 0; i < 2 * chunk; ++i) {
+      CHECK(other[i] == 3 * chunk + i);
+    }
+
+    // Beyond the pooled chunks, new ones are faulted
+    pool.grow(other, 6 * chunk);
+    check_stats(pool, {2, 1, 0, 9, 7, 0});
+    for (size_t i = 2 * chunk; i < 5 * chunk; ++i) {
+      CHECK(other[i] == 3 * chunk + i);
+    }
+    CHECK(other[5 * chunk] == 0);
+
+    pool.give(std::move(other));
+    pool.give(std::move(recycled));
+    check_stats(pool, {2, 1, 2, 9, 7, 7});
+
+    pool.trim();
+    check_stats(pool, {2, 1, 0, 9, 7, 0});
+  }
+
+  return 0;
+}
@@ -0,0 +1,121 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <tracr/marker_management_engine.hpp>
+
+#include "check.hpp"
+
+using TraCR::CompactCodec;
+using TraCR::Payload;
+
+/**
+ * Encode payload after prev, check it takes the expected number of words and
+ * decodes to the same payload and timestamp
+ */
+static void round_trip(const Payload &payload, uint64_t prev, size_t words) {
+  uint64_t encoded[CompactCodec::MAX_WORDS];
+  CHECK(CompactCodec::encode(payload, prev, encoded) == words);
+
+  Payload decoded{};
+  uint64_t decoded_prev = prev;
+  CHECK(CompactCodec::decode(encoded, words, decoded_prev, decoded) == words);
+  CHECK(decoded.channelId == payload.channelId);
+  CHECK(decoded.eventId == payload.eventId);
+  CHECK(decoded.extraId == payload.extraId);
+  CHECK(decoded.timestamp == payload.timestamp);
+  CHECK(decoded_prev ==
+        (payload.timestamp & ~TraCR::COARSE_TIMESTAMP_FLAG));
+}
+
+/*
+ * The compact records of TRACR_COMPACT_PAYLOAD at the limits of their fields,
+ * and the escape records beyond them
+ */
+int main() {
+  const uint64_t prev = 1'000'000'000;
+  const uint64_t max_delta = CompactCodec::DELTA_MASK;
+
+  // The delta takes 24 bits
+  round_trip({1, 2, 3, prev + max_delta}, prev, 1);
+  round_trip({1, 2, 3, prev + max_delta + 1}, prev, CompactCodec::MAX_WORDS);
+
+  // A timestamp before the previous one
+  round_trip({1, 2, 3, prev - 1}, prev, CompactCodec::MAX_WORDS);
+
+  // The channel takes 8 bits
+  round_trip({255, 2, 3, prev + 10}, prev, 1);
+  round_trip({256, 2, 3, prev + 10}, prev, CompactCodec::MAX_WORDS);
+
+  // The extraId takes 22 bits, all ones stand for UINT32_MAX
+  const uint32_t max_extra = CompactCodec::EXTRA_MASK;
+  round_trip({1, 2, max_extra - 1, prev + 10}, prev, 1);
+  round_trip({1, 2, max_extra, prev + 10}, prev, CompactCodec::MAX_WORDS);
+  round_trip({1, 2, max_extra + 1, prev + 10}, prev, CompactCodec::MAX_WORDS);
+  round_trip({1, 2, UINT32_MAX, prev + 10}, prev, 1);
+
+  // The event takes 8 bits, all ones stand for UINT16_MAX (a RESET)
+  round_trip({1, 254, 3, prev + 10}, prev, 1);
+  round_trip({1, 255, 3, prev + 10}, prev, CompactCodec::MAX_WORDS);
+  round_trip({1, UINT16_MAX, 3, prev + 10}, prev, 1);
+
+  // The coarse flag survives both kinds of records
+  round_trip({1, 2, 3, (prev + 10) | TraCR::COARSE_TIMESTAMP_FLAG}, prev, 1);
+  round_trip({1, 2, 3, (prev + max_delta + 1) | TraCR::COARSE_TIMESTAMP_FLAG},
+             prev, CompactCodec::MAX_WORDS);
+
+  // A truncated escape record is not decoded
+  uint64_t escape[CompactCodec::MAX_WORDS];
+  CHECK(CompactCodec::encode({256, 2, 3, prev + 10}, prev, escape) ==
+        CompactCodec::MAX_WORDS);
+  for (size_t avail = 1; avail < CompactCodec::MAX_WORDS; ++avail) {
+    Payload decoded{};
+    uint64_t decoded_prev = prev;
+    CHECK(CompactCodec::decode(escape, avail, decoded_prev, decoded) == 0);
+    CHECK(decoded_prev == prev);
+  }
+
+  // A sequence decodes with the deltas chained
+  const Payload sequence[] = {{0, 1, 7, prev},
+                              {0, UINT16_MAX, 0, prev + max_delta},
+                              {300, 1, 7, prev + max_delta + 5},
+                              {0, 1, max_extra + 1, prev + 2 * max_delta},
+                              {0, UINT16_MAX, 0, prev + 2 * max_delta + 1}};
+  std::vector<uint64_t> words;
+  uint64_t last = prev;
+  for (const Payload &payload : sequence) {
+    uint64_t encoded[CompactCodec::MAX_WORDS];
+    size_t count = CompactCodec::encode(payload, last, encoded);
+    words.insert(words.end(), encoded, encoded + count);
+    last = payload.timestamp;
+  }
+  CHECK(words.size() == 3 + 2 * CompactCodec::MAX_WORDS);
+
+  last = prev;
+  size_t pos = 0;
+  for (const Payload &payload : sequence) {
+    Payload decoded{};
+    size_t used =
+        CompactCodec::decode(&words[pos], words.size() - pos, last, decoded);
+    CHECK(used > 0);
+    CHECK(decoded.timestamp == payload.timestamp);
+    CHECK(decoded.channelId == payload.channelId);
+    CHECK(decoded.extraId == payload.extraId);
+    pos += used;
+  }
+  CHECK(pos == words.size());
+
+  return 0;
+}
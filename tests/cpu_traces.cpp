@@ -0,0 +1,186 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fstream>
+#include <thread>
+
+#include <trace_reader.hpp>
+#include <tracr/tracr.hpp>
+
+#include "check.hpp"
+
+using TraCR::CpuRecord;
+using TraCR::Payload;
+
+/**
+ * Write the buffer of a CPU into proc_path/cpu.<cpu>/traces.bts
+ */
+static void write_cpu(const fs::path &proc_path, uint32_t cpu,
+                      const std::vector<CpuRecord> &records,
+                      TraCR::BtsPayloadFormat format) {
+  const fs::path folder = proc_path / ("cpu." + std::to_string(cpu));
+  fs::create_directories(folder);
+
+  TraCR::BtsHeader header{};
+  std::memcpy(header.magic, TraCR::BTS_MAGIC, sizeof(header.magic));
+  header.version = TraCR::BTS_VERSION;
+  header.header_size = sizeof(TraCR::BtsHeader);
+  header.record_size = sizeof(CpuRecord);
+  header.payload_format = static_cast<uint8_t>(format);
+  header.cpu = cpu;
+  header.capacity = 1024;
+  header.tid = -1;
+
+  TraCR::BtsStats stats;
+  for (const auto &record : records) {
+    stats.add(record.payload.eventId, record.payload.timestamp);
+  }
+  TraCR::BtsTrailer trailer{};
+  trailer.num_records = records.size();
+
+  std::ofstream ofs(folder / "traces.bts", std::ios::binary | std::ios::trunc);
+  ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  ofs.write(reinterpret_cast<const char *>(records.data()),
+            records.size() * sizeof(CpuRecord));
+  ofs << TraCR::bts_trailer_bytes(stats, trailer);
+  CHECK(ofs.good());
+}
+
+/**
+ * Check that traces are exactly the expected payloads
+ */
+static void check_traces(const std::vector<Payload> &traces,
+                         const std::vector<Payload> &expected) {
+  CHECK(traces.size() == expected.size());
+  for (size_t i = 0; i < traces.size(); ++i) {
+    CHECK(traces[i].eventId == expected[i].eventId);
+    CHECK(traces[i].extraId == expected[i].extraId);
+    CHECK(traces[i].timestamp == expected[i].timestamp);
+  }
+}
+
+/**
+ * Record n_events events with rising extraIds, without a thread init
+ */
+static void record(size_t n_events) {
+  for (size_t i = 0; i < n_events; ++i) {
+    INSTRUMENTATION_MARK_SET(0, 1, uint32_t(i));
+  }
+}
+
+/*
+ * The buffers of a TRACR_PER_CPU proc hold the records of all threads that
+ * ran on each CPU. tracr_process splits them by TID, orders each thread by
+ * timestamp across the CPUs and puts a CPU payload in front of each
+ * migration.
+ */
+int main() {
+  const fs::path dir = fs::temp_directory_path() /
+                       ("tracr_cpu_traces." + std::to_string(getpid()));
+  const uint16_t cpu = TraCR::CPU_EVENT_ID;
+  const uint64_t coarse = TraCR::COARSE_TIMESTAMP_FLAG;
+
+  // Two threads interleaved on two CPUs, with a reserved slot and a coarse
+  // timestamp that sorts by its value
+  {
+    const fs::path proc = dir / "synthetic";
+    write_cpu(proc, 0,
+              {{{0, 1, 1, 10}, 100},
+               {{0, 1, 2, 15}, 200},
+               {{0, 1, 3, 25}, 200},
+               {{0, 1, 4, 40}, 100}},
+              TraCR::BtsPayloadFormat::PER_CPU);
+    write_cpu(proc, 1,
+              {{{0, 1, 5, 20}, 100},
+               {{0, 1, 6, 30}, 100},
+               {{0, 1, 7, 35 | coarse}, 200},
+               {{0, 1, 8, 50}, 0}},
+              TraCR::BtsPayloadFormat::PER_CPU);
+
+    std::map<pid_t, std::vector<Payload>> threads;
+    CHECK(load_cpu_traces(proc, threads));
+    CHECK(threads.size() == 2);
+
+    check_traces(threads[100], {{0, cpu, 0, 10},
+                                {0, 1, 1, 10},
+                                {0, cpu, 1, 20},
+                                {0, 1, 5, 20},
+                                {0, 1, 6, 30},
+                                {0, cpu, 0, 40},
+                                {0, 1, 4, 40}});
+    check_traces(threads[200], {{0, cpu, 0, 15},
+                                {0, 1, 2, 15},
+                                {0, 1, 3, 25},
+                                {0, cpu, 1, 35 | coarse},
+                                {0, 1, 7, 35 | coarse}});
+
+    // The same through the folder walk of tracr_process
+    std::vector<std::vector<Payload>> bts_files;
+    std::vector<pid_t> bts_tids;
+    CHECK(load_thread_traces(proc, bts_files, bts_tids, false) == 0);
+    CHECK(bts_tids == std::vector<pid_t>({100, 200}));
+    CHECK(bts_files[0].size() == 7 && bts_files[1].size() == 5);
+
+    // A CPU folder holding thread payloads is rejected
+    write_cpu(proc, 2, {}, TraCR::BtsPayloadFormat::STANDARD);
+    CHECK(!load_cpu_traces(proc, threads));
+  }
+
+  // Threads recording through the per-CPU buffers of this build
+  {
+    const size_t n_threads = 3, n_events = 5000;
+
+    INSTRUMENTATION_TRACE_PATH(dir.string() + "/");
+    INSTRUMENTATION_START();
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < n_threads; ++t) {
+      threads.emplace_back(record, n_events);
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+
+    INSTRUMENTATION_END();
+
+    std::vector<std::vector<Payload>> bts_files;
+    std::vector<pid_t> bts_tids;
+    for (const auto &proc : fs::directory_iterator(dir / "tracr")) {
+      if (proc.is_directory()) {
+        CHECK(load_thread_traces(proc.path(), bts_files, bts_tids, false) ==
+              0);
+      }
+    }
+    CHECK(bts_files.size() == n_threads);
+
+    // Each thread gets its own events back in order, with the CPU in front
+    for (const auto &traces : bts_files) {
+      CHECK(!traces.empty() && traces.front().eventId == cpu);
+
+      size_t next = 0;
+      for (size_t i = 0; i < traces.size(); ++i) {
+        CHECK(i == 0 || traces[i].timestamp >= traces[i - 1].timestamp);
+        if (traces[i].eventId != cpu) {
+          CHECK(traces[i].extraId == next++);
+        }
+      }
+      CHECK(next == n_events);
+    }
+  }
+
+  fs::remove_all(dir);
+  return 0;
+}
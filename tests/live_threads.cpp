@@ -0,0 +1,98 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <thread>
+
+#include <trace_reader.hpp>
+#include <tracr/tracr.hpp>
+
+#include "check.hpp"
+
+/**
+ * Record n_events of eventId, counting extraId up from 0
+ */
+static void record(uint16_t eventId, size_t n_events) {
+  for (size_t i = 0; i < n_events; ++i) {
+    INSTRUMENTATION_MARK_SET(0, eventId, uint32_t(i));
+  }
+}
+
+/*
+ * A thread that exits without INSTRUMENTATION_THREAD_FINALIZE() is flushed by
+ * its exit guard, and a thread still running at INSTRUMENTATION_END() is
+ * flushed by the proc. Both leave the records they published on disk.
+ */
+int main() {
+  const size_t n_exited = 1000, n_running = 2000;
+
+  const fs::path dir = fs::temp_directory_path() /
+                       ("tracr_live_threads." + std::to_string(getpid()));
+  fs::create_directories(dir);
+
+  INSTRUMENTATION_TRACE_PATH(dir.string() + "/");
+  INSTRUMENTATION_START();
+
+  // Leaves without finalizing
+  std::thread exited([&] {
+    INSTRUMENTATION_THREAD_INIT();
+    record(1, n_exited);
+  });
+  exited.join();
+
+  // Still running at the end
+  std::atomic<bool> recorded{false}, ended{false};
+  std::thread running([&] {
+    INSTRUMENTATION_THREAD_INIT();
+    record(2, n_running);
+    recorded = true;
+    while (!ended) {
+      std::this_thread::yield();
+    }
+  });
+  while (!recorded) {
+    std::this_thread::yield();
+  }
+
+  INSTRUMENTATION_END();
+  ended = true;
+  running.join();
+
+  std::vector<std::vector<TraCR::Payload>> bts_files;
+  std::vector<pid_t> bts_tids;
+  for (const auto &proc : fs::directory_iterator(dir / "tracr")) {
+    if (proc.is_directory()) {
+      CHECK(load_thread_traces(proc.path(), bts_files, bts_tids, false) == 0);
+    }
+  }
+
+  // The main thread recorded nothing and leaves no file
+  CHECK(bts_files.size() == 2);
+  size_t found = 0;
+  for (const std::vector<TraCR::Payload> &traces : bts_files) {
+    CHECK(!traces.empty());
+    const uint16_t eventId = traces.front().eventId;
+    CHECK(traces.size() == ((eventId == 1) ? n_exited : n_running));
+    for (size_t i = 0; i < traces.size(); ++i) {
+      CHECK(traces[i].eventId == eventId && traces[i].extraId == i);
+    }
+    found |= eventId;
+  }
+  CHECK(found == 3);
+
+  fs::remove_all(dir);
+  return 0;
+}
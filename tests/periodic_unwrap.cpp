@@ -0,0 +1,75 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <trace_reader.hpp>
+#include <tracr/tracr.hpp>
+
+#include "check.hpp"
+
+/*
+ * A thread of a TRACR_POLICY_PERIODIC build records far more events than its
+ * buffer holds. The flushed file has to hold the last TRACR_CAPACITY of them,
+ * oldest first, and count the overwritten ones.
+ */
+int main() {
+  const size_t n_events = 300000;
+
+  const fs::path dir = fs::temp_directory_path() /
+                       ("tracr_periodic_unwrap." + std::to_string(getpid()));
+  fs::create_directories(dir);
+
+  INSTRUMENTATION_TRACE_PATH(dir.string() + "/");
+  INSTRUMENTATION_START();
+
+  for (size_t i = 0; i < n_events; ++i) {
+    INSTRUMENTATION_MARK_SET(0, 1, uint32_t(i));
+  }
+
+  INSTRUMENTATION_END();
+
+  std::vector<std::vector<TraCR::Payload>> bts_files;
+  std::vector<pid_t> bts_tids;
+  for (const auto &proc : fs::directory_iterator(dir / "tracr")) {
+    if (proc.is_directory()) {
+      CHECK(load_thread_traces(proc.path(), bts_files, bts_tids, false) == 0);
+    }
+  }
+
+  // The main thread, the only one that recorded
+  CHECK(bts_files.size() == 1);
+  const std::vector<TraCR::Payload> &traces = bts_files.front();
+  CHECK(traces.size() == TraCR::CAPACITY);
+
+  const size_t first = n_events - TraCR::CAPACITY;
+  for (size_t i = 0; i < traces.size(); ++i) {
+    CHECK(traces[i].extraId == first + i);
+    CHECK(i == 0 || traces[i].timestamp >= traces[i - 1].timestamp);
+  }
+
+  // The trailer counts the overwritten events, the records are unwrapped
+  for (const auto &entry : fs::recursive_directory_iterator(dir / "tracr")) {
+    if (entry.path().filename() == "traces.bts") {
+      BtsFileInfo info;
+      CHECK(read_bts_info(entry.path(), info));
+      CHECK(info.trailer.num_records == TraCR::CAPACITY);
+      CHECK(info.trailer.num_overwritten == first);
+      CHECK(info.trailer.wrap_index == 0);
+    }
+  }
+
+  fs::remove_all(dir);
+  return 0;
+}
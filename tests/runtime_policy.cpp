@@ -0,0 +1,120 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <trace_reader.hpp>
+#include <tracr/tracr.hpp>
+
+#include "check.hpp"
+
+using TraCR::BtsPolicy;
+
+/*
+ * The policy names of TRACR_RUNTIME_POLICY, and the environment taken by
+ * INSTRUMENTATION_START(). Invalid values of TRACR_POLICY or TRACR_CAPACITY
+ * have to stop the process (see tests/meson.build). A thread recording more
+ * events than the capacity keeps the last ones oldest first with periodic,
+ * and the first ones with ignore_if_full.
+ */
+int main() {
+  // Every policy parses back from its name
+  for (BtsPolicy policy :
+       {BtsPolicy::ABORT, BtsPolicy::IGNORE_IF_FULL, BtsPolicy::PERIODIC}) {
+    BtsPolicy parsed = BtsPolicy::SEGMENTED;
+    CHECK(TraCR::parse_full_policy(TraCR::full_policy_name(policy), parsed));
+    CHECK(parsed == policy);
+  }
+
+  // Anything else is refused and leaves the policy alone
+  for (const char *name : {"", "Abort", "ABORT", "periodic ", " periodic",
+                           "ignore", "ignore-if-full", "segmented",
+                           "streaming", "abortx"}) {
+    BtsPolicy parsed = BtsPolicy::SEGMENTED;
+    CHECK(!TraCR::parse_full_policy(name, parsed));
+    CHECK(parsed == BtsPolicy::SEGMENTED);
+  }
+  BtsPolicy parsed = BtsPolicy::SEGMENTED;
+  CHECK(!TraCR::parse_full_policy(std::string("abort\0", 6), parsed));
+
+  const fs::path dir = fs::temp_directory_path() /
+                       ("tracr_runtime_policy." + std::to_string(getpid()));
+  fs::create_directories(dir);
+
+  INSTRUMENTATION_TRACE_PATH(dir.string() + "/");
+  INSTRUMENTATION_START();
+
+  // A valid environment is taken over
+  if (const char *policy = std::getenv("TRACR_POLICY")) {
+    CHECK(std::strcmp(TraCR::full_policy_name(TraCR::tracr_policy), policy) ==
+          0);
+  }
+  if (const char *capacity = std::getenv("TRACR_CAPACITY")) {
+    CHECK(std::to_string(TraCR::tracr_capacity) == capacity);
+  }
+
+  // Fill the buffer a few laps over, unless full aborts
+  const BtsPolicy policy = TraCR::tracr_policy;
+  const size_t capacity = TraCR::tracr_capacity;
+  const size_t n_events =
+      (policy == BtsPolicy::ABORT) ? capacity / 2 : 3 * capacity + 123;
+
+  for (size_t i = 0; i < n_events; ++i) {
+    INSTRUMENTATION_MARK_SET(0, 1, uint32_t(i));
+  }
+
+  INSTRUMENTATION_END();
+
+  std::vector<std::vector<TraCR::Payload>> bts_files;
+  std::vector<pid_t> bts_tids;
+  for (const auto &proc : fs::directory_iterator(dir / "tracr")) {
+    if (proc.is_directory()) {
+      CHECK(load_thread_traces(proc.path(), bts_files, bts_tids, false) == 0);
+    }
+  }
+
+  // The main thread, the only one that recorded
+  const size_t n_kept = std::min(n_events, capacity);
+  CHECK(bts_files.size() == 1);
+  const std::vector<TraCR::Payload> &traces = bts_files.front();
+  CHECK(traces.size() == n_kept);
+
+  const size_t first =
+      (policy == BtsPolicy::PERIODIC) ? n_events - n_kept : 0;
+  for (size_t i = 0; i < traces.size(); ++i) {
+    CHECK(traces[i].extraId == first + i);
+    CHECK(i == 0 || traces[i].timestamp >= traces[i - 1].timestamp);
+  }
+
+  // The trailer counts the overwritten or the dropped events
+  for (const auto &entry : fs::recursive_directory_iterator(dir / "tracr")) {
+    if (entry.path().filename() == "traces.bts") {
+      BtsFileInfo info;
+      CHECK(read_bts_info(entry.path(), info));
+      CHECK(info.header.policy == static_cast<uint8_t>(policy));
+      CHECK(info.trailer.num_records == n_kept);
+      CHECK(info.trailer.num_overwritten ==
+            ((policy == BtsPolicy::PERIODIC) ? n_events - n_kept : 0));
+      CHECK(info.trailer.num_dropped ==
+            ((policy == BtsPolicy::IGNORE_IF_FULL) ? n_events - n_kept : 0));
+    }
+  }
+
+  fs::remove_all(dir);
+  return 0;
+}
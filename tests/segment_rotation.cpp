@@ -0,0 +1,182 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fstream>
+#include <thread>
+
+#include <trace_reader.hpp>
+#include <tracr/tracr.hpp>
+
+#include "check.hpp"
+
+/**
+ * Create a file of the given size, as a segment to be rotated
+ */
+static std::string segment_file(const fs::path &dir, size_t index,
+                                size_t bytes) {
+  const fs::path path = dir / ("segment." + std::to_string(index));
+  std::ofstream(path) << std::string(bytes, 'x');
+  return path.string();
+}
+
+/**
+ * The rotation bounds of a SegmentManager on its own
+ */
+static void check_rotation(const fs::path &dir) {
+  size_t written, removed, bytes;
+
+  // At most 3 segments, the oldest are removed first
+  {
+    TraCR::SegmentManager segments;
+    segments.set_rotation(3, 0);
+    for (size_t i = 0; i < 5; ++i) {
+      segments.add(segment_file(dir, i, 100), 100);
+    }
+
+    segments.getStats(written, removed, bytes);
+    CHECK(written == 5 && removed == 2 && bytes == 300);
+    for (size_t i = 0; i < 5; ++i) {
+      CHECK(fs::exists(dir / ("segment." + std::to_string(i))) == (i >= 2));
+    }
+  }
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+
+  // At most 250 bytes, the latest segment is kept even if larger
+  {
+    TraCR::SegmentManager segments;
+    segments.set_rotation(0, 250);
+    for (size_t i = 0; i < 4; ++i) {
+      segments.add(segment_file(dir, i, 100), 100);
+    }
+
+    segments.getStats(written, removed, bytes);
+    CHECK(written == 4 && removed == 2 && bytes == 200);
+
+    segments.add(segment_file(dir, 4, 1000), 1000);
+    segments.getStats(written, removed, bytes);
+    CHECK(written == 5 && removed == 4 && bytes == 1000);
+    CHECK(fs::exists(dir / "segment.4") && !fs::exists(dir / "segment.3"));
+
+    // Tightening the bounds rotates right away
+    segments.add(segment_file(dir, 5, 10), 10);
+    segments.set_rotation(1, 0);
+    segments.getStats(written, removed, bytes);
+    CHECK(written == 6 && removed == 5 && bytes == 10);
+  }
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+
+  // The callback runs on the ticker thread, not on the thread adding
+  {
+    std::mutex mutex;
+    std::vector<std::thread::id> callers;
+
+    TraCR::SegmentManager segments;
+    segments.on_segment([&] {
+      std::lock_guard<std::mutex> lock(mutex);
+      callers.push_back(std::this_thread::get_id());
+    });
+
+    for (size_t i = 0; i < 100; ++i) {
+      segments.add(segment_file(dir, i, 1), 1);
+    }
+
+    for (size_t waited_ms = 0; waited_ms < 5000; waited_ms += 10) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!callers.empty()) {
+        break;
+      }
+    }
+
+    // Throttled, so the 100 segments don't cause 100 refreshes
+    std::lock_guard<std::mutex> lock(mutex);
+    CHECK(!callers.empty() && callers.size() <= 2);
+    CHECK(callers.front() != std::this_thread::get_id());
+  }
+}
+
+/*
+ * A SegmentManager removes the oldest segments once a bound is exceeded and
+ * calls back off the tracing thread. A segmented trace that rotated is read
+ * back with its remaining segments concatenated in numeric order, and the
+ * metadata reports the bytes the kept segments take on disk.
+ */
+int main() {
+  const fs::path dir = fs::temp_directory_path() /
+                       ("tracr_segment_rotation." + std::to_string(getpid()));
+  fs::create_directories(dir / "rotation");
+
+  check_rotation(dir / "rotation");
+
+  // 12 segments of 10 events, the last 4 (8 to 11) are kept
+  const size_t n_segments = 12, n_events = 10, n_kept = 4;
+
+  INSTRUMENTATION_TRACE_PATH(dir.string() + "/");
+  INSTRUMENTATION_START();
+  INSTRUMENTATION_SEGMENT_ROTATION(n_kept, 0);
+
+  for (size_t s = 0; s < n_segments; ++s) {
+    for (size_t i = 0; i < n_events; ++i) {
+      INSTRUMENTATION_MARK_SET(0, 1, uint32_t(s * n_events + i));
+    }
+    INSTRUMENTATION_FLUSH();
+  }
+
+  INSTRUMENTATION_END();
+
+  std::vector<std::vector<TraCR::Payload>> bts_files;
+  std::vector<pid_t> bts_tids;
+  for (const auto &proc : fs::directory_iterator(dir / "tracr")) {
+    if (!proc.is_directory()) {
+      continue;
+    }
+
+    // The rotation counted the segments with their size on disk
+    size_t bytes_kept = 0;
+    for (const auto &thread : fs::directory_iterator(proc.path())) {
+      if (thread.is_directory()) {
+        const auto files = thread_trace_files(thread.path());
+        CHECK(files.size() == n_kept);
+        for (const auto &file : files) {
+          bytes_kept += fs::file_size(file);
+        }
+      }
+    }
+
+    nlohmann::json metadata;
+    std::ifstream(proc.path() / "metadata.json") >> metadata;
+    CHECK(metadata["segments"]["written"] == n_segments);
+    CHECK(metadata["segments"]["removed"] == n_segments - n_kept);
+    CHECK(metadata["segments"]["bytes_kept"] == bytes_kept);
+
+    CHECK(load_thread_traces(proc.path(), bts_files, bts_tids, false) == 0);
+  }
+
+  // traces.10.bts follows traces.9.bts, not traces.1.bts
+  CHECK(bts_files.size() == 1);
+  const std::vector<TraCR::Payload> &traces = bts_files.front();
+  CHECK(traces.size() == n_kept * n_events);
+
+  const size_t first = (n_segments - n_kept) * n_events;
+  for (size_t i = 0; i < traces.size(); ++i) {
+    CHECK(traces[i].extraId == first + i);
+  }
+
+  fs::remove_all(dir);
+  return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ *   Copyright 2026 Huawei Technologies Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fstream>
+#include <map>
+#include <thread>
+
+#include <trace_reader.hpp>
+#include <tracr/tracr.hpp>
+
+#include "check.hpp"
+
+/**
+ * Record n_events events on a thread of its own
+ */
+static void record(size_t n_events) {
+  INSTRUMENTATION_THREAD_INIT();
+  for (size_t i = 0; i < n_events; ++i) {
+    INSTRUMENTATION_MARK_SET(0, 1, uint32_t(i));
+  }
+  INSTRUMENTATION_THREAD_FINALIZE();
+}
+
+/**
+ * Copy the byte range of a section into a .bts file of its own
+ */
+static void extract(const fs::path &container,
+                    const TraCR::ContainerSection &section,
+                    const fs::path &filepath) {
+  std::ifstream ifs(container, std::ios::binary);
+  std::string bytes(section.size, '\0');
+  ifs.seekg(section.offset);
+  CHECK(ifs.read(bytes.data(), bytes.size()));
+  std::ofstream(filepath, std::ios::binary) << bytes;
+}
+
+/*
+ * Threads of a TRACR_SINGLE_FILE build write their trace files as sections of
+ * one container. Each section starts on CONTAINER_ALIGNMENT, holds a complete
+ * .bts image of the thread, and the metadata section comes last, right in
+ * front of the directory and the footer.
+ */
+int main() {
+  // Record counts that don't fill whole pages
+  const std::vector<size_t> n_events = {1, 1000, 4099, 70001};
+
+  const fs::path dir = fs::temp_directory_path() /
+                       ("tracr_trace_container." + std::to_string(getpid()));
+  fs::create_directories(dir);
+
+  INSTRUMENTATION_TRACE_PATH(dir.string() + "/");
+  INSTRUMENTATION_START();
+
+  std::vector<std::thread> threads;
+  for (size_t n : n_events) {
+    threads.emplace_back(record, n);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  INSTRUMENTATION_END();
+
+  std::vector<fs::path> containers;
+  for (const auto &entry : fs::directory_iterator(dir / "tracr")) {
+    if (entry.path().extension() == ".tracr") {
+      containers.push_back(entry.path());
+    }
+  }
+  CHECK(containers.size() == 1);
+  const fs::path &container = containers.front();
+  const size_t filesize = fs::file_size(container);
+
+  ContainerInfo info;
+  CHECK(read_container(container, info));
+  CHECK(info.header.alignment == TraCR::CONTAINER_ALIGNMENT);
+  CHECK(info.sections.size() == n_events.size() + 1);
+
+  // The footer points right behind the metadata
+  TraCR::ContainerFooter footer{};
+  {
+    std::ifstream ifs(container, std::ios::binary);
+    ifs.seekg(filesize - sizeof(footer));
+    CHECK(ifs.read(reinterpret_cast<char *>(&footer), sizeof(footer)));
+  }
+  CHECK(footer.num_sections == info.sections.size());
+  CHECK(footer.directory_offset +
+            footer.num_sections * sizeof(TraCR::ContainerSection) +
+            sizeof(footer) ==
+        filesize);
+
+  const TraCR::ContainerSection &metadata = info.sections.back();
+  CHECK(metadata.kind ==
+        static_cast<uint32_t>(TraCR::ContainerSectionKind::METADATA));
+  CHECK(metadata.offset + metadata.size == footer.directory_offset);
+  CHECK(nlohmann::json::parse(info.metadata).contains("start_time"));
+
+  // Aligned sections that don't overlap, one per thread
+  std::map<size_t, size_t> sizes;
+  uint64_t end = sizeof(TraCR::ContainerHeader);
+  for (size_t i = 0; i < info.sections.size(); ++i) {
+    const TraCR::ContainerSection &section = info.sections[i];
+    CHECK(section.offset % TraCR::CONTAINER_ALIGNMENT == 0);
+    CHECK(section.offset >= end);
+    end = section.offset + section.size;
+
+    if (i + 1 == info.sections.size()) {
+      break;
+    }
+    CHECK(section.kind ==
+          static_cast<uint32_t>(TraCR::ContainerSectionKind::TRACES));
+
+    // The section is the .bts file the thread would have written
+    BtsFileInfo bts;
+    CHECK(read_bts_info(container, bts, section.offset, section.size));
+    const size_t records = bts.trailer.num_records;
+    CHECK(bts.header.tid == section.tid);
+    CHECK(bts.records_begin == sizeof(TraCR::BtsHeader));
+    CHECK(bts.records_end - bts.records_begin ==
+          records * sizeof(TraCR::Payload));
+    CHECK(section.size == bts.records_end +
+                              bts.counts.size() *
+                                  sizeof(TraCR::BtsEventCount) +
+                              sizeof(TraCR::BtsTrailer));
+    ++sizes[records];
+
+    const fs::path file = dir / ("thread." + std::to_string(section.tid));
+    extract(container, section, file);
+    CHECK(fs::file_size(file) == section.size);
+
+    std::vector<TraCR::Payload> from_file, from_section;
+    CHECK(load_bts_file(file, from_file, false));
+    CHECK(load_bts_file(container, from_section, false, section.offset,
+                        section.size));
+    CHECK(from_file.size() == records);
+    CHECK(std::memcmp(from_file.data(), from_section.data(),
+                      records * sizeof(TraCR::Payload)) == 0);
+  }
+
+  for (size_t n : n_events) {
+    CHECK(sizes[n] == 1);
+  }
+
+  // Without the footer the container was not finished
+  fs::resize_file(container, filesize - sizeof(footer));
+  CHECK(!read_container(container, info));
+
+  fs::remove_all(dir);
+  return 0;
+}